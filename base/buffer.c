@@ -1,5 +1,8 @@
+#include <pthread.h>
 #include "buffer.h"
 
+// storage is taken on first write and given back by shrink or reset,
+// so an idle buffer costs only the struct
 struct buffer_t {
     char* buffer;
     int buffer_size;
@@ -10,6 +13,119 @@ struct buffer_t {
     buffer_free_func free_func;
 };
 
+// drained storage of default allocator is cached per thread
+typedef struct buffer_cache_list_t {
+    int size;
+    int count;
+    void* head;
+} cache_list_t;
+
+typedef struct buffer_cache_t {
+    int bytes;
+    cache_list_t lists[BUFFER_CACHE_SIZES];
+} cache_t;
+
+static pthread_key_t _cache_key;
+static pthread_once_t _cache_once = PTHREAD_ONCE_INIT;
+
+static void
+_buffer_cache_free(void* arg) {
+    cache_t* cache = (cache_t*)arg;
+    for (int i = 0; i < BUFFER_CACHE_SIZES; ++ i) {
+        void* p = cache->lists[i].head;
+        while (p) {
+            void* next = *(void**)p;
+            FREE(p);
+            p = next;
+        }
+    }
+    FREE(cache);
+}
+
+static void
+_buffer_cache_init() {
+    pthread_key_create(&_cache_key, _buffer_cache_free);
+}
+
+static cache_t*
+_buffer_cache(buffer_t* cb) {
+    if (cb->malloc_func != MALLOC || cb->free_func != FREE
+        || cb->buffer_size < (int)sizeof(void*)) {
+        return NULL;
+    }
+    pthread_once(&_cache_once, _buffer_cache_init);
+    cache_t* cache = (cache_t*)pthread_getspecific(_cache_key);
+    if (!cache) {
+        cache = (cache_t*)MALLOC(sizeof(cache_t));
+        if (!cache)
+            return NULL;
+        memset(cache, 0, sizeof(*cache));
+        if (pthread_setspecific(_cache_key, cache)) {
+            FREE(cache);
+            return NULL;
+        }
+    }
+    return cache;
+}
+
+static void
+_buffer_alloc(buffer_t* cb) {
+    cache_t* cache = _buffer_cache(cb);
+    if (cache) {
+        for (int i = 0; i < BUFFER_CACHE_SIZES; ++ i) {
+            cache_list_t* l = &cache->lists[i];
+            if (l->size == cb->buffer_size && l->head) {
+                cb->buffer = (char*)l->head;
+                l->head = *(void**)l->head;
+                -- l->count;
+                cache->bytes -= l->size;
+                return;
+            }
+        }
+    }
+    cb->buffer = (char*)cb->malloc_func(cb->buffer_size);
+    assert(cb->buffer);
+}
+
+static void
+_buffer_free(buffer_t* cb) {
+    cache_t* cache = _buffer_cache(cb);
+    if (cache && cache->bytes + cb->buffer_size <= BUFFER_CACHE_BYTES) {
+        // same size list, or an empty one to take over
+        cache_list_t* l = NULL;
+        for (int i = 0; i < BUFFER_CACHE_SIZES; ++ i) {
+            if (cache->lists[i].size == cb->buffer_size) {
+                l = &cache->lists[i];
+                break;
+            }
+            if (!l && 0 == cache->lists[i].count) {
+                l = &cache->lists[i];
+            }
+        }
+        if (l) {
+            l->size = cb->buffer_size;
+            *(void**)cb->buffer = l->head;
+            l->head = cb->buffer;
+            ++ l->count;
+            cache->bytes += l->size;
+            cb->buffer = NULL;
+            return;
+        }
+    }
+    cb->free_func(cb->buffer);
+    cb->buffer = NULL;
+}
+
+// move unread data to head when tail is short, instead of on every read
+static void
+_buffer_compact(buffer_t* cb) {
+    if (cb->read_pos > 0 && cb->buffer_size - cb->write_pos < cb->drift_threshold) {
+        memmove(cb->buffer, cb->buffer + cb->read_pos, cb->write_pos - cb->read_pos);
+        cb->write_pos -= cb->read_pos;
+        cb->read_pos = 0;
+    }
+}
+
 // buffer_size hint: 4 * max pkg size
 buffer_t*
 buffer_create(int buffer_size,
@@ -26,15 +142,16 @@ buffer_create(int buffer_size,
     cb->drift_threshold = buffer_size / 2;
     cb->malloc_func = malloc_func ? malloc_func : MALLOC;
     cb->free_func = free_func ? free_func : FREE;
-    cb->buffer = (char*)cb->malloc_func(buffer_size);
-    assert(cb->buffer);
+    cb->buffer = NULL;
     return cb;
 }
 
 int
 buffer_release(buffer_t* cb) {
     if (cb) {
-        cb->free_func(cb->buffer);
+        if (cb->buffer) {
+            _buffer_free(cb);
+        }
         FREE(cb);
     }
     return 0;
@@ -67,13 +184,9 @@ buffer_read_nocopy(buffer_t* cb, int len) {
     }
     cb->read_pos += len;
     assert(cb->write_pos >= cb->read_pos);
-    // check drift threshold
-    if (cb->read_pos > cb->drift_threshold) {
-        const char* shift = buffer_read_buffer(cb);
-        // threshold is half size, so memcpy src & dst will never overlap to escape memmove
-        memcpy(cb->buffer, shift, cb->write_pos - cb->read_pos);
-        cb->write_pos -= cb->read_pos;
-        cb->read_pos = 0;
+    // drained, storage is kept for the next message
+    if (cb->read_pos == cb->write_pos) {
+        cb->read_pos = cb->write_pos = 0;
     }
     return len;
 }
@@ -112,14 +225,18 @@ buffer_write(buffer_t* cb, const char* src, int len) {
     return buffer_write_nocopy(cb, len);
 }
 
+// no compaction, data may be written at buffer_write_buffer already
 int
 buffer_write_nocopy(buffer_t* cb, int len) {
-    if (buffer_write_len(cb) < len) {
-        return buffer_write_nocopy(cb, buffer_write_len(cb));
-    }
-    if (len < 0) {
+    if (!cb || len < 0) {
         return -1;
     }
+    if (cb->buffer_size - cb->write_pos < len) {
+        return buffer_write_nocopy(cb, cb->buffer_size - cb->write_pos);
+    }
+    if (len > 0 && !cb->buffer) {
+        _buffer_alloc(cb);
+    }
     cb->write_pos += len;
     assert(cb->write_pos <= cb->buffer_size);
     return len;
@@ -131,6 +248,20 @@ buffer_reset(buffer_t* cb) {
         return -1;
     }
     cb->read_pos = cb->write_pos = 0;
+    if (cb->buffer) {
+        _buffer_free(cb);
+    }
+    return 0;
+}
+
+int
+buffer_shrink(buffer_t* cb) {
+    if (!cb) {
+        return -1;
+    }
+    if (cb->buffer && cb->read_pos == cb->write_pos) {
+        buffer_reset(cb);
+    }
     return 0;
 }
 
@@ -142,8 +273,9 @@ buffer_debug(buffer_t* cb) {
     }
     memset(debug_str, 0, sizeof(debug_str));
     snprintf(debug_str, sizeof(debug_str),
-        "size=%d, read_pos=%d, write_pos=%d",
+        "size=%d, alloc=%d, read_pos=%d, write_pos=%d",
         cb->buffer_size,
+        cb->buffer ? 1 : 0,
         cb->read_pos,
         cb->write_pos);
     return debug_str;
@@ -151,11 +283,15 @@ buffer_debug(buffer_t* cb) {
 
 char*
 buffer_read_buffer(buffer_t* cb) {
-    return cb->buffer + cb->read_pos;
+    return (cb->buffer && cb->write_pos > cb->read_pos) ? cb->buffer + cb->read_pos : NULL;
 }
 
 char*
 buffer_write_buffer(buffer_t* cb) {
+    if (!cb->buffer) {
+        _buffer_alloc(cb);
+    }
+    _buffer_compact(cb);
     return cb->buffer + cb->write_pos;
 }
 
@@ -172,6 +308,31 @@ buffer_write_len(buffer_t* cb) {
     if (!cb) {
         return -1;
     }
+    if (cb->buffer) {
+        _buffer_compact(cb);
+    }
     return cb->buffer_size - cb->write_pos;
 }
 
+int
+buffer_read_iov(buffer_t* cb, struct iovec* iov) {
+    int len = buffer_read_len(cb);
+    if (len <= 0 || !iov) {
+        return 0;
+    }
+    iov->iov_base = buffer_read_buffer(cb);
+    iov->iov_len = len;
+    return 1;
+}
+
+int
+buffer_write_iov(buffer_t* cb, struct iovec* iov) {
+    int len = buffer_write_len(cb);
+    if (len <= 0 || !iov) {
+        return 0;
+    }
+    iov->iov_base = buffer_write_buffer(cb);
+    iov->iov_len = len;
+    return 1;
+}
+
@@ -3,6 +3,9 @@
 
 //
 // buffer for connection, read / write like pop / push
+// storage is allocated on first write and kept while in use,
+// released by buffer_shrink (when empty) or buffer_reset,
+// default allocator keeps released storage in a per-thread cache
 //
 
 #ifdef __cplusplus
@@ -10,8 +13,13 @@ extern "C" {
 #endif
 
 #include <assert.h>
+#include <sys/uio.h>
 #include "core/os_def.h"
 
+// per-thread cache of released storage
+#define BUFFER_CACHE_SIZES 4
+#define BUFFER_CACHE_BYTES (4 << 20)
+
 typedef struct buffer_t buffer_t;
 
 typedef void* (*buffer_malloc_func)(size_t);
@@ -31,17 +39,25 @@ int buffer_peek(buffer_t*, char* dest, int len);
 int buffer_write(buffer_t*, const char* src, int len);
 int buffer_write_nocopy(buffer_t*, int len);
 
+// drop data, and release storage
 int buffer_reset(buffer_t*);
+// release storage if empty
+int buffer_shrink(buffer_t*);
 
 // not thread safe
 const char* buffer_debug(buffer_t*);
 
+// read buffer is NULL if empty, write buffer allocates storage
 char* buffer_read_buffer(buffer_t*);
 char* buffer_write_buffer(buffer_t*);
 
 int buffer_read_len(buffer_t*);
 int buffer_write_len(buffer_t*);
 
+// iovec views, return iovec count (0 or 1)
+int buffer_read_iov(buffer_t*, struct iovec*);
+int buffer_write_iov(buffer_t*, struct iovec*);
+
 #ifdef __cplusplus
 }
 #endif
@@ -172,6 +172,31 @@ _heap_rotdown(heap_t* heap, int pos) {
     }
 }
 
+static void
+_heap_rotup(heap_t* heap, int pos) {
+    while (pos > 0) {
+        int pos_up = HEAP_PARENT(pos);
+        if (heap->cmp_func(heap->array[pos].data, heap->array[pos_up].data) >= 0) {
+            break;
+        }
+        _heap_swap(heap, pos, pos_up);
+        pos = pos_up;
+    }
+}
+
+// the node at pos is changed, rotate up if less than parent, or down
+static void
+_heap_fix(heap_t* heap, int pos) {
+    if (pos >= (int)heap->size)
+        return;
+    if (pos > 0 && heap->cmp_func(heap->array[pos].data,
+        heap->array[HEAP_PARENT(pos)].data) < 0) {
+        _heap_rotup(heap, pos);
+    } else {
+        _heap_rotdown(heap, pos);
+    }
+}
+
 //  return >= 0, success, return key which used to erase data
 //  return < 0, fail
 int
@@ -194,16 +219,7 @@ heap_insert(heap_t* heap, void* data) {
     heap->key_table[node->heap_key] = heap->size - 1;
     _heap_set_next_key(heap);
 
-    // rotate up
-    int pos = heap->size - 1;
-    while (pos > 0) {
-        int pos_up = HEAP_PARENT(pos);
-        if (heap->cmp_func(heap->array[pos].data, heap->array[pos_up].data) >= 0) {
-            break;
-        }
-        _heap_swap(heap, pos, pos_up);
-        pos = pos_up;
-    }
+    _heap_rotup(heap, heap->size - 1);
     return res;
 }
 
@@ -223,7 +239,8 @@ heap_erase(heap_t* heap, int key) {
     _heap_swap(heap, index, heap->size - 1);
     heap->size --;
 
-    _heap_rotdown(heap, index);
+    // the last one moved in may be less than the parent
+    _heap_fix(heap, index);
 
     heap->key_table[key] = -1;
     return data;
@@ -237,7 +254,7 @@ heap_update(heap_t* heap, int key, void* data) {
     if (index < 0)
         return;
     heap->array[index].data = data;
-    _heap_rotdown(heap, index);
+    _heap_fix(heap, index);
 }
 
 int
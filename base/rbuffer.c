@@ -1,33 +1,91 @@
+
 #include <assert.h>
 
 #include "core/atom.h"
 #include "rbuffer.h"
 
+// every record is [head][data], rounded up by RBUFFER_ALIGN
+// so a record never splits across the buffer tail:
+// when tail space is not enough, a skip head is written and writer wraps
+typedef struct rbuffer_head_t {
+    uint32_t len;
+    // set by writer, 0 by default
+    uint32_t stamp;
+} head_t;
+
+#define RBUFFER_ALIGN sizeof(head_t)
+#define RBUFFER_SKIP 0xffffffff
+// multi-producer only: reserved but not committed yet,
+// and the gap left by a commit shorter than reserved
+#define RBUFFER_BUSY 0x80000000
+#define RBUFFER_GAP 0x40000000
+#define RBUFFER_FLAG_MPSC 0x1
+#define RBUFFER_RECORD(len) ROUNDUP2((uint32_t)(len) + sizeof(head_t), RBUFFER_ALIGN)
+
+// writer & reader positions live in separate cache lines,
+// each side keeps a cached copy of the other one's position in its own line,
+// and reloads it (acquire) only when the cached one is not enough
+#define RBUFFER_PAD (CACHE_LINE_SIZE - 2 * sizeof(uint32_t))
+
 struct rbuffer_t {
     uint32_t size;
-    volatile atom_t read_pos;
-    volatile atom_t write_pos;
+    uint32_t flag;
+    char pad0[RBUFFER_PAD];
+    // written by writer
+    atom_t write_pos;
+    uint32_t read_cache;
+    char pad1[RBUFFER_PAD];
+    // written by reader
+    atom_t read_pos;
+    uint32_t write_cache;
+    char pad2[RBUFFER_PAD];
     char buffer[0];
 };
 
-rbuffer_t*
-rbuffer_create(uint32_t size) {
+static void
+_rbuffer_init(rbuffer_t* r, uint32_t size, uint32_t flag) {
+    r->size = size;
+    r->flag = flag;
+    // multi-producer reader finds records by non-zero heads
+    if (flag & RBUFFER_FLAG_MPSC) {
+        memset(r->buffer, 0, size);
+    }
+    r->write_pos = 0;
+    r->read_cache = 0;
+    r->read_pos = 0;
+    r->write_cache = 0;
+    __sync_synchronize();
+}
+
+static rbuffer_t*
+_rbuffer_create(uint32_t size, uint32_t flag) {
 	rbuffer_t* r;
     // round up by 2^n
     if (size & (size - 1)) {
         size = ROUNDUP(size);
+    }
+    if (size < RBUFFER_ALIGN) {
+        size = RBUFFER_ALIGN;
     }
 	// malloc
     r = (rbuffer_t*)MALLOC(sizeof(rbuffer_t) + size);
     if (!r) { return NULL; }
-    r->size = size;
-    atom_set(&r->read_pos, 0);
-    atom_set(&r->write_pos, 0);
+    _rbuffer_init(r, size, flag);
     return r;
 }
 
 rbuffer_t*
-rbuffer_attach(void* mem, size_t mem_size) {
+rbuffer_create(uint32_t size) {
+    return _rbuffer_create(size, 0);
+}
+
+rbuffer_t*
+rbuffer_create_mpsc(uint32_t size) {
+    return _rbuffer_create(size, RBUFFER_FLAG_MPSC);
+}
+
+static rbuffer_t*
+_rbuffer_attach(void* mem, size_t mem_size, uint32_t flag) {
     rbuffer_t* r;
     uint32_t size;
     if (!mem || mem_size < sizeof(struct rbuffer_t)) {
@@ -37,14 +95,36 @@ rbuffer_attach(void* mem, size_t mem_size) {
     if (size & (size - 1)) {
         size = ROUNDDOWN(size);
     }
-    if (size == 0) {
+    if (size < RBUFFER_ALIGN) {
         return NULL;
     }
     // assignment
     r = (rbuffer_t*)mem;
-    r->size = size;
-    atom_set(&r->read_pos, 0);
-    atom_set(&r->write_pos, 0);
+    _rbuffer_init(r, size, flag);
+    return r;
+}
+
+rbuffer_t*
+rbuffer_attach(void* mem, size_t mem_size) {
+    return _rbuffer_attach(mem, mem_size, 0);
+}
+
+rbuffer_t*
+rbuffer_attach_mpsc(void* mem, size_t mem_size) {
+    return _rbuffer_attach(mem, mem_size, RBUFFER_FLAG_MPSC);
+}
+
+rbuffer_t*
+rbuffer_attach_exist(void* mem, size_t mem_size) {
+    rbuffer_t* r;
+    if (!mem || mem_size < sizeof(struct rbuffer_t)) {
+        return NULL;
+    }
+    r = (rbuffer_t*)mem;
+    if (r->size < RBUFFER_ALIGN || (r->size & (r->size - 1))
+        || r->size > mem_size - sizeof(struct rbuffer_t)) {
+        return NULL;
+    }
     return r;
 }
 
@@ -63,112 +143,396 @@ rbuffer_head_size() {
     return sizeof(rbuffer_t);
 }
 
+uint32_t
+rbuffer_record_size(size_t size) {
+    return RBUFFER_RECORD(size);
+}
+
+int
+rbuffer_mpsc(rbuffer_t* r) {
+    return (r && (r->flag & RBUFFER_FLAG_MPSC)) ? 1 : 0;
+}
+
 uint32_t
 rbuffer_read_bytes(rbuffer_t* r) {
-    uint32_t write_pos = r->write_pos;
-    uint32_t read_pos = r->read_pos;
-    uint32_t min_len = sizeof(uint32_t);
+    uint32_t write_pos = atom_load_acquire(&r->write_pos);
+    uint32_t read_pos = atom_load_acquire(&r->read_pos);
+    uint32_t min_len = sizeof(head_t);
     if (write_pos - read_pos >= min_len) {
         return write_pos - read_pos - min_len;
     }
     return 0;
 }
 
+uint32_t
+rbuffer_reader_bytes(rbuffer_t* r) {
+    uint32_t write_pos = (r->flag & RBUFFER_FLAG_MPSC)
+        ? atom_load_acquire(&r->write_pos) : r->write_cache;
+    uint32_t min_len = sizeof(head_t);
+    if (write_pos - r->read_pos >= min_len) {
+        return write_pos - r->read_pos - min_len;
+    }
+    return 0;
+}
+
 uint32_t
 rbuffer_write_bytes(rbuffer_t* r) {
-    uint32_t write_pos = r->write_pos;
-    uint32_t read_pos = r->read_pos;
-    uint32_t min_len = sizeof(uint32_t);
+    uint32_t write_pos = atom_load_acquire(&r->write_pos);
+    uint32_t read_pos = atom_load_acquire(&r->read_pos);
+    uint32_t min_len = sizeof(head_t);
     if (write_pos - read_pos >= r->size - min_len) {
         return 0;
     }
     return r->size - min_len - (write_pos - read_pos);
 }
 
-int
-rbuffer_read(rbuffer_t* r, char* buf, size_t* buf_size) {
-    int ret = rbuffer_peek(r, buf, buf_size);
-    if (0 == ret) {
-        atom_add(&r->read_pos, (sizeof(uint32_t) + *buf_size));
+static inline head_t*
+_rbuffer_head(rbuffer_t* r, uint32_t pos) {
+    return (head_t*)(r->buffer + (pos & (r->size - 1)));
+}
+
+// writer only, wpos - read_cache never exceeds size as writer never passes it
+static inline int
+_rbuffer_writable(rbuffer_t* r, uint32_t wpos, uint32_t need) {
+    if (need <= r->size - (wpos - r->read_cache)) {
+        return 1;
     }
-    return ret;
+    r->read_cache = atom_load_acquire(&r->read_pos);
+    return need <= r->size - (wpos - r->read_cache);
+}
+
+// multi-producer: ticket by cas on write pos, no cached read pos as writers share it
+// the record is busy until committed, reader stops at it
+static char*
+_rbuffer_reserve_mpsc(rbuffer_t* r, size_t size) {
+    uint32_t need, wpos, rpos, to_tail;
+    head_t* head;
+    do {
+        wpos = atom_load_acquire(&r->write_pos);
+        rpos = atom_load_acquire(&r->read_pos);
+        need = RBUFFER_RECORD(size);
+        to_tail = r->size - (wpos & (r->size - 1));
+        if (need > to_tail) {
+            need += to_tail;
+        }
+        if (need > r->size - (wpos - rpos)) {
+            return NULL;
+        }
+    } while (!__sync_bool_compare_and_swap(&r->write_pos, wpos, wpos + need));
+
+    head = _rbuffer_head(r, wpos);
+    if (need > RBUFFER_RECORD(size)) {
+        head->stamp = 0;
+        atom_store_release(&head->len, RBUFFER_SKIP);
+        head = (head_t*)r->buffer;
+    }
+    head->stamp = 0;
+    atom_store_release(&head->len, (uint32_t)size | RBUFFER_BUSY);
+    return (char*)(head + 1);
+}
+
+char*
+rbuffer_reserve(rbuffer_t* r, size_t size) {
+    uint32_t need, wpos, to_tail;
+    head_t* head;
+    if (!r || size == 0 || size > r->size) {
+        return NULL;
+    }
+    if (r->flag & RBUFFER_FLAG_MPSC) {
+        return size < RBUFFER_GAP ? _rbuffer_reserve_mpsc(r, size) : NULL;
+    }
+    need = RBUFFER_RECORD(size);
+    wpos = r->write_pos;
+    to_tail = r->size - (wpos & (r->size - 1));
+    // skip the tail, record starts from buffer head
+    if (need > to_tail) {
+        need += to_tail;
+    }
+    if (!_rbuffer_writable(r, wpos, need)) {
+        return NULL;
+    }
+    head = _rbuffer_head(r, wpos);
+    if (need > RBUFFER_RECORD(size)) {
+        head->len = RBUFFER_SKIP;
+        head = (head_t*)r->buffer;
+    }
+    // reserved length, for commit validation
+    head->len = size;
+    head->stamp = 0;
+    return (char*)(head + 1);
 }
 
 int
-rbuffer_peek(rbuffer_t* r, char* buf, size_t* buf_size) {
-    uint32_t read_to_tail, least, read_to_tail_least, read_len, read_to_tail_bytes;
-    if (!r || !buf || !buf_size) {
+rbuffer_commit(rbuffer_t* r, size_t size) {
+    return rbuffer_commit_stamp(r, size, 0);
+}
+
+int
+rbuffer_commit_stamp(rbuffer_t* r, size_t size, uint32_t stamp) {
+    uint32_t nwrites, wpos;
+    head_t* head;
+    if (!r || size == 0 || (r->flag & RBUFFER_FLAG_MPSC)) {
         return -1;
     }
-    if (0 == rbuffer_read_bytes(r)) {
+    nwrites = 0;
+    wpos = r->write_pos;
+    head = _rbuffer_head(r, wpos);
+    if (head->len == RBUFFER_SKIP) {
+        nwrites = r->size - (wpos & (r->size - 1));
+        head = (head_t*)r->buffer;
+    }
+    if (size > head->len) {
         return -1;
     }
+    head->len = size;
+    head->stamp = stamp;
+    nwrites += RBUFFER_RECORD(size);
 
-    read_to_tail = r->size - (r->read_pos & (r->size - 1));
-    least = sizeof(uint32_t);
-    read_to_tail_least = (read_to_tail < least ? read_to_tail : least);
+    // publish the record
+    atom_store_release(&r->write_pos, wpos + nwrites);
+    return 0;
+}
 
-    // get data length
-    memcpy(&read_len, r->buffer + (r->read_pos & (r->size - 1)), read_to_tail_least);
-    if (read_to_tail_least < least) {
-        memcpy((char*)&read_len + read_to_tail_least, r->buffer, least - read_to_tail_least);
+// multi-producer: the tail of a shorter commit is left as a gap record
+static int
+_rbuffer_commit_mpsc(rbuffer_t* r, char* data, size_t size, uint32_t stamp) {
+    head_t* head = (head_t*)data - 1;
+    uint32_t reserved, span, used;
+    if (head->len == RBUFFER_SKIP || !(head->len & RBUFFER_BUSY)) {
+        return -1;
     }
-    // check data length
-    if (read_len > r->size - least || read_len > *buf_size) {
+    reserved = head->len & ~RBUFFER_BUSY;
+    if (size > reserved) {
         return -1;
     }
+    span = RBUFFER_RECORD(reserved);
+    used = RBUFFER_RECORD(size);
+    if (span > used) {
+        head_t* gap = (head_t*)((char*)head + used);
+        gap->stamp = 0;
+        atom_store_release(&gap->len, (span - used) | RBUFFER_GAP);
+    }
+    head->stamp = stamp;
+    atom_store_release(&head->len, (uint32_t)size);
+    return 0;
+}
 
-    // copy data from buffer
-    if (read_to_tail_least < least) {
-        memcpy(buf, r->buffer + least - read_to_tail_least, read_len);
-    } else {
-        read_to_tail -= least;
-        read_to_tail_bytes = (read_len < read_to_tail ? read_len : read_to_tail);
-        memcpy(buf, r->buffer + ((r->read_pos + least) & (r->size - 1)), read_to_tail_bytes);
-        if (read_to_tail_bytes < read_len) {
-            memcpy(buf + read_to_tail_bytes, r->buffer, read_len - read_to_tail_bytes);
+int
+rbuffer_commit_ptr(rbuffer_t* r, char* data, size_t size, uint32_t stamp) {
+    if (!r || !data || size == 0) {
+        return -1;
+    }
+    if (r->flag & RBUFFER_FLAG_MPSC) {
+        return _rbuffer_commit_mpsc(r, data, size, stamp);
+    }
+    return rbuffer_commit_stamp(r, size, stamp);
+}
+
+// reader only, cached write pos never falls behind reader's position
+// cursor readers share nothing, so they load write pos every time
+static inline int
+_rbuffer_readable(rbuffer_t* r, uint32_t pos, uint32_t* cache) {
+    if (!cache) {
+        return atom_load_acquire(&r->write_pos) != pos;
+    }
+    if (*cache != pos) {
+        return 1;
+    }
+    *cache = atom_load_acquire(&r->write_pos);
+    return *cache != pos;
+}
+
+static const char*
+_rbuffer_peek_at(rbuffer_t* r, volatile uint32_t* pos, uint32_t* cache, size_t* size) {
+    uint32_t rpos;
+    head_t* head;
+    if (!r || !pos || !size) {
+        return NULL;
+    }
+    rpos = *pos;
+    if (!_rbuffer_readable(r, rpos, cache)) {
+        return NULL;
+    }
+    head = _rbuffer_head(r, rpos);
+    if (head->len == RBUFFER_SKIP) {
+        rpos += r->size - (rpos & (r->size - 1));
+        atom_store_release(pos, rpos);
+        if (!_rbuffer_readable(r, rpos, cache)) {
+            return NULL;
         }
+        head = (head_t*)r->buffer;
     }
+    *size = head->len;
+    return (const char*)(head + 1);
+}
 
-    // set read buf size
-    *buf_size = read_len;
+static int
+_rbuffer_consume_at(rbuffer_t* r, volatile uint32_t* pos, uint32_t* cache) {
+    size_t size;
+    if (!_rbuffer_peek_at(r, pos, cache, &size)) {
+        return -1;
+    }
+    atom_store_release(pos, *pos + RBUFFER_RECORD(size));
+    return 0;
+}
+
+// multi-producer: write pos may run ahead of committed records,
+// so reader stops at the first busy (or zero) head,
+// and zeros what it consumed, as a new head could land anywhere
+static const char*
+_rbuffer_peek_mpsc(rbuffer_t* r, size_t* size) {
+    uint32_t rpos, len;
+    head_t* head;
+    if (!size) {
+        return NULL;
+    }
+    rpos = r->read_pos;
+    while (1) {
+        head = _rbuffer_head(r, rpos);
+        len = atom_load_acquire(&head->len);
+        if (len == RBUFFER_SKIP) {
+            head->len = 0;
+            rpos += r->size - (rpos & (r->size - 1));
+        } else if (len == 0 || (len & RBUFFER_BUSY)) {
+            return NULL;
+        } else if (len & RBUFFER_GAP) {
+            len &= ~RBUFFER_GAP;
+            memset(head, 0, len);
+            rpos += len;
+        } else {
+            *size = len;
+            return (const char*)(head + 1);
+        }
+        atom_store_release(&r->read_pos, rpos);
+    }
+}
+
+static int
+_rbuffer_consume_mpsc(rbuffer_t* r) {
+    size_t size;
+    const char* data = _rbuffer_peek_mpsc(r, &size);
+    if (!data) {
+        return -1;
+    }
+    size = RBUFFER_RECORD(size);
+    memset((char*)data - sizeof(head_t), 0, size);
+    atom_store_release(&r->read_pos, r->read_pos + size);
+    return 0;
+}
+
+const char*
+rbuffer_peek_ptr(rbuffer_t* r, size_t* size) {
+    if (!r) {
+        return NULL;
+    }
+    if (r->flag & RBUFFER_FLAG_MPSC) {
+        return _rbuffer_peek_mpsc(r, size);
+    }
+    return _rbuffer_peek_at(r, &r->read_pos, &r->write_cache, size);
+}
+
+int
+rbuffer_consume(rbuffer_t* r) {
+    if (!r) {
+        return -1;
+    }
+    if (r->flag & RBUFFER_FLAG_MPSC) {
+        return _rbuffer_consume_mpsc(r);
+    }
+    return _rbuffer_consume_at(r, &r->read_pos, &r->write_cache);
+}
+
+int
+rbuffer_read(rbuffer_t* r, char* buf, size_t* buf_size) {
+    int ret = rbuffer_peek(r, buf, buf_size);
+    if (0 == ret) {
+        ret = rbuffer_consume(r);
+    }
+    return ret;
+}
+
+int
+rbuffer_peek(rbuffer_t* r, char* buf, size_t* buf_size) {
+    const char* data;
+    size_t len;
+    if (!r || !buf || !buf_size) {
+        return -1;
+    }
+    data = rbuffer_peek_ptr(r, &len);
+    if (!data || len > *buf_size) {
+        return -1;
+    }
+    memcpy(buf, data, len);
+    *buf_size = len;
     return 0;
 }
 
 int
 rbuffer_write(rbuffer_t* r, const char* buf, size_t buf_size) {
-    uint32_t len_size, nwrites, write_to_tail, min_len_size, write_to_tail_bytes;
+    return rbuffer_write_stamp(r, buf, buf_size, 0);
+}
+
+int
+rbuffer_write_stamp(rbuffer_t* r, const char* buf, size_t buf_size, uint32_t stamp) {
+    char* data;
     if (!r || !buf) return -1;
     if (0 == buf_size) return 0;
-
-    len_size = sizeof(uint32_t);
-    nwrites = buf_size + len_size;
-    if (rbuffer_write_bytes(r) < buf_size) {
+    data = rbuffer_reserve(r, buf_size);
+    if (!data) {
         return -1;
     }
-    write_to_tail = r->size - (r->write_pos & (r->size - 1));
-    min_len_size = (len_size < write_to_tail ? len_size : write_to_tail);
+    memcpy(data, buf, buf_size);
+    return rbuffer_commit_ptr(r, data, buf_size, stamp);
+}
 
-    // write length first
-    memcpy(r->buffer + (r->write_pos & (r->size - 1)), &buf_size, min_len_size);
-    if (min_len_size < len_size) {
-        memcpy(r->buffer, (char*)&buf_size + min_len_size, len_size - min_len_size);
-    }
+uint32_t
+rbuffer_stamp(const char* data) {
+    return data ? ((const head_t*)data - 1)->stamp : 0;
+}
 
-    // write data to buffer
-    if (write_to_tail > len_size) {
-        write_to_tail -= len_size;
-        write_to_tail_bytes = (buf_size < write_to_tail ? buf_size : write_to_tail);
-        memcpy(r->buffer + ((r->write_pos + len_size) & (r->size - 1)), buf, write_to_tail_bytes);
-        if (write_to_tail_bytes < buf_size) {
-            memcpy(r->buffer, buf + write_to_tail_bytes, buf_size - write_to_tail_bytes);
-        }
-    } else {
-        memcpy(r->buffer + len_size - min_len_size, buf, buf_size);
-    }
+uint32_t
+rbuffer_write_pos(rbuffer_t* r) {
+    return atom_load_acquire(&r->write_pos);
+}
+
+void
+rbuffer_cursor_sync(rbuffer_t* r, uint32_t slowest) {
+    atom_store_release(&r->read_pos, slowest);
+}
 
-    // set write pos
-    atom_add(&r->write_pos, nwrites);
+uint32_t
+rbuffer_cursor_read_bytes(rbuffer_t* r, volatile uint32_t* cursor) {
+    uint32_t write_pos = atom_load_acquire(&r->write_pos);
+    uint32_t read_pos = atom_load_acquire(cursor);
+    uint32_t min_len = sizeof(head_t);
+    if (write_pos - read_pos >= min_len) {
+        return write_pos - read_pos - min_len;
+    }
     return 0;
 }
 
+const char*
+rbuffer_cursor_peek_ptr(rbuffer_t* r, volatile uint32_t* cursor, size_t* size) {
+    return _rbuffer_peek_at(r, cursor, NULL, size);
+}
+
+int
+rbuffer_cursor_consume(rbuffer_t* r, volatile uint32_t* cursor) {
+    return _rbuffer_consume_at(r, cursor, NULL);
+}
+
+int
+rbuffer_cursor_read(rbuffer_t* r, volatile uint32_t* cursor, char* buf, size_t* buf_size) {
+    const char* data;
+    size_t len;
+    if (!r || !buf || !buf_size) {
+        return -1;
+    }
+    data = _rbuffer_peek_at(r, cursor, NULL, &len);
+    if (!data || len > *buf_size) {
+        return -1;
+    }
+    memcpy(buf, data, len);
+    *buf_size = len;
+    return _rbuffer_consume_at(r, cursor, NULL);
+}
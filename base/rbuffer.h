@@ -4,6 +4,13 @@
 // it's a ring buffer, as atomic flags, so it's 'lock-free'
 // BUT, support only single reading thread & writing thread
 // multi reading threads or writing threads will cause un-expected problems
+// except multi-producer mode (create_mpsc/attach_mpsc), with multi writing threads
+//
+// records are stored continuously (never split across buffer tail),
+// so they could be written & parsed in place by reserve/commit & peek_ptr/consume
+//
+// write & read positions are in separate cache lines with acquire/release ordering,
+// so writer and reader processes don't bounce one line on every record
 
 #ifdef __cplusplus
 extern "C" {
@@ -16,20 +23,64 @@ typedef struct rbuffer_t rbuffer_t;
 rbuffer_t* rbuffer_create(uint32_t size);
 void rbuffer_release(rbuffer_t* r);
 
+// multi-producer & single consumer:
+// writers claim space by cas, then commit every record by its own flag,
+// reader stops at the first record not committed yet
+// so a reserved record must be committed soon, or it blocks the reader
+rbuffer_t* rbuffer_create_mpsc(uint32_t size);
+rbuffer_t* rbuffer_attach_mpsc(void* mem, size_t mem_size);
+int rbuffer_mpsc(rbuffer_t* r);
+
 // create from an allocated memory
 // if create from memory, usually we don't need to release it
 rbuffer_t* rbuffer_attach(void* mem, size_t mem_size);
+// attach an initialized ring buffer (by others), keep its data
+rbuffer_t* rbuffer_attach_exist(void* mem, size_t mem_size);
 
 size_t rbuffer_size(rbuffer_t* r);
 size_t rbuffer_head_size();
+// bytes a record of size takes in buffer, with its head & alignment
+uint32_t rbuffer_record_size(size_t size);
 
 uint32_t rbuffer_read_bytes(rbuffer_t* r);
 uint32_t rbuffer_write_bytes(rbuffer_t* r);
+// reader only, by its cached write pos, no load of writer's cache line
+// (multi-producer has no cache, and loads write pos)
+uint32_t rbuffer_reader_bytes(rbuffer_t* r);
 
 int rbuffer_read(rbuffer_t* r, char* buf, size_t* buf_size);
 int rbuffer_peek(rbuffer_t* r, char* buf, size_t* buf_size);
 int rbuffer_write(rbuffer_t* r, const char* buf, size_t buf_size);
 
+// zero-copy writing: reserve continuous space, fill it, then commit
+// commit size should be no more than reserved size
+// return NULL means not enough space
+char* rbuffer_reserve(rbuffer_t* r, size_t size);
+int rbuffer_commit(rbuffer_t* r, size_t size);
+// commit by the reserved pointer, the only way for multi-producer mode
+int rbuffer_commit_ptr(rbuffer_t* r, char* data, size_t size, uint32_t stamp);
+
+// zero-copy reading: peek record in place, then consume it
+// return NULL means empty
+const char* rbuffer_peek_ptr(rbuffer_t* r, size_t* size);
+int rbuffer_consume(rbuffer_t* r);
+
+// every record could carry a 32 bits stamp set by writer (e.g. enqueue time)
+// reader gets it by the record data pointer from peek_ptr
+int rbuffer_write_stamp(rbuffer_t* r, const char* buf, size_t buf_size, uint32_t stamp);
+int rbuffer_commit_stamp(rbuffer_t* r, size_t size, uint32_t stamp);
+uint32_t rbuffer_stamp(const char* data);
+
+// single writer & multi readers (broadcast):
+// every reader keeps its own cursor (init by write pos),
+// and writer syncs the slowest cursor as read pos before writing
+uint32_t rbuffer_write_pos(rbuffer_t* r);
+void rbuffer_cursor_sync(rbuffer_t* r, uint32_t slowest);
+uint32_t rbuffer_cursor_read_bytes(rbuffer_t* r, volatile uint32_t* cursor);
+int rbuffer_cursor_read(rbuffer_t* r, volatile uint32_t* cursor, char* buf, size_t* buf_size);
+const char* rbuffer_cursor_peek_ptr(rbuffer_t* r, volatile uint32_t* cursor, size_t* size);
+int rbuffer_cursor_consume(rbuffer_t* r, volatile uint32_t* cursor);
+
 #ifdef __cplusplus
 }
 #endif
@@ -90,6 +90,17 @@ timer_unregister(timerheap_t* timer, int timer_id) {
     if (node) FREE(node);
 }
 
+int
+timer_next(timerheap_t* timer, tv_t* due) {
+    if (!timer || !due)
+        return -1;
+    node_t* top = (node_t*)heap_top(timer->heap);
+    if (!top)
+        return -1;
+    memcpy(due, &top->expire_time, sizeof(tv_t));
+    return 0;
+}
+
 void
 timer_poll(timerheap_t* timer, tv_t* now) {
     if (!timer || !now)
@@ -110,8 +121,8 @@ timer_poll(timerheap_t* timer, tv_t* now) {
                 util_time_add(now, &top->interval_time, &top->expire_time);
                 heap_update(timer->heap, top->timer_id, top);
             } else {
-                // erase timer
-                top = (node_t*)heap_pop(timer->heap);
+                // erase timer by id, as callback may register new timers
+                heap_erase(timer->heap, top->timer_id);
                 FREE(top);
             }
             continue;
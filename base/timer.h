@@ -34,6 +34,10 @@ void timer_unregister(timerheap_t*, int timerid);
 
 void timer_poll(timerheap_t*, tv_t* now);
 
+// due time of the nearest timer
+// return < 0 if no timer
+int timer_next(timerheap_t*, tv_t* due);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,427 @@
+#include <assert.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "logic/bus.h"
+
+//
+// bus benchmark, every case forks real processes over the same bus key
+// results are printed as json lines, one line per case:
+//  pingpong: one message round trip, latency is the half of it
+//  stream: 1..N producers to one consumer, throughput as fast as they can.
+//      with -rate, each producer sends paced, and one-way latency is taken
+//      from the scheduled send time. unpaced latency is queue backlog only,
+//      so it's not reported
+//
+
+#define BENCH_BUS_KEY 0x1240
+#define BENCH_ADDR_CONSUMER ((1 << 16) + 1)
+#define BENCH_ADDR_PRODUCER(i) ((2 << 16) + (i) + 1)
+#define BENCH_PIPE_SIZE (4 << 20)
+#define BENCH_MAX_SIZE (64 << 10)
+#define BENCH_MAX_BYTES (256 << 20)
+#define BENCH_MAX_SIZES 32
+#define BENCH_MAX_PRODUCERS 128
+#define BENCH_BATCH 16
+#define BENCH_WARMUP 1000
+
+typedef struct bench_msg_t {
+    uint64_t stamp;
+    uint32_t seq;
+    uint32_t stop;
+} bench_msg_t;
+
+static int16_t _key = BENCH_BUS_KEY;
+static int _count = 100000;
+static int _producers = 4;
+static int _wait = 0;
+static int _rate = 0;
+static int _pingpong = 1;
+static int _stream = 1;
+static int _sizes[BENCH_MAX_SIZES] = { 16, 64, 256, 1024, 4096, 16384, 65536 };
+static int _nsizes = 7;
+
+static uint64_t
+_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// messages count of the size, bytes limited
+static int
+_bench_count(int size) {
+    int limit = BENCH_MAX_BYTES / size;
+    return _count < limit ? _count : limit;
+}
+
+static bus_t*
+_bench_bus(bus_addr_t addr) {
+    bus_t* bt = bus_create(_key, addr);
+    if (!bt) {
+        fprintf(stderr, "bus[%d] create fail\n", addr);
+        exit(-1);
+    }
+    bus_set_pipe_size_by_type(bt, bus_addr_type(BENCH_ADDR_CONSUMER), BENCH_PIPE_SIZE);
+    bus_set_pipe_size_by_type(bt, bus_addr_type(BENCH_ADDR_PRODUCER(0)), BENCH_PIPE_SIZE);
+    return bt;
+}
+
+static void
+_idle(bus_t* bt) {
+    if (_wait) {
+        bus_wait(bt, 10);
+    } else {
+        sched_yield();
+    }
+}
+
+static void
+_send(bus_t* bt, const char* buf, size_t sz, bus_addr_t to) {
+    int ret;
+    while ((ret = bus_send(bt, buf, sz, to)) != BUS_OK) {
+        if (ret != BUS_ERR_SEND_FAIL) {
+            fprintf(stderr, "bus send to %d fail: %d\n", to, ret);
+            exit(-1);
+        }
+        sched_yield();
+    }
+}
+
+static size_t
+_recv(bus_t* bt, char* buf, size_t sz, bus_addr_t* from) {
+    bus_msg_t msg;
+    while (1) {
+        msg.buf = buf;
+        msg.bufsz = sz;
+        if (bus_recv_batch(bt, &msg, 1) == 1) {
+            if (from)
+                *from = msg.from;
+            return msg.bufsz;
+        }
+        bus_poll(bt);
+        _idle(bt);
+    }
+}
+
+// messages left by broken runs
+static void
+_drain(bus_t* bt) {
+    char* buf = (char*)MALLOC(BENCH_MAX_SIZE);
+    bus_msg_t msg;
+    bus_poll(bt);
+    do {
+        msg.buf = buf;
+        msg.bufsz = BENCH_MAX_SIZE;
+    } while (bus_recv_batch(bt, &msg, 1) == 1);
+    FREE(buf);
+}
+
+static void
+_gate_wait(int fd) {
+    char c;
+    if (read(fd, &c, 1) != 1) {
+        fprintf(stderr, "gate read fail\n");
+        exit(-1);
+    }
+}
+
+static void
+_gate_open(int fd, int n) {
+    char c = 0;
+    for (int i = 0; i < n; ++ i) {
+        if (write(fd, &c, 1) != 1) {
+            fprintf(stderr, "gate write fail\n");
+            exit(-1);
+        }
+    }
+}
+
+static int
+_reap(int n) {
+    int status, fail = 0;
+    for (int i = 0; i < n; ++ i) {
+        wait(&status);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            fail = -1;
+    }
+    return fail;
+}
+
+static int
+_cmp_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// lat is NULL if latency is not measured, rate 0 if not paced
+static void
+_report(const char* name, int size, int producers, int rate, uint64_t* lat, int n, uint64_t cost) {
+    double secs = cost / 1e9;
+    printf("{\"case\":\"%s\",\"size\":%d,\"producers\":%d,\"count\":%d",
+        name, size, producers, n);
+    if (rate > 0)
+        printf(",\"rate\":%d", rate);
+    if (lat) {
+        qsort(lat, n, sizeof(uint64_t), _cmp_u64);
+        printf(",\"p50_ns\":%"PRIu64",\"p99_ns\":%"PRIu64",\"p999_ns\":%"PRIu64",\"max_ns\":%"PRIu64,
+            lat[(int)(n * 0.5)], lat[(int)(n * 0.99)], lat[(int)(n * 0.999)], lat[n - 1]);
+    }
+    printf(",\"msgs_per_sec\":%.0f,\"mb_per_sec\":%.2f}\n",
+        n / secs, (double)n * size / secs / (1 << 20));
+    fflush(stdout);
+}
+
+static void
+_pingpong_echo(int fd, int size) {
+    bus_t* bt = _bench_bus(BENCH_ADDR_PRODUCER(0));
+    _drain(bt);
+    _gate_open(fd, 1);
+    char* buf = (char*)MALLOC(size);
+    while (1) {
+        bus_addr_t from;
+        size_t sz = _recv(bt, buf, size, &from);
+        _send(bt, buf, sz, from);
+        if (((bench_msg_t*)buf)->stop)
+            break;
+    }
+    FREE(buf);
+    bus_release(bt);
+}
+
+static int
+_bench_pingpong(int size) {
+    bus_t* bt = _bench_bus(BENCH_ADDR_CONSUMER);
+    _drain(bt);
+    int fds[2];
+    if (pipe(fds)) {
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        _pingpong_echo(fds[1], size);
+        _exit(0);
+    }
+    _gate_wait(fds[0]);
+
+    int count = _bench_count(size);
+    uint64_t* lat = (uint64_t*)MALLOC(sizeof(uint64_t) * count);
+    char* buf = (char*)MALLOC(size);
+    bench_msg_t* msg = (bench_msg_t*)buf;
+    memset(buf, 0, size);
+    uint64_t start = 0;
+    for (int i = -BENCH_WARMUP; i <= count; ++ i) {
+        if (i == 0)
+            start = _now();
+        msg->seq = (uint32_t)i;
+        msg->stop = (i == count);
+        uint64_t t = _now();
+        _send(bt, buf, size, BENCH_ADDR_PRODUCER(0));
+        size_t sz = _recv(bt, buf, size, NULL);
+        if (sz != (size_t)size || msg->seq != (uint32_t)i) {
+            fprintf(stderr, "pingpong echo mismatch: %d\n", i);
+            return -1;
+        }
+        if (i >= 0 && i < count)
+            lat[i] = (_now() - t) / 2;
+    }
+    uint64_t cost = _now() - start;
+    int ret = _reap(1);
+    if (ret == 0)
+        _report("pingpong", size, 1, 0, lat, count, cost);
+
+    close(fds[0]);
+    close(fds[1]);
+    FREE(buf);
+    FREE(lat);
+    bus_release(bt);
+    return ret;
+}
+
+static void
+_stream_produce(int fd, int index, int size, int count) {
+    bus_t* bt = _bench_bus(BENCH_ADDR_PRODUCER(index));
+    _gate_wait(fd);
+    char* buf = (char*)MALLOC(size);
+    bench_msg_t* msg = (bench_msg_t*)buf;
+    memset(buf, 0, size);
+    // paced by schedule, so a stall is counted in latency of the messages behind
+    uint64_t interval = _rate > 0 ? 1000000000ULL / _rate : 0;
+    uint64_t start = _now();
+    for (int i = -BENCH_WARMUP; i < count; ++ i) {
+        msg->seq = (uint32_t)i;
+        if (interval > 0) {
+            uint64_t due = start + (uint64_t)(i + BENCH_WARMUP) * interval;
+            while (_now() < due)
+                sched_yield();
+            msg->stamp = due;
+        } else {
+            msg->stamp = _now();
+        }
+        _send(bt, buf, size, BENCH_ADDR_CONSUMER);
+    }
+    FREE(buf);
+    bus_release(bt);
+}
+
+static int
+_bench_stream(int size, int producers) {
+    bus_t* bt = _bench_bus(BENCH_ADDR_CONSUMER);
+    _drain(bt);
+    int fds[2];
+    if (pipe(fds)) {
+        return -1;
+    }
+    int count = _bench_count(size) / producers;
+    for (int i = 0; i < producers; ++ i) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            _stream_produce(fds[0], i, size, count);
+            _exit(0);
+        }
+    }
+    _gate_open(fds[1], producers);
+
+    int total = count * producers, n = 0;
+    int left = (count + BENCH_WARMUP) * producers;
+    uint64_t* lat = (uint64_t*)MALLOC(sizeof(uint64_t) * total);
+    char* bufs = (char*)MALLOC(size * BENCH_BATCH);
+    bus_msg_t msgs[BENCH_BATCH];
+    uint64_t first = UINT64_MAX, last = 0;
+    while (left > 0) {
+        for (int i = 0; i < BENCH_BATCH; ++ i) {
+            msgs[i].buf = bufs + size * i;
+            msgs[i].bufsz = size;
+        }
+        int m = bus_recv_batch(bt, msgs, BENCH_BATCH);
+        if (m <= 0) {
+            bus_poll(bt);
+            _idle(bt);
+            continue;
+        }
+        uint64_t now = _now();
+        left -= m;
+        for (int i = 0; i < m; ++ i) {
+            bench_msg_t* msg = (bench_msg_t*)msgs[i].buf;
+            // warmup
+            if ((int32_t)msg->seq < 0)
+                continue;
+            lat[n ++] = now - msg->stamp;
+            if (msg->stamp < first)
+                first = msg->stamp;
+            last = now;
+        }
+    }
+    int ret = _reap(producers);
+    if (ret == 0)
+        _report("stream", size, producers, _rate, _rate > 0 ? lat : NULL, total, last - first);
+
+    close(fds[0]);
+    close(fds[1]);
+    FREE(bufs);
+    FREE(lat);
+    bus_release(bt);
+    return ret;
+}
+
+static int
+_parse_sizes(const char* arg) {
+    _nsizes = 0;
+    while (arg && *arg && _nsizes < BENCH_MAX_SIZES) {
+        int size = atoi(arg);
+        if (size < (int)sizeof(bench_msg_t) || size > BENCH_MAX_SIZE)
+            return -1;
+        _sizes[_nsizes ++] = size;
+        arg = strchr(arg, ',');
+        if (arg)
+            ++ arg;
+    }
+    return _nsizes > 0 ? 0 : -1;
+}
+
+static void
+usage() {
+    fprintf(stderr, "usage: bench_bus [options]\n"
+        "  -key <bus key>          default 0x%x\n"
+        "  -count <messages>       per size, default %d\n"
+        "  -producers <n>          stream with 1, 2, 4 .. n producers, default %d\n"
+        "  -sizes <s1,s2,..>       payload bytes, %d ~ %d\n"
+        "  -case <pingpong|stream> default both\n"
+        "  -rate <msgs per second> stream paced per producer, latency reported only if set\n"
+        "  -wait                   sleep on bus doorbell instead of yield\n",
+        BENCH_BUS_KEY, _count, _producers, (int)sizeof(bench_msg_t), BENCH_MAX_SIZE);
+}
+
+int
+main(int argc, char** argv) {
+
+    struct option opts[] = {
+        {"key",         required_argument,  0,  'k'},
+        {"count",       required_argument,  0,  'c'},
+        {"producers",   required_argument,  0,  'p'},
+        {"sizes",       required_argument,  0,  's'},
+        {"case",        required_argument,  0,  't'},
+        {"rate",        required_argument,  0,  'r'},
+        {"wait",        no_argument,        0,  'w'},
+        {0,             0,                  0,  0}
+    };
+
+    int index, c;
+    while ((c = getopt_long_only(argc, argv, "", opts, &index)) != -1) {
+        switch (c) {
+            case 'k':
+                _key = (int16_t)strtol(optarg, NULL, 0);
+                break;
+            case 'c':
+                _count = atoi(optarg);
+                break;
+            case 'p':
+                _producers = atoi(optarg);
+                break;
+            case 's':
+                if (_parse_sizes(optarg) < 0) {
+                    usage();
+                    exit(-1);
+                }
+                break;
+            case 't':
+                _pingpong = (strcmp(optarg, "pingpong") == 0);
+                _stream = (strcmp(optarg, "stream") == 0);
+                break;
+            case 'r':
+                _rate = atoi(optarg);
+                break;
+            case 'w':
+                _wait = 1;
+                break;
+            default:
+                usage();
+                exit(-1);
+        }
+    }
+    if (_count <= 0 || _producers <= 0 || _producers > BENCH_MAX_PRODUCERS || _rate < 0
+        || (!_pingpong && !_stream)) {
+        usage();
+        exit(-1);
+    }
+
+    for (int i = 0; i < _nsizes; ++ i) {
+        if (_pingpong && _bench_pingpong(_sizes[i]) < 0) {
+            fprintf(stderr, "pingpong size %d fail\n", _sizes[i]);
+            exit(-1);
+        }
+    }
+    for (int i = 0; i < _nsizes; ++ i) {
+        for (int p = 1; _stream && p <= _producers; p = (p * 2 > _producers && p < _producers) ? _producers : p * 2) {
+            if (_bench_stream(_sizes[i], p) < 0) {
+                fprintf(stderr, "stream size %d producers %d fail\n", _sizes[i], p);
+                exit(-1);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,257 @@
+#include <assert.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "net/sock.h"
+#include "net/reactor.h"
+#include "net/acceptor.h"
+#include "net/connector.h"
+
+//
+// echo benchmark, server runs in this process by the reactor backend,
+// clients are forked, each keeps one message in flight per connection.
+// results are printed as json lines, one line per backend & size
+//
+
+#define BENCH_ECHO_IP "127.0.0.1"
+#define BENCH_ECHO_PORT 8300
+#define BENCH_MAX_SIZE (64 << 10)
+#define BENCH_MAX_CONNS 1024
+#define BENCH_MAX_SIZES 32
+
+static int _count = 10000;
+static int _clients = 2;
+static int _conns = 16;
+static int _epoll = 1;
+static int _uring = 1;
+static int _sizes[BENCH_MAX_SIZES] = { 16, 256, 4096 };
+static int _nsizes = 3;
+static int _closed;
+
+static uint64_t
+_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int
+_reap(int n) {
+    int status, fail = 0;
+    for (int i = 0; i < n; ++ i) {
+        wait(&status);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            fail = -1;
+    }
+    return fail;
+}
+
+static int
+_echo_read(sock_t fd, void* arg, const char* buf, int buflen) {
+    return con_send((con_t*)arg, buf, buflen) < 0 ? -1 : buflen;
+}
+
+static void
+_echo_close(sock_t fd, void* arg) {
+    con_release((con_t*)arg);
+    ++ _closed;
+}
+
+static int
+_echo_accept(sock_t fd, void* arg, const sockaddr_t* peer) {
+    con_t* con = con_create((reactor_t*)arg);
+    if (!con) {
+        sock_close(fd);
+        return 0;
+    }
+    con_set_read_func(con, _echo_read, con);
+    con_set_close_func(con, _echo_close, con);
+    con_set_sock(con, fd);
+    con_set_nonblock(con);
+    if (con_start(con) < 0) {
+        con_release(con);
+    }
+    return 0;
+}
+
+static int
+_full_io(sock_t fd, char* buf, int size, int out) {
+    int n = 0;
+    while (n < size) {
+        int ret = out ? write(fd, buf + n, size - n) : read(fd, buf + n, size - n);
+        if (ret <= 0)
+            return -1;
+        n += ret;
+    }
+    return 0;
+}
+
+// all connections in lockstep: send one, then receive the echo
+static int
+_client(int size) {
+    sock_t fds[BENCH_MAX_CONNS];
+    sockaddrin_t addr;
+    sock_addr_aton(BENCH_ECHO_IP, BENCH_ECHO_PORT, &addr);
+    for (int i = 0; i < _conns; ++ i) {
+        fds[i] = sock_tcp();
+        if (connect(fds[i], (sockaddr_t*)&addr, sizeof(addr)) < 0)
+            return -1;
+        sock_set_nodelay(fds[i]);
+    }
+    char* buf = (char*)MALLOC(size);
+    memset(buf, 'e', size);
+    for (int r = 0; r < _count; ++ r) {
+        for (int i = 0; i < _conns; ++ i) {
+            if (_full_io(fds[i], buf, size, 1) < 0)
+                return -1;
+        }
+        for (int i = 0; i < _conns; ++ i) {
+            if (_full_io(fds[i], buf, size, 0) < 0)
+                return -1;
+        }
+    }
+    for (int i = 0; i < _conns; ++ i) {
+        sock_close(fds[i]);
+    }
+    FREE(buf);
+    return 0;
+}
+
+static int
+_bench(const char* name, reactor_t* r, int size) {
+    acc_t* acc = acc_create(r);
+    if (!acc)
+        return -1;
+    acc_set_read_func(acc, _echo_accept, r);
+    sockaddrin_t addr;
+    sock_addr_aton(BENCH_ECHO_IP, BENCH_ECHO_PORT, &addr);
+    if (acc_start(acc, (sockaddr_t*)&addr) < 0) {
+        acc_release(acc);
+        return -1;
+    }
+
+    _closed = 0;
+    uint64_t start = _now();
+    for (int i = 0; i < _clients; ++ i) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            _exit(_client(size) < 0 ? -1 : 0);
+        }
+    }
+    while (_closed < _clients * _conns) {
+        if (reactor_dispatch(r, 10) < 0) {
+            fprintf(stderr, "%s dispatch fail\n", name);
+            break;
+        }
+    }
+    uint64_t cost = _now() - start;
+    int ret = _reap(_clients);
+    if (ret == 0) {
+        double secs = cost / 1e9;
+        double n = (double)_count * _clients * _conns;
+        printf("{\"case\":\"echo\",\"reactor\":\"%s\",\"size\":%d,\"clients\":%d,\"conns\":%d,"
+            "\"count\":%d,\"msgs_per_sec\":%.0f,\"mb_per_sec\":%.2f}\n",
+            name, size, _clients, _conns, _count, n / secs, n * size / secs / (1 << 20));
+        fflush(stdout);
+    }
+    acc_release(acc);
+    return ret;
+}
+
+static int
+_parse_sizes(const char* arg) {
+    _nsizes = 0;
+    while (arg && *arg && _nsizes < BENCH_MAX_SIZES) {
+        int size = atoi(arg);
+        if (size <= 0 || size > BENCH_MAX_SIZE)
+            return -1;
+        _sizes[_nsizes ++] = size;
+        arg = strchr(arg, ',');
+        if (arg)
+            ++ arg;
+    }
+    return _nsizes > 0 ? 0 : -1;
+}
+
+static void
+usage() {
+    fprintf(stderr, "usage: bench_echo [options]\n"
+        "  -count <round trips>    per connection, default %d\n"
+        "  -clients <n>            client processes, default %d\n"
+        "  -conns <n>              connections per client, default %d\n"
+        "  -sizes <s1,s2,..>       payload bytes, 1 ~ %d\n"
+        "  -reactor <epoll|uring>  default both\n",
+        _count, _clients, _conns, BENCH_MAX_SIZE);
+}
+
+int
+main(int argc, char** argv) {
+
+    struct option opts[] = {
+        {"count",       required_argument,  0,  'c'},
+        {"clients",     required_argument,  0,  'p'},
+        {"conns",       required_argument,  0,  'n'},
+        {"sizes",       required_argument,  0,  's'},
+        {"reactor",     required_argument,  0,  'r'},
+        {0,             0,                  0,  0}
+    };
+
+    int index, c;
+    while ((c = getopt_long_only(argc, argv, "", opts, &index)) != -1) {
+        switch (c) {
+            case 'c':
+                _count = atoi(optarg);
+                break;
+            case 'p':
+                _clients = atoi(optarg);
+                break;
+            case 'n':
+                _conns = atoi(optarg);
+                break;
+            case 's':
+                if (_parse_sizes(optarg) < 0) {
+                    usage();
+                    exit(-1);
+                }
+                break;
+            case 'r':
+                _epoll = (strcmp(optarg, "epoll") == 0);
+                _uring = (strcmp(optarg, "uring") == 0);
+                break;
+            default:
+                usage();
+                exit(-1);
+        }
+    }
+    if (_count <= 0 || _clients <= 0 || _conns <= 0 || _conns > BENCH_MAX_CONNS
+        || (!_epoll && !_uring)) {
+        usage();
+        exit(-1);
+    }
+
+    for (int i = 0; i < _nsizes; ++ i) {
+        if (_epoll) {
+            reactor_t* r = reactor_create();
+            if (!r || _bench("epoll", r, _sizes[i]) < 0) {
+                fprintf(stderr, "epoll size %d fail\n", _sizes[i]);
+                exit(-1);
+            }
+            reactor_release(r);
+        }
+        if (_uring) {
+            reactor_t* r = reactor_create_uring();
+            if (!r) {
+                fprintf(stderr, "io_uring not supported\n");
+                exit(-1);
+            }
+            if (_bench("uring", r, _sizes[i]) < 0) {
+                fprintf(stderr, "uring size %d fail\n", _sizes[i]);
+                exit(-1);
+            }
+            reactor_release(r);
+        }
+    }
+    return 0;
+}
@@ -15,6 +15,11 @@ atom_t atom_set(atom_t volatile*, uint32_t val);
 atom_t atom_add(atom_t volatile*, uint32_t val);
 atom_t atom_sub(atom_t volatile*, uint32_t val);
 
+// acquire load & release store without full barrier (gcc >= 4.7)
+// for a value written by one side only, e.g. ring buffer positions
+#define atom_load_acquire(a) __atomic_load_n((a), __ATOMIC_ACQUIRE)
+#define atom_store_release(a, val) __atomic_store_n((a), (val), __ATOMIC_RELEASE)
+
 typedef void* atom_ptr_t;
 atom_ptr_t atom_ptr_set(atom_ptr_t volatile*, void* data);
 atom_ptr_t atom_ptr_cas(atom_ptr_t volatile*, void* cmp, void* val);
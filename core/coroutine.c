@@ -66,6 +66,8 @@ _crt_unit_release(crt_unit_t* cu) {
     if (cu) {
         if (cu->stack) {
             cu->stack -= CRT_UNIT_RESERVED_SIZE;
+            // unprotect, or allocator writing the page faults later
+            mprotect(cu->stack, CRT_UNIT_RESERVED_SIZE, PROT_READ | PROT_WRITE);
             FREE(cu->stack);
             cu->stack = 0;
         }
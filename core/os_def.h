@@ -176,6 +176,10 @@ extern "C" {
 #define VALLOC valloc
 #endif
 
+#if !defined CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,135 @@
+#include <pthread.h>
+#include <sched.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "core/atom.h"
+#include "plock.h"
+
+// spin times waiting for initialization
+#define PLOCK_WAIT_LOOP 100000
+
+struct plock_t {
+    volatile atom_t ready;
+    // share memory id if created by key
+    int shmid;
+    pthread_mutex_t mutex;
+};
+
+// fits in PLOCK_SIZE, checked at compile time
+typedef char _plock_size_check[sizeof(plock_t) <= PLOCK_SIZE ? 1 : -1];
+
+static int
+_plock_init(plock_t* l) {
+    pthread_mutexattr_t attr;
+    if (pthread_mutexattr_init(&attr))
+        return -1;
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+#if defined(OS_LINUX)
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+#endif
+    int ret = pthread_mutex_init(&l->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (ret)
+        return -1;
+    atom_set(&l->ready, 1);
+    return 0;
+}
+
+static int
+_plock_wait(plock_t* l) {
+    for (int i = 0; i < PLOCK_WAIT_LOOP; ++ i) {
+        if (l->ready)
+            return 0;
+        sched_yield();
+    }
+    return -1;
+}
+
+plock_t*
+plock_create(int key) {
+    plock_t* l;
+    int shmid = shmget(key, PLOCK_SIZE, IPC_CREAT | IPC_EXCL | 0666);
+    if (shmid >= 0) {
+        l = (plock_t*)shmat(shmid, NULL, 0);
+        if (l == (plock_t*)-1)
+            return NULL;
+        l->shmid = shmid;
+        if (_plock_init(l)) {
+            shmdt(l);
+            return NULL;
+        }
+        return l;
+    }
+    if (errno != EEXIST)
+        return NULL;
+    shmid = shmget(key, PLOCK_SIZE, 0666);
+    if (shmid < 0)
+        return NULL;
+    l = (plock_t*)shmat(shmid, NULL, 0);
+    if (l == (plock_t*)-1)
+        return NULL;
+    if (_plock_wait(l)) {
+        shmdt(l);
+        return NULL;
+    }
+    return l;
+}
+
+plock_t*
+plock_attach(void* mem, size_t size, int init) {
+    if (!mem || size < PLOCK_SIZE)
+        return NULL;
+    plock_t* l = (plock_t*)mem;
+    if (init) {
+        l->shmid = -1;
+        return _plock_init(l) == 0 ? l : NULL;
+    }
+    return _plock_wait(l) == 0 ? l : NULL;
+}
+
+void
+plock_release(plock_t* l) {
+    if (l && l->shmid >= 0) {
+        shmdt(l);
+    }
+}
+
+void
+plock_destroy(plock_t* l) {
+    if (l && l->shmid >= 0) {
+        shmctl(l->shmid, IPC_RMID, NULL);
+    }
+}
+
+static int
+_plock_result(plock_t* l, int ret) {
+    if (ret == 0)
+        return 0;
+#if defined(OS_LINUX)
+    // owner died, make it usable again
+    if (ret == EOWNERDEAD) {
+        pthread_mutex_consistent(&l->mutex);
+        return PLOCK_OWNER_DEAD;
+    }
+#endif
+    return -1;
+}
+
+int
+plock_lock(plock_t* l) {
+    return l ? _plock_result(l, pthread_mutex_lock(&l->mutex)) : -1;
+}
+
+int
+plock_try_lock(plock_t* l) {
+    return l ? _plock_result(l, pthread_mutex_trylock(&l->mutex)) : -1;
+}
+
+int
+plock_unlock(plock_t* l) {
+    if (l) {
+        return pthread_mutex_unlock(&l->mutex) == 0 ? 0 : -1;
+    }
+    return -1;
+}
@@ -0,0 +1,44 @@
+#ifndef PLOCK_H_
+#define PLOCK_H_
+
+//
+// process lock: robust pthread mutex in share memory
+// uncontended lock & unlock run under user-level,
+// and the lock is recovered if the owner process died
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "core/os_def.h"
+
+typedef struct plock_t plock_t;
+
+// share memory size for plock_attach
+#define PLOCK_SIZE 64
+
+// locked, but the previous owner died holding it
+// data protected may be inconsistent
+#define PLOCK_OWNER_DEAD 1
+
+// lock in a new share memory segment, or attach the exist one
+plock_t* plock_create(int key);
+
+// lock in memory given, size >= PLOCK_SIZE
+// init != 0: initialize it, otherwise wait for the initialization
+plock_t* plock_attach(void* mem, size_t size, int init);
+
+void plock_release(plock_t*);
+void plock_destroy(plock_t*);
+
+// return 0 or PLOCK_OWNER_DEAD if locked, otherwise -1
+int plock_lock(plock_t*);
+int plock_try_lock(plock_t*);
+int plock_unlock(plock_t*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PLOCK_H_
@@ -12,6 +12,7 @@ set(GBASE_DIR_CORE "${CMAKE_SOURCE_DIR}/core")
 set(GBASE_DIR_BASE "${CMAKE_SOURCE_DIR}/base")
 set(GBASE_DIR_UTIL "${CMAKE_SOURCE_DIR}/util")
 set(GBASE_DIR_TEST "${CMAKE_SOURCE_DIR}/test")
+set(GBASE_DIR_BENCH "${CMAKE_SOURCE_DIR}/bench")
 set(GBASE_DIR_NET "${CMAKE_SOURCE_DIR}/net")
 set(GBASE_DIR_MM "${CMAKE_SOURCE_DIR}/mm")
 set(GBASE_DIR_LOGIC "${CMAKE_SOURCE_DIR}/logic")
@@ -45,6 +46,9 @@ add_library(${GBASE_LIB} ${GBASE_SOURCE})
 # 编译test
 add_subdirectory(${GBASE_DIR_TEST})
 
+# 编译benchmark
+add_subdirectory(${GBASE_DIR_BENCH})
+
 # 安装到发布目录
 install(
     DIRECTORY ${GBASE_DIR_CORE} ${GBASE_DIR_BASE} ${GBASE_DIR_UTIL} ${GBASE_DIR_NET} ${GBASE_DIR_MM} ${GBASE_DIR_LOGIC}
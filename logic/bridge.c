@@ -0,0 +1,527 @@
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "base/buffer.h"
+#include "net/sock.h"
+#include "net/acceptor.h"
+#include "net/connector.h"
+#include "bridge.h"
+
+#define BRIDGE_FRAME_MSG 1
+#define BRIDGE_FRAME_HELLO 2
+
+// network byte order, followed by payload
+typedef struct bridge_head_t {
+    uint32_t len;
+    uint32_t type;
+    int32_t from;
+    int32_t to;
+} head_t;
+
+struct bridge_peer_t;
+
+typedef struct bridge_link_t {
+    bridge_t* bridge;
+    con_t* con;
+    buffer_t* rbuf;
+    buffer_t* wbuf;
+    // bound by hello if accepted
+    struct bridge_peer_t* peer;
+    // written since last flush
+    int dirty;
+} link_t;
+
+typedef struct bridge_peer_t {
+    // pending nonblocking connect, handler must be at head
+    handler_t h;
+    uint64_t connect_ms;
+    bridge_t* bridge;
+    int id;
+    // connect to if port is set
+    char ip[32];
+    uint16_t port;
+    time_t last_connect;
+    link_t* link;
+} peer_t;
+
+typedef struct bridge_route_t {
+    bus_addr_t begin;
+    bus_addr_t end;
+    peer_t* peer;
+    // proxy terminals in local bus
+    bus_t** proxies;
+} route_t;
+
+struct bridge_t {
+    int16_t key;
+    int id;
+    reactor_t* r;
+    int max_msg;
+    int connect_timeout;
+    acc_t* acc;
+    peer_t peers[BRIDGE_MAX_PEERS];
+    int npeers;
+    route_t routes[BRIDGE_MAX_ROUTES];
+    int nroutes;
+    // bound or not
+    link_t* links[BRIDGE_MAX_LINKS];
+    int nlinks;
+    uint64_t drops;
+};
+
+bridge_t*
+bridge_create(int16_t key, int id, reactor_t* r, int max_msg) {
+    if (!r)
+        return NULL;
+    if (max_msg <= 0)
+        max_msg = BRIDGE_DEFAULT_MSG_SIZE;
+    bridge_t* b = (bridge_t*)MALLOC(sizeof(*b));
+    if (!b)
+        return NULL;
+    memset(b, 0, sizeof(*b));
+    b->key = key;
+    b->id = id;
+    b->r = r;
+    b->max_msg = max_msg;
+    b->connect_timeout = BRIDGE_CONNECT_TIMEOUT_MS;
+    return b;
+}
+
+void
+bridge_set_connect_timeout(bridge_t* b, int ms) {
+    if (b)
+        b->connect_timeout = ms > 0 ? ms : BRIDGE_CONNECT_TIMEOUT_MS;
+}
+
+static void
+_bridge_link_release(link_t* link) {
+    bridge_t* b = link->bridge;
+    for (int i = 0; i < b->nlinks; ++ i) {
+        if (b->links[i] == link) {
+            b->links[i] = b->links[-- b->nlinks];
+            break;
+        }
+    }
+    if (link->peer && link->peer->link == link)
+        link->peer->link = NULL;
+    con_release(link->con);
+    buffer_release(link->rbuf);
+    buffer_release(link->wbuf);
+    FREE(link);
+}
+
+static void _bridge_connect_abort(peer_t* peer);
+
+void
+bridge_release(bridge_t* b) {
+    if (!b)
+        return;
+    for (int i = 0; i < b->npeers; ++ i)
+        _bridge_connect_abort(&b->peers[i]);
+    while (b->nlinks > 0)
+        _bridge_link_release(b->links[0]);
+    if (b->acc)
+        acc_release(b->acc);
+    for (int i = 0; i < b->nroutes; ++ i) {
+        route_t* route = &b->routes[i];
+        for (bus_addr_t addr = route->begin; addr <= route->end; ++ addr)
+            bus_release(route->proxies[addr - route->begin]);
+        FREE(route->proxies);
+    }
+    FREE(b);
+}
+
+static peer_t*
+_bridge_peer(bridge_t* b, int id) {
+    for (int i = 0; i < b->npeers; ++ i) {
+        if (b->peers[i].id == id)
+            return &b->peers[i];
+    }
+    return NULL;
+}
+
+static peer_t*
+_bridge_peer_add(bridge_t* b, int id) {
+    peer_t* peer = _bridge_peer(b, id);
+    if (peer)
+        return peer;
+    if (b->npeers >= BRIDGE_MAX_PEERS)
+        return NULL;
+    peer = &b->peers[b->npeers ++];
+    memset(peer, 0, sizeof(*peer));
+    peer->h.fd = INVALID_SOCK;
+    peer->bridge = b;
+    peer->id = id;
+    return peer;
+}
+
+static route_t*
+_bridge_route(bridge_t* b, bus_addr_t addr) {
+    for (int i = 0; i < b->nroutes; ++ i) {
+        route_t* route = &b->routes[i];
+        if (addr >= route->begin && addr <= route->end)
+            return route;
+    }
+    return NULL;
+}
+
+// message from peer to local terminal, by proxy of the source
+static void
+_bridge_deliver(bridge_t* b, link_t* link, const head_t* head, const char* data) {
+    route_t* route = _bridge_route(b, head->from);
+    if (!route || route->peer != link->peer) {
+        ++ b->drops;
+        return;
+    }
+    bus_t* proxy = route->proxies[head->from - route->begin];
+    if (bus_send(proxy, data, head->len, head->to) != BUS_OK)
+        ++ b->drops;
+}
+
+static int
+_bridge_bind(bridge_t* b, link_t* link, int id) {
+    peer_t* peer = _bridge_peer(b, id);
+    if (!peer)
+        return -1;
+    // the last one wins, as old link may be broken silently
+    if (peer->link && peer->link != link)
+        _bridge_link_release(peer->link);
+    peer->link = link;
+    link->peer = peer;
+    return 0;
+}
+
+// return buffer size processed, -1 means close the link
+static int
+_bridge_read(sock_t fd, void* arg, const char* buffer, int buflen) {
+    link_t* link = (link_t*)arg;
+    bridge_t* b = link->bridge;
+    int pos = 0;
+    while (buflen - pos >= (int)sizeof(head_t)) {
+        head_t head;
+        memcpy(&head, buffer + pos, sizeof(head));
+        head.len = ntohl(head.len);
+        head.type = ntohl(head.type);
+        head.from = (int32_t)ntohl(head.from);
+        head.to = (int32_t)ntohl(head.to);
+        if (head.len > (uint32_t)b->max_msg)
+            return -1;
+        if ((uint32_t)(buflen - pos) < sizeof(head) + head.len)
+            break;
+        const char* data = buffer + pos + sizeof(head);
+        switch (head.type) {
+            case BRIDGE_FRAME_HELLO: {
+                int32_t id;
+                if (head.len != sizeof(id))
+                    return -1;
+                memcpy(&id, data, sizeof(id));
+                if (_bridge_bind(b, link, (int32_t)ntohl(id)) < 0)
+                    return -1;
+                break;
+            }
+            case BRIDGE_FRAME_MSG:
+                if (!link->peer)
+                    return -1;
+                _bridge_deliver(b, link, &head, data);
+                break;
+            default:
+                return -1;
+        }
+        pos += sizeof(head) + head.len;
+    }
+    return pos;
+}
+
+static void
+_bridge_close(sock_t fd, void* arg) {
+    _bridge_link_release((link_t*)arg);
+}
+
+// fd is closed if fail
+static link_t*
+_bridge_link_create(bridge_t* b, sock_t fd) {
+    if (b->nlinks >= BRIDGE_MAX_LINKS)
+        goto LINK_FAIL;
+    link_t* link = (link_t*)MALLOC(sizeof(*link));
+    if (!link)
+        goto LINK_FAIL;
+    memset(link, 0, sizeof(*link));
+    link->bridge = b;
+    // buffer size hint: 4 * max pkg size
+    int size = 4 * (sizeof(head_t) + b->max_msg);
+    link->rbuf = buffer_create(size, MALLOC, FREE);
+    link->wbuf = buffer_create(size, MALLOC, FREE);
+    link->con = con_create(b->r);
+    if (!link->rbuf || !link->wbuf || !link->con)
+        goto LINK_FAIL1;
+    con_set_rbuf(link->con, link->rbuf);
+    con_set_wbuf(link->con, link->wbuf);
+    con_set_read_func(link->con, _bridge_read, link);
+    con_set_close_func(link->con, _bridge_close, link);
+    con_set_sock(link->con, fd);
+    // accepted or connected nonblocking
+    con_set_nonblock(link->con);
+    if (con_start(link->con) < 0)
+        goto LINK_FAIL1;
+    b->links[b->nlinks ++] = link;
+    return link;
+
+LINK_FAIL1:
+    if (link->con)
+        con_release(link->con);
+    if (link->rbuf)
+        buffer_release(link->rbuf);
+    if (link->wbuf)
+        buffer_release(link->wbuf);
+    FREE(link);
+LINK_FAIL:
+    sock_close(fd);
+    return NULL;
+}
+
+static int
+_bridge_accept(sock_t fd, void* arg, const sockaddr_t* peer) {
+    // keep accepting even if the link fails
+    _bridge_link_create((bridge_t*)arg, fd);
+    return 0;
+}
+
+static void
+_bridge_acc_close(sock_t fd, void* arg) {
+    // acceptor releases itself
+    ((bridge_t*)arg)->acc = NULL;
+}
+
+int
+bridge_listen(bridge_t* b, const char* ip, uint16_t port) {
+    if (!b || !ip || b->acc)
+        return -1;
+    sockaddrin_t addr;
+    if (sock_addr_aton(ip, port, &addr) < 0)
+        return -1;
+    b->acc = acc_create(b->r);
+    if (!b->acc)
+        return -1;
+    acc_set_read_func(b->acc, _bridge_accept, b);
+    acc_set_close_func(b->acc, _bridge_acc_close, b);
+    if (acc_start(b->acc, (sockaddr_t*)&addr) < 0) {
+        acc_release(b->acc);
+        b->acc = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int
+bridge_add_peer(bridge_t* b, int id, const char* ip, uint16_t port) {
+    if (!b || !ip || port == 0 || strlen(ip) >= sizeof(b->peers[0].ip))
+        return -1;
+    peer_t* peer = _bridge_peer_add(b, id);
+    if (!peer)
+        return -1;
+    snprintf(peer->ip, sizeof(peer->ip), "%s", ip);
+    peer->port = port;
+    return 0;
+}
+
+int
+bridge_add_route(bridge_t* b, bus_addr_t begin, bus_addr_t end, int id) {
+    if (!b || begin > end || b->nroutes >= BRIDGE_MAX_ROUTES)
+        return -1;
+    for (int i = 0; i < b->nroutes; ++ i) {
+        if (begin <= b->routes[i].end && end >= b->routes[i].begin)
+            return -1;
+    }
+    peer_t* peer = _bridge_peer_add(b, id);
+    if (!peer)
+        return -1;
+    route_t* route = &b->routes[b->nroutes];
+    route->begin = begin;
+    route->end = end;
+    route->peer = peer;
+    route->proxies = (bus_t**)MALLOC(sizeof(bus_t*) * (end - begin + 1));
+    if (!route->proxies)
+        return -1;
+    for (bus_addr_t addr = begin; addr <= end; ++ addr) {
+        route->proxies[addr - begin] = bus_create(b->key, addr);
+        if (!route->proxies[addr - begin]) {
+            while (-- addr >= begin)
+                bus_release(route->proxies[addr - begin]);
+            FREE(route->proxies);
+            return -1;
+        }
+    }
+    ++ b->nroutes;
+    return 0;
+}
+
+static void
+_bridge_frame(link_t* link, uint32_t type, bus_addr_t from, bus_addr_t to,
+              size_t len) {
+    head_t head;
+    head.len = htonl((uint32_t)len);
+    head.type = htonl(type);
+    head.from = (int32_t)htonl(from);
+    head.to = (int32_t)htonl(to);
+    memcpy(buffer_write_buffer(link->wbuf), &head, sizeof(head));
+    buffer_write_nocopy(link->wbuf, sizeof(head) + len);
+    link->dirty = 1;
+}
+
+// monotonic milli-seconds
+static uint64_t
+_bridge_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// link is up, hello first
+static void
+_bridge_link_up(bridge_t* b, peer_t* peer, sock_t fd) {
+    link_t* link = _bridge_link_create(b, fd);
+    if (!link)
+        return;
+    link->peer = peer;
+    peer->link = link;
+    int32_t id = (int32_t)htonl(b->id);
+    memcpy(buffer_write_buffer(link->wbuf) + sizeof(head_t), &id, sizeof(id));
+    _bridge_frame(link, BRIDGE_FRAME_HELLO, 0, 0, sizeof(id));
+}
+
+static void
+_bridge_connect_abort(peer_t* peer) {
+    if (peer->h.fd != INVALID_SOCK) {
+        reactor_unregister(peer->bridge->r, &peer->h);
+        sock_close(peer->h.fd);
+        peer->h.fd = INVALID_SOCK;
+    }
+}
+
+// writable or failed, connected only if no socket error
+static int
+_bridge_connect_done(handler_t* h) {
+    peer_t* peer = (peer_t*)h;
+    // bound by hello of an accepted link meanwhile
+    if (peer->link)
+        return -1;
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(h->fd, SOL_SOCKET, SO_ERROR, (char*)&err, &len) < 0 || err != 0)
+        return -1;
+    sock_t fd = h->fd;
+    reactor_unregister(peer->bridge->r, h);
+    h->fd = INVALID_SOCK;
+    _bridge_link_up(peer->bridge, peer, fd);
+    return 0;
+}
+
+static int
+_bridge_connect_close(handler_t* h) {
+    _bridge_connect_abort((peer_t*)h);
+    return 0;
+}
+
+// never blocks, the link is up once the socket is writable
+static void
+_bridge_connect(bridge_t* b, peer_t* peer) {
+    sockaddrin_t addr;
+    if (sock_addr_aton(peer->ip, peer->port, &addr) < 0)
+        return;
+    sock_t fd = sock_tcp();
+    if (fd == INVALID_SOCK)
+        return;
+    if (sock_set_nonblock(fd) < 0)
+        goto CONNECT_FAIL;
+    if (connect(fd, (const sockaddr_t*)&addr, sizeof(addr)) == 0) {
+        _bridge_link_up(b, peer, fd);
+        return;
+    }
+    if (errno != EINPROGRESS)
+        goto CONNECT_FAIL;
+    peer->h.fd = fd;
+    peer->h.in_func = _bridge_connect_done;
+    peer->h.out_func = _bridge_connect_done;
+    peer->h.close_func = _bridge_connect_close;
+    if (reactor_register(b->r, &peer->h, EVENT_OUT) < 0) {
+        peer->h.fd = INVALID_SOCK;
+        goto CONNECT_FAIL;
+    }
+    peer->connect_ms = _bridge_now_ms();
+    return;
+
+CONNECT_FAIL:
+    sock_close(fd);
+}
+
+// receive into write buffer of link in place, with head reserved
+static int
+_bridge_drain(bridge_t* b, link_t* link, bus_t* proxy, bus_addr_t to) {
+    int n = 0;
+    bus_msg_t msg;
+    while (buffer_write_len(link->wbuf) >= (int)sizeof(head_t) + b->max_msg) {
+        msg.buf = buffer_write_buffer(link->wbuf) + sizeof(head_t);
+        msg.bufsz = b->max_msg;
+        int ret = bus_recv_batch(proxy, &msg, 1);
+        if (ret == BUS_ERR_OVERSIZE) {
+            // a larger one blocks its pipe, drop it and go on
+            msg.bufsz = 0;
+            if (bus_recv_oversize(proxy, b->max_msg, &msg) != 1)
+                break;
+            ++ b->drops;
+            continue;
+        }
+        if (ret != 1)
+            break;
+        _bridge_frame(link, BRIDGE_FRAME_MSG, msg.from, to, msg.bufsz);
+        ++ n;
+    }
+    return n;
+}
+
+int
+bridge_poll(bridge_t* b) {
+    if (!b)
+        return 0;
+    time_t now = time(NULL);
+    uint64_t now_ms = _bridge_now_ms();
+    for (int i = 0; i < b->npeers; ++ i) {
+        peer_t* peer = &b->peers[i];
+        if (peer->h.fd != INVALID_SOCK) {
+            if (now_ms - peer->connect_ms >= (uint64_t)b->connect_timeout)
+                _bridge_connect_abort(peer);
+            continue;
+        }
+        if (!peer->link && peer->port > 0
+            && now - peer->last_connect >= BRIDGE_RECONNECT_INTERVAL) {
+            peer->last_connect = now;
+            _bridge_connect(b, peer);
+        }
+    }
+    int n = 0;
+    for (int i = 0; i < b->nroutes; ++ i) {
+        route_t* route = &b->routes[i];
+        link_t* link = route->peer->link;
+        for (bus_addr_t addr = route->begin; addr <= route->end; ++ addr) {
+            bus_t* proxy = route->proxies[addr - route->begin];
+            bus_poll(proxy);
+            if (link)
+                n += _bridge_drain(b, link, proxy, addr);
+        }
+    }
+    // coalesced, one write per link
+    for (int i = 0; i < b->nlinks; ++ i) {
+        link_t* link = b->links[i];
+        if (link->dirty) {
+            con_flush(link->con);
+            link->dirty = 0;
+        }
+    }
+    return n;
+}
+
+uint64_t
+bridge_drops(bridge_t* b) {
+    return b ? b->drops : 0;
+}
@@ -0,0 +1,65 @@
+#ifndef BRIDGE_H_
+#define BRIDGE_H_
+
+//
+// bridge buses of hosts by tcp
+// terminals behind a remote bridge are routed by address range,
+// the bridge creates proxy terminals for them in local bus,
+// so bus_send to a remote address is the same as a local one.
+// messages received by proxies are framed (length prefixed) into
+// the peer's write buffer, and flushed once per bridge_poll
+//
+// a pair of bridges should be connected by one side (bridge_add_peer),
+// the other side learns the peer by its hello
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "core/os_def.h"
+#include "net/reactor.h"
+#include "logic/bus.h"
+
+#define BRIDGE_MAX_PEERS 64
+#define BRIDGE_MAX_ROUTES 64
+#define BRIDGE_MAX_LINKS 128
+#define BRIDGE_DEFAULT_MSG_SIZE (64 * 1024)
+#define BRIDGE_RECONNECT_INTERVAL 1
+// default timeout of pending connect, covers a lost syn and slow links
+#define BRIDGE_CONNECT_TIMEOUT_MS 3000
+
+typedef struct bridge_t bridge_t;
+
+// id: distinct bridge id, known by peers
+// max_msg: max message size forwarded, <= 0 means default
+//  larger messages are dropped and counted by bridge_drops
+bridge_t* bridge_create(int16_t key, int id, reactor_t*, int max_msg);
+void bridge_release(bridge_t*);
+
+// pending connect is aborted by bridge_poll after ms, <= 0 means default
+void bridge_set_connect_timeout(bridge_t*, int ms);
+
+// accept peers
+int bridge_listen(bridge_t*, const char* ip, uint16_t port);
+
+// connect to peer, reconnect in bridge_poll if broken
+int bridge_add_peer(bridge_t*, int id, const char* ip, uint16_t port);
+
+// terminals [begin, end] are behind peer
+// a proxy terminal is created for each address, so range is limited by bus capacity
+int bridge_add_route(bridge_t*, bus_addr_t begin, bus_addr_t end, int peer);
+
+// forward messages in local bus to peers, reactor_dispatch is up to user
+// messages wait in pipes while peer is disconnected or writing is slow
+// return messages forwarded
+int bridge_poll(bridge_t*);
+
+// messages dropped, as unknown source, local bus_send fail, or larger than max_msg
+uint64_t bridge_drops(bridge_t*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BRIDGE_H_
@@ -1,47 +1,222 @@
 #include <assert.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/un.h>
 #include "mm/shm.h"
 #include "core/atom.h"
-#include "core/lock.h"
+#include "core/plock.h"
 #include "base/idtable.h"
 #include "base/rbuffer.h"
+#include "net/sock.h"
 #include "logic/bus.h"
 
+#if defined(OS_LINUX)
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+// pipe statistics in shm, sender & receiver write their own cache lines
+typedef struct bus_stat_send_t {
+    uint64_t send_msgs;
+    uint64_t send_bytes;
+    uint64_t send_fails;
+    uint64_t spill_msgs;
+    uint64_t spill_drops;
+    // broadcast only, as its read pos is synced by sender
+    uint32_t peak_bytes;
+} __attribute__((aligned(CACHE_LINE_SIZE))) stat_send_t;
+
+typedef struct bus_stat_recv_t {
+    uint64_t recv_msgs;
+    uint64_t recv_bytes;
+    // sampled by the single receiver
+    uint32_t peak_bytes;
+    uint64_t latency[BUS_STAT_LATENCY_BUCKETS];
+} __attribute__((aligned(CACHE_LINE_SIZE))) stat_recv_t;
+
 typedef struct bus_pipe_head {
     int key;
     size_t size;
     bus_addr_t from;
     bus_addr_t to;
+    // backed by huge pages
+    int huge;
+    // reclaimed, slot could be reused
+    int dead;
+    // multi-producer ring buffer
+    int mpsc;
+    // priority lanes, rings of the same size in one shm
+    int lanes;
+    stat_send_t send;
+    stat_recv_t recv;
 } head_t;
 
+// terminal liveness, heartbeat stamped in bus_poll
+typedef struct bus_life_t {
+    atom_t pid;
+    // monotonic seconds
+    atom_t beat;
+    // BUS_TERM_XXX
+    atom_t state;
+    // monotonic seconds of the last process probe
+    atom_t probe;
+} life_t;
+
+enum {
+    BUS_TERM_ALIVE = 0,
+    BUS_TERM_DEAD,
+};
+
+// terminal doorbell, shared by all pipes to the terminal
+// writers ring it only when the reader is going to sleep
+typedef struct bus_bell_t {
+    // futex word
+    atom_t seq;
+    // BUS_BELL_XXX
+    atom_t waiting;
+} bell_t;
+
+enum {
+    BUS_BELL_NONE = 0,
+    BUS_BELL_FUTEX,
+    BUS_BELL_FD,
+};
+
+// broadcast pipe, single writer & multi readers
+// pipe head's "to" is the terminal type
+// followed by read cursors & subscribed flags of terminals, same index as terms
+typedef struct bus_bcast_head {
+    head_t pipe;
+    atom_t cursors[0];
+} bcast_t;
+
+// pipe config of destination, size 0 means default
+typedef struct bus_pipe_conf_t {
+    int by_type;
+    int id;
+    size_t size;
+    int mpsc;
+    int lanes;
+} conf_t;
+
 typedef struct bus_pipe_t{
     head_t* head;
+    // head's key when attached, slot may be reused after reclaimed
+    int key;
+    shm_t* shm;
+    // lane 0
     rbuffer_t* r;
+    rbuffer_t* lanes[BUS_MAX_LANES];
+    int nlanes;
+    // lane peeked, to be consumed
+    int lane;
+    // local spill queues of lanes, created when pipe is full,
+    // spill size is split by lanes, bytes with record heads
+    rbuffer_t* spills[BUS_MAX_LANES];
+    size_t spill_bytes;
+    // above high watermark
+    int spill_high;
+    // doorbell & liveness of the receiver
+    bell_t* bell;
+    life_t* life;
+    // broadcast pipe, and read cursor for subscriber
+    bcast_t* bcast;
+    volatile atom_t* cursor;
 } pipe_t;
 
+// bus directory in shm, arrays sized by capacity follow the head:
+// terms, bells, lives, terminal hash slots, pipes, broadcast pipes
 typedef struct bus_head {
     int key;
-    int16_t ckey;
+    uint16_t ckey;
     size_t size;
+    // control plane lock
+    char lock[PLOCK_SIZE] __attribute__((aligned(8)));
+    // capacity
+    int max_terms;
+    int max_pipes;
+    int max_bcasts;
+    // terminal hash slots count, 2^n
+    int hsize;
+    size_t bcast_size;
+    // arrays offset
+    size_t terms_off;
+    size_t bells_off;
+    size_t lives_off;
+    size_t hash_off;
+    size_t pipes_off;
+    size_t bcasts_off;
     // terminals info
     atom_t tver;
     int tcount;
-    bus_addr_t terms[BUS_MAX_TERMINAL_COUNT];
     // channel info
     atom_t pver;
     int pcount;
-    head_t pipes[BUS_MAX_PIPE_COUNT];
+    int bcount;
+    // pipes reclaimed
+    atom_t rver;
+    // dead pipe slots reused, full scan needed
+    atom_t pgen;
 } bus_head;
 
+#define BUS_HEAD_ALIGN 64
+#define BUS_HASH_EMPTY 0
+// spin times waiting for the creator
+#define BUS_ATTACH_WAIT_LOOP 100000
+
 struct bus_t {
     bus_head* head;
+    shm_t* shm;
     bus_addr_t self;
-    lock_t* lock;
+    int index;
+    plock_t* lock;
     uint32_t tver;
     uint32_t pver;
     int tcount;
-    bus_addr_t terms[BUS_MAX_TERMINAL_COUNT];
+    bus_addr_t* terms;
+    // distinct terminal types
+    int tycount;
+    int* types;
+    // pipes scanned, discover new ones only
+    int pscan;
+    int bscan;
+    uint32_t rver;
+    uint32_t pgen;
+    // heartbeat timeout seconds, 0 means checking process only
+    int timeout;
     idtable_t* opipes;
     idtable_t* ipipes;
+    // broadcast pipes, output by type & input by from
+    idtable_t* bopipes;
+    idtable_t* bipipes;
+    // input pipes in order, for fair round-robin receiving
+    int icursor;
+    int icount;
+    pipe_t** ilist;
+    // max lanes of input pipes
+    int ilanes;
+    // doorbell
+    bell_t* bell;
+    sock_t rfd;
+    sock_t wfd;
+    // stamp enqueue time
+    int stamp;
+    // pipe size config
+    int ccount;
+    conf_t confs[BUS_MAX_PIPE_CONF];
+    // spill queue config, size 0 means disabled
+    size_t spill_size;
+    size_t spill_hwm;
+    size_t spill_lwm;
+    bus_spill_func spill_cb;
+    void* spill_arg;
+    // some pipes may have spilled messages
+    int spilling;
 };
 
 static void
@@ -52,7 +227,141 @@ _head_t_assign(head_t* head, int key, bus_addr_t from,
         head->size = sz;
         head->from = from;
         head->to = to;
+        head->huge = 0;
+        head->dead = 0;
+        head->mpsc = 0;
+        head->lanes = 1;
+        memset(&head->send, 0, sizeof(head->send));
+        memset(&head->recv, 0, sizeof(head->recv));
+    }
+}
+
+static void _bus_bell_init(bell_t* bell);
+static void _bus_life_init(life_t* life);
+static void _bus_spill_poll(bus_t* bt);
+static int _bus_lock(bus_t* bt);
+static void _bus_repair(bus_t* bt);
+
+static inline bus_addr_t*
+_bus_terms(bus_head* head) {
+    return (bus_addr_t*)((char*)head + head->terms_off);
+}
+
+static inline bell_t*
+_bus_bells(bus_head* head) {
+    return (bell_t*)((char*)head + head->bells_off);
+}
+
+static inline life_t*
+_bus_lives(bus_head* head) {
+    return (life_t*)((char*)head + head->lives_off);
+}
+
+// terminal index + 1, BUS_HASH_EMPTY means empty slot
+static inline int32_t*
+_bus_hash(bus_head* head) {
+    return (int32_t*)((char*)head + head->hash_off);
+}
+
+static inline head_t*
+_bus_pipe_at(bus_head* head, int i) {
+    return (head_t*)((char*)head + head->pipes_off) + i;
+}
+
+static inline bcast_t*
+_bus_bcast_at(bus_head* head, int i) {
+    return (bcast_t*)((char*)head + head->bcasts_off + head->bcast_size * i);
+}
+
+static inline int8_t*
+_bus_bcast_subs(bus_head* head, bcast_t* bc) {
+    return (int8_t*)(bc->cursors + head->max_terms);
+}
+
+static inline uint32_t
+_bus_hash_slot(bus_head* head, bus_addr_t addr) {
+    return ((uint32_t)addr * 2654435761u) & (head->hsize - 1);
+}
+
+// lock free, slots are only added under lock
+static int
+_bus_term_index(bus_head* head, bus_addr_t addr) {
+    int32_t* hash = _bus_hash(head);
+    bus_addr_t* terms = _bus_terms(head);
+    uint32_t slot = _bus_hash_slot(head, addr);
+    for (int i = 0; i < head->hsize; ++ i) {
+        int32_t index = hash[slot];
+        if (index == BUS_HASH_EMPTY)
+            return -1;
+        if (terms[index - 1] == addr)
+            return index - 1;
+        slot = (slot + 1) & (head->hsize - 1);
+    }
+    return -1;
+}
+
+// under lock, terminal is complete once hashed
+static void
+_bus_hash_add(bus_head* head, bus_addr_t addr, int index) {
+    int32_t* hash = _bus_hash(head);
+    uint32_t slot = _bus_hash_slot(head, addr);
+    while (hash[slot] != BUS_HASH_EMPTY) {
+        slot = (slot + 1) & (head->hsize - 1);
     }
+    __sync_synchronize();
+    hash[slot] = index + 1;
+}
+
+// under lock
+static int
+_bus_term_add(bus_head* head, bus_addr_t addr) {
+    if (head->tcount >= head->max_terms)
+        return -1;
+    int index = head->tcount;
+    _bus_terms(head)[index] = addr;
+    _bus_bell_init(&_bus_bells(head)[index]);
+    _bus_life_init(&_bus_lives(head)[index]);
+    _bus_hash_add(head, addr, index);
+    ++ head->tcount;
+    return index;
+}
+
+static bell_t*
+_bus_bell(bus_head* head, bus_addr_t addr) {
+    int index = _bus_term_index(head, addr);
+    return index < 0 ? NULL : &_bus_bells(head)[index];
+}
+
+static life_t*
+_bus_life(bus_head* head, bus_addr_t addr) {
+    int index = _bus_term_index(head, addr);
+    return index < 0 ? NULL : &_bus_lives(head)[index];
+}
+
+static void
+_bus_bell_init(bell_t* bell) {
+    atom_set(&bell->seq, 0);
+    atom_set(&bell->waiting, BUS_BELL_NONE);
+}
+
+// monotonic seconds
+static uint32_t
+_bus_now() {
+    struct timespec ts;
+#if defined(CLOCK_MONOTONIC_COARSE)
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (uint32_t)ts.tv_sec;
+}
+
+static void
+_bus_life_init(life_t* life) {
+    atom_set(&life->pid, getpid());
+    atom_set(&life->beat, _bus_now());
+    atom_set(&life->state, BUS_TERM_ALIVE);
+    atom_set(&life->probe, 0);
 }
 
 static pipe_t*
@@ -62,24 +371,82 @@ _bus_pipe_create(head_t* head, int create) {
     pipe_t* bp = (pipe_t*)MALLOC(sizeof(*bp));
     assert(bp);
     bp->head = head;
-    // extend ring-buffer head
-    shm_t* shm = shm_create(head->key, head->size + rbuffer_head_size(), create);
+    bp->key = head->key;
+    bp->shm = NULL;
+    bp->bell = NULL;
+    bp->life = NULL;
+    bp->bcast = NULL;
+    bp->cursor = NULL;
+    bp->nlanes = (head->lanes > 1 && head->lanes <= BUS_MAX_LANES) ? head->lanes : 1;
+    bp->lane = 0;
+    memset(bp->spills, 0, sizeof(bp->spills));
+    bp->spill_bytes = 0;
+    bp->spill_high = 0;
+    // extend ring-buffer head, lanes follow one by one
+    // a new large pipe tries huge pages first, and falls back
+    size_t lsz = head->size + rbuffer_head_size();
+    size_t sz = lsz * bp->nlanes;
+    shm_t* shm = NULL;
+    if (create == 0) {
+        head->huge = (head->size >= BUS_PIPE_HUGE_SIZE);
+    }
+    if (head->huge) {
+        shm = shm_create_huge(head->key, sz, create);
+        if (!shm && create == 0)
+            head->huge = 0;
+    }
+    if (!head->huge) {
+        shm = shm_create(head->key, sz, create);
+    }
     if (!shm) {
         FREE(bp);
         return NULL;
     }
-    shm_mem(shm);
-    bp->r = rbuffer_attach((char*)shm_mem(shm), head->size + rbuffer_head_size());
-    if (!bp->r) {
-        FREE(bp);
-        return NULL;
+    // create == 0 means a new pipe, otherwise it's an exist one with messages
+    for (int i = 0; i < bp->nlanes; ++ i) {
+        char* mem = (char*)shm_mem(shm) + lsz * i;
+        if (create == 0 && head->mpsc) {
+            bp->lanes[i] = rbuffer_attach_mpsc(mem, lsz);
+        } else if (create == 0) {
+            bp->lanes[i] = rbuffer_attach(mem, lsz);
+        } else {
+            bp->lanes[i] = rbuffer_attach_exist(mem, lsz);
+        }
+        if (!bp->lanes[i]) {
+            shm_detach(shm);
+            FREE(bp);
+            return NULL;
+        }
     }
+    bp->r = bp->lanes[0];
+    bp->shm = shm;
     return bp;
 }
 
 static void
 _bus_pipe_release(pipe_t* bp) {
-    if (bp) FREE(bp);
+    if (bp) {
+        for (int i = 0; i < BUS_MAX_LANES; ++ i)
+            rbuffer_release(bp->spills[i]);
+        shm_detach(bp->shm);
+        FREE(bp);
+    }
+}
+
+// remove pipe's shm, freed after all terminals detach
+static void
+_bus_pipe_reclaim(head_t* head) {
+    head->dead = 1;
+    shm_t* shm = shm_attach(head->key);
+    if (shm) {
+        shm_destroy(shm);
+        shm_detach(shm);
+    }
+}
+
+static inline int
+_bus_pipe_dead(pipe_t* bp) {
+    return bp->head->dead || bp->head->key != bp->key;
 }
 
 static rbuffer_t*
@@ -92,54 +459,263 @@ _head_t(pipe_t* bp) {
     return bp ? bp->head : NULL;
 }
 
+static uint32_t
+_bus_pipe_read_bytes(pipe_t* bp) {
+    if (bp->cursor)
+        return rbuffer_cursor_read_bytes(bp->r, bp->cursor);
+    uint32_t bytes = 0;
+    for (int i = 0; i < bp->nlanes; ++ i)
+        bytes += rbuffer_read_bytes(bp->lanes[i]);
+    return bytes;
+}
+
+// monotonic micro-seconds, 0 means no stamp
+static uint32_t
+_bus_stamp() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint32_t stamp = (uint32_t)(ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+    return stamp ? stamp : 1;
+}
+
+// no load of receiver's position here, peak is sampled by receiver,
+// except broadcast, whose read pos is written by sender itself
+static void
+_bus_stat_send(pipe_t* bp, size_t bufsz) {
+    stat_send_t* st = &bp->head->send;
+    if (bp->head->mpsc) {
+        __sync_add_and_fetch(&st->send_msgs, 1);
+        __sync_add_and_fetch(&st->send_bytes, bufsz);
+        return;
+    }
+    ++ st->send_msgs;
+    st->send_bytes += bufsz;
+    if (bp->bcast) {
+        uint32_t used = rbuffer_read_bytes(bp->r);
+        if (used > st->peak_bytes)
+            st->peak_bytes = used;
+    }
+}
+
+static void
+_bus_stat_fail(pipe_t* bp) {
+    if (bp->head->mpsc) {
+        __sync_add_and_fetch(&bp->head->send.send_fails, 1);
+    } else {
+        ++ bp->head->send.send_fails;
+    }
+}
+
+// broadcast pipe has multi readers
 static void
-_bus_head_init(bus_head* head, int key, bus_addr_t creator) {
+_bus_stat_add(pipe_t* bp, uint64_t* val, uint64_t n) {
+    if (bp->cursor) {
+        __sync_add_and_fetch(val, n);
+    } else {
+        *val += n;
+    }
+}
+
+static void
+_bus_stat_recv(pipe_t* bp, const char* data, size_t len) {
+    stat_recv_t* st = &bp->head->recv;
+    _bus_stat_add(bp, &st->recv_msgs, 1);
+    _bus_stat_add(bp, &st->recv_bytes, len);
+    if (!bp->cursor) {
+        uint32_t used = 0;
+        for (int i = 0; i < bp->nlanes; ++ i)
+            used += rbuffer_reader_bytes(bp->lanes[i]);
+        if (used > st->peak_bytes)
+            st->peak_bytes = used;
+    }
+    uint32_t stamp = rbuffer_stamp(data);
+    if (stamp) {
+        uint32_t latency = _bus_stamp() - stamp;
+        int i = latency ? 32 - __builtin_clz(latency) : 0;
+        if (i >= BUS_STAT_LATENCY_BUCKETS)
+            i = BUS_STAT_LATENCY_BUCKETS - 1;
+        _bus_stat_add(bp, &st->latency[i], 1);
+    }
+}
+
+// higher lane first, and remember it for consuming
+static const char*
+_bus_pipe_peek(pipe_t* bp, size_t* bufsz) {
+    if (bp->cursor)
+        return rbuffer_cursor_peek_ptr(bp->r, bp->cursor, bufsz);
+    for (int i = bp->nlanes - 1; i >= 0; -- i) {
+        const char* data = rbuffer_peek_ptr(bp->lanes[i], bufsz);
+        if (data) {
+            bp->lane = i;
+            return data;
+        }
+    }
+    return NULL;
+}
+
+// consume the lane peeked, as higher lanes may be written since
+static int
+_bus_pipe_consume(pipe_t* bp) {
+    size_t len;
+    const char* data;
+    if (bp->cursor) {
+        data = rbuffer_cursor_peek_ptr(bp->r, bp->cursor, &len);
+    } else {
+        data = rbuffer_peek_ptr(bp->lanes[bp->lane], &len);
+        if (!data)
+            data = _bus_pipe_peek(bp, &len);
+    }
+    if (!data)
+        return -1;
+    _bus_stat_recv(bp, data, len);
+    if (bp->cursor)
+        return rbuffer_cursor_consume(bp->r, bp->cursor);
+    return rbuffer_consume(bp->lanes[bp->lane]);
+}
+
+// return -1 if empty, BUS_ERR_OVERSIZE if larger than buffer
+static int
+_bus_pipe_read(pipe_t* bp, char* buf, size_t* bufsz) {
+    size_t len;
+    const char* data = _bus_pipe_peek(bp, &len);
+    if (!data)
+        return -1;
+    if (len > *bufsz)
+        return BUS_ERR_OVERSIZE;
+    memcpy(buf, data, len);
+    *bufsz = len;
+    return _bus_pipe_consume(bp);
+}
+
+// read the lane only
+static int
+_bus_pipe_read_lane(pipe_t* bp, int lane, char* buf, size_t* bufsz) {
+    size_t len;
+    if (bp->cursor || lane >= bp->nlanes)
+        return -1;
+    const char* data = rbuffer_peek_ptr(bp->lanes[lane], &len);
+    if (!data)
+        return -1;
+    if (len > *bufsz)
+        return BUS_ERR_OVERSIZE;
+    memcpy(buf, data, len);
+    *bufsz = len;
+    bp->lane = lane;
+    return _bus_pipe_consume(bp);
+}
+
+// priority over the highest lane is clamped
+static inline int
+_bus_pipe_lane(pipe_t* bp, int prio) {
+    return prio < bp->nlanes ? prio : bp->nlanes - 1;
+}
+
+static int
+_bus_pipe_write(bus_t* bt, pipe_t* bp, int prio, const char* buf, size_t bufsz) {
+    rbuffer_t* r = bp->lanes[_bus_pipe_lane(bp, prio)];
+    int ret = rbuffer_write_stamp(r, buf, bufsz, bt->stamp ? _bus_stamp() : 0);
+    if (ret == 0)
+        _bus_stat_send(bp, bufsz);
+    return ret;
+}
+
+// layout by capacity, return total size
+static size_t
+_bus_head_layout(bus_head* head, int max_terms, int max_pipes, int max_bcasts) {
+    head->max_terms = max_terms;
+    head->max_pipes = max_pipes;
+    head->max_bcasts = max_bcasts;
+    head->hsize = ROUNDUP(max_terms * 2);
+    head->bcast_size = ROUNDUP2(sizeof(bcast_t) + max_terms * (sizeof(atom_t) + 1), CACHE_LINE_SIZE);
+    size_t off = ROUNDUP2(sizeof(bus_head), BUS_HEAD_ALIGN);
+    head->terms_off = off;
+    off = ROUNDUP2(off + max_terms * sizeof(bus_addr_t), BUS_HEAD_ALIGN);
+    head->bells_off = off;
+    off = ROUNDUP2(off + max_terms * sizeof(bell_t), BUS_HEAD_ALIGN);
+    head->lives_off = off;
+    off = ROUNDUP2(off + max_terms * sizeof(life_t), BUS_HEAD_ALIGN);
+    head->hash_off = off;
+    off = ROUNDUP2(off + head->hsize * sizeof(int32_t), BUS_HEAD_ALIGN);
+    head->pipes_off = off;
+    off = ROUNDUP2(off + max_pipes * sizeof(head_t), BUS_HEAD_ALIGN);
+    head->bcasts_off = off;
+    off += max_bcasts * head->bcast_size;
+    return off;
+}
+
+static void
+_bus_head_init(bus_head* head, bus_addr_t creator, size_t size) {
     if (head) {
-        head->key = key;
         head->ckey = 0;
-        head->size = sizeof(bus_head);
+        head->size = size;
         atom_set(&head->tver, 1);
-        head->tcount = 1;
-        head->terms[0] = creator;
+        head->tcount = 0;
+        memset(_bus_hash(head), 0, head->hsize * sizeof(int32_t));
+        _bus_term_add(head, creator);
         atom_set(&head->pver, 1);
         head->pcount = 0;
+        head->bcount = 0;
+        atom_set(&head->rver, 1);
+        atom_set(&head->pgen, 1);
     }
 }
 
 static int
-_bus_head_create(bus_t* bt, int16_t key) {
+_bus_head_create(bus_t* bt, int16_t key, int max_terms, int max_pipes, int max_bcasts) {
     int buskey = (key << 16);
-    shm_t* shm = shm_create(buskey, sizeof(bus_head), 0);
+    bus_head layout;
+    size_t size = _bus_head_layout(&layout, max_terms, max_pipes, max_bcasts);
+    shm_t* shm = shm_create(buskey, size, 0);
     if (shm) {
+        bt->shm = shm;
         bt->head = (bus_head*)shm_mem(shm);
         assert(bt->head);
-        _bus_head_init(bt->head, buskey, bt->self);
+        _bus_head_layout(bt->head, max_terms, max_pipes, max_bcasts);
+        _bus_head_init(bt->head, bt->self, size);
+        bt->lock = plock_attach(bt->head->lock, sizeof(bt->head->lock), 1);
+        assert(bt->lock);
+        // key at last, terminals attaching wait for it
+        __sync_synchronize();
+        *(volatile int*)&bt->head->key = buskey;
         return 0;
     }
     return -1;
 }
 
+// terminals are only appended, copy new ones
 static void
 _bus_update_terminals(bus_t* bt) {
     assert(bt && bt->head);
     bt->tver = bt->head->tver;
-    bt->tcount = bt->head->tcount;
-    for (int i = 0; i < bt->tcount; ++ i) {
-        bt->terms[i] = bt->head->terms[i];
+    bus_addr_t* terms = _bus_terms(bt->head);
+    for (; bt->tcount < bt->head->tcount; ++ bt->tcount) {
+        bus_addr_t addr = terms[bt->tcount];
+        bt->terms[bt->tcount] = addr;
+        if (addr == bt->self)
+            continue;
+        int i = 0;
+        for (; i < bt->tycount && bt->types[i] != bus_addr_type(addr); ++ i);
+        if (i == bt->tycount)
+            bt->types[bt->tycount ++] = bus_addr_type(addr);
     }
 }
 
+// pipes are only appended, discover new ones since last scan
 static void
 _bus_update_pipes(bus_t* bt) {
     assert(bt && bt->head);
     bt->pver = bt->head->pver;
-    for (int i = 0; i < bt->head->pcount; ++ i) {
-        head_t* phead = &bt->head->pipes[i];
+    for (; bt->pscan < bt->head->pcount; ++ bt->pscan) {
+        head_t* phead = _bus_pipe_at(bt->head, bt->pscan);
         pipe_t* bp;
         int ret;
+        if (phead->dead)
+            continue;
         if (phead->from == bt->self && !idtable_get(bt->opipes, phead->to)) {
             bp = _bus_pipe_create(phead, 1);
             assert(bp);
+            bp->bell = _bus_bell(bt->head, phead->to);
+            bp->life = _bus_life(bt->head, phead->to);
             ret = idtable_add(bt->opipes, phead->to, bp);
             assert(0 == ret);
         } else if (phead->to == bt->self && !idtable_get(bt->ipipes, phead->from)) {
@@ -147,64 +723,176 @@ _bus_update_pipes(bus_t* bt) {
             assert(bp);
             ret = idtable_add(bt->ipipes, phead->from, bp);
             assert(0 == ret);
+            bt->ilist[bt->icount ++] = bp;
+            if (bp->nlanes > bt->ilanes)
+                bt->ilanes = bp->nlanes;
+        }
+    }
+    // broadcast pipes
+    for (; bt->bscan < bt->head->bcount; ++ bt->bscan) {
+        bcast_t* bc = _bus_bcast_at(bt->head, bt->bscan);
+        int8_t* subs = _bus_bcast_subs(bt->head, bc);
+        head_t* phead = &bc->pipe;
+        pipe_t* bp;
+        int ret;
+        if (phead->dead)
+            continue;
+        if (phead->from == bt->self && !idtable_get(bt->bopipes, phead->to)) {
+            bp = _bus_pipe_create(phead, 1);
+            assert(bp);
+            bp->bcast = bc;
+            ret = idtable_add(bt->bopipes, phead->to, bp);
+            assert(0 == ret);
+        } else if (phead->to == bus_addr_type(bt->self) && phead->from != bt->self
+            && !idtable_get(bt->bipipes, phead->from)) {
+            bp = _bus_pipe_create(phead, 1);
+            assert(bp);
+            bp->bcast = bc;
+            bp->cursor = &bc->cursors[bt->index];
+            // subscribe from now on
+            if (!subs[bt->index]) {
+                atom_set(bp->cursor, rbuffer_write_pos(bp->r));
+                subs[bt->index] = 1;
+                __sync_synchronize();
+            }
+            ret = idtable_add(bt->bipipes, phead->from, bp);
+            assert(0 == ret);
+            bt->ilist[bt->icount ++] = bp;
         }
     }
 }
 
+// wait for the creator, and check it's a bus of the key
+// read only, so a foreign or stale segment is never locked
+static int
+_bus_head_check(bus_head* head, int key, size_t size) {
+    for (int i = 0; i < BUS_ATTACH_WAIT_LOOP && 0 == *(volatile int*)&head->key; ++ i)
+        sched_yield();
+    __sync_synchronize();
+    return (head->key == key && head->size <= size) ? 0 : -1;
+}
+
 static int
 _bus_create_attach(bus_t* bt, int16_t key) {
     // attach exsit shm
     int buskey = (key << 16);
-    shm_t* shm = shm_create(buskey, sizeof(bus_head), 1);
-    assert(shm);
-    bt->head = (bus_head*)shm_mem(shm);
-    if (bt->head->key != buskey || bt->head->size != sizeof(bus_head)) {
+    shm_t* shm = shm_attach(buskey);
+    if (!shm)
         return -1;
-    }
-    // register terminal info
-    int registered = -1;
-    for (int i = 0; i < bt->head->tcount; ++ i) {
-        if (bt->head->terms[i] == bt->self) {
-            registered = 0;
-            break;
-        }
-    }
-    if (registered != 0) {
-        if (bt->head->tcount >= BUS_MAX_TERMINAL_COUNT) {
-            return -1;
-        } else {
-            bt->head->terms[bt->head->tcount ++] = bt->self;
-            atom_inc(&bt->head->tver);
+    bt->shm = shm;
+    bt->head = (bus_head*)shm_mem(shm);
+    if (shm_size(shm) < sizeof(bus_head))
+        goto ATTACH_DETACH;
+    if (_bus_head_check(bt->head, buskey, shm_size(shm)) < 0)
+        goto ATTACH_DETACH;
+    bt->lock = plock_attach(bt->head->lock, sizeof(bt->head->lock), 0);
+    if (!bt->lock)
+        goto ATTACH_DETACH;
+    int locked = plock_lock(bt->lock);
+    if (locked < 0)
+        goto ATTACH_DETACH;
+    // check again, as it may be destroyed and created since
+    if (bt->head->key != buskey || bt->head->size > shm_size(shm))
+        goto ATTACH_FAIL;
+    if (locked == PLOCK_OWNER_DEAD)
+        _bus_repair(bt);
+    // register terminal info, or restart with the same address
+    int index = _bus_term_index(bt->head, bt->self);
+    if (index < 0) {
+        if (_bus_term_add(bt->head, bt->self) < 0) {
+            goto ATTACH_FAIL;
         }
+        atom_inc(&bt->head->tver);
+    } else {
+        _bus_life_init(&_bus_lives(bt->head)[index]);
     }
+    plock_unlock(bt->lock);
     return 0;
+
+ATTACH_FAIL:
+    plock_unlock(bt->lock);
+ATTACH_DETACH:
+    shm_detach(shm);
+    bt->shm = NULL;
+    bt->head = NULL;
+    return -1;
 }
 
 bus_t*
 bus_create(int16_t key, bus_addr_t addr) {
+    return bus_create_sized(key, addr, 0, 0, 0);
+}
+
+bus_t*
+bus_create_sized(int16_t key, bus_addr_t addr, int max_terms,
+                 int max_pipes, int max_bcasts) {
+    max_terms = max_terms > 0 ? max_terms : BUS_DEFAULT_TERMINAL_COUNT;
+    max_pipes = max_pipes > 0 ? max_pipes : BUS_DEFAULT_PIPE_COUNT;
+    max_bcasts = max_bcasts > 0 ? max_bcasts : BUS_DEFAULT_BCAST_COUNT;
+    if (max_terms > BUS_MAX_TERMINAL_COUNT)
+        return NULL;
     bus_t* bt = (bus_t*)MALLOC(sizeof(*bt));
     if (!bt) return NULL;
     bt->head = NULL;
+    bt->shm = NULL;
     bt->self = addr;
+    bt->index = -1;
     bt->tver = 0;
     bt->pver = 0;
-    bt->lock = lock_create(key);
-    assert(bt->lock);
-    bt->opipes = idtable_create(BUS_MAX_TERMINAL_COUNT);
+    bt->tcount = 0;
+    bt->tycount = 0;
+    bt->pscan = 0;
+    bt->bscan = 0;
+    bt->timeout = 0;
+    bt->icursor = 0;
+    bt->icount = 0;
+    bt->ilanes = 1;
+    bt->bell = NULL;
+    bt->rfd = INVALID_SOCK;
+    bt->wfd = INVALID_SOCK;
+    bt->stamp = 0;
+    bt->ccount = 0;
+    bt->spill_size = 0;
+    bt->spill_cb = NULL;
+    bt->spilling = 0;
+    bt->lock = NULL;
+    if (_bus_head_create(bt, key, max_terms, max_pipes, max_bcasts) != 0
+        && _bus_create_attach(bt, key) != 0) {
+        FREE(bt);
+        return NULL;
+    }
+
+    // local tables sized by capacity of the bus
+    // odd table size, so addresses of different types spread well
+    max_terms = bt->head->max_terms;
+    bt->terms = (bus_addr_t*)MALLOC(sizeof(bus_addr_t) * max_terms);
+    assert(bt->terms);
+    bt->types = (int*)MALLOC(sizeof(int) * max_terms);
+    assert(bt->types);
+    bt->ilist = (pipe_t**)MALLOC(sizeof(pipe_t*) * max_terms * 2);
+    assert(bt->ilist);
+    bt->opipes = idtable_create(max_terms * 2 + 1);
     assert(bt->opipes);
-    bt->ipipes = idtable_create(BUS_MAX_TERMINAL_COUNT);
+    bt->ipipes = idtable_create(max_terms * 2 + 1);
     assert(bt->ipipes);
+    bt->bopipes = idtable_create(max_terms * 2 + 1);
+    assert(bt->bopipes);
+    bt->bipipes = idtable_create(max_terms * 2 + 1);
+    assert(bt->bipipes);
 
-    lock_lock(bt->lock);
-    if (_bus_head_create(bt, key) == 0 || _bus_create_attach(bt, key) == 0) {
-        _bus_update_terminals(bt);
-        _bus_update_pipes(bt);
-        lock_unlock(bt->lock);
-        return bt;
+    if (_bus_lock(bt) < 0) {
+        bus_release(bt);
+        return NULL;
     }
-    lock_unlock(bt->lock);
-    FREE(bt);
-    return NULL;
+    _bus_update_terminals(bt);
+    bt->index = _bus_term_index(bt->head, bt->self);
+    assert(bt->index >= 0);
+    bt->bell = &_bus_bells(bt->head)[bt->index];
+    bt->rver = bt->head->rver;
+    bt->pgen = bt->head->pgen;
+    _bus_update_pipes(bt);
+    plock_unlock(bt->lock);
+    return bt;
 }
 
 static int
@@ -222,33 +910,398 @@ bus_release(bus_t* bt) {
         idtable_loop(bt->ipipes, _bus_release_pipe, NULL, 0);
         idtable_release(bt->ipipes);
         bt->ipipes = NULL;
+        idtable_loop(bt->bopipes, _bus_release_pipe, NULL, 0);
+        idtable_release(bt->bopipes);
+        bt->bopipes = NULL;
+        idtable_loop(bt->bipipes, _bus_release_pipe, NULL, 0);
+        idtable_release(bt->bipipes);
+        bt->bipipes = NULL;
+        sock_close(bt->rfd);
+        sock_close(bt->wfd);
+        FREE(bt->terms);
+        FREE(bt->types);
+        FREE(bt->ilist);
+        shm_detach(bt->shm);
         FREE(bt);
     }
 }
 
+typedef struct bus_purge_t {
+    pipe_t** pipes;
+    int count;
+} purge_t;
+
+static int
+_bus_purge_collect(void* data, void* arg) {
+    purge_t* pg = (purge_t*)arg;
+    pg->pipes[pg->count ++] = (pipe_t*)data;
+    return 0;
+}
+
+// rebuild table without dead pipes, as idtable removing breaks probing
+static void
+_bus_purge_table(idtable_t* table, int by_from, pipe_t** buf) {
+    purge_t pg;
+    pg.pipes = buf;
+    pg.count = 0;
+    idtable_loop(table, _bus_purge_collect, &pg, 0);
+    idtable_cleanup(table);
+    for (int i = 0; i < pg.count; ++ i) {
+        pipe_t* bp = pg.pipes[i];
+        if (_bus_pipe_dead(bp)) {
+            _bus_pipe_release(bp);
+        } else {
+            idtable_add(table, by_from ? bp->head->from : bp->head->to, bp);
+        }
+    }
+}
+
+// drop local pipes reclaimed
+static void
+_bus_update_reclaimed(bus_t* bt) {
+    bt->rver = bt->head->rver;
+    int n = 0;
+    for (int i = 0; i < bt->icount; ++ i) {
+        if (!_bus_pipe_dead(bt->ilist[i]))
+            bt->ilist[n ++] = bt->ilist[i];
+    }
+    bt->icount = n;
+    if (bt->icursor >= n)
+        bt->icursor = 0;
+    pipe_t** buf = (pipe_t**)MALLOC(sizeof(pipe_t*) * bt->head->max_terms * 2);
+    assert(buf);
+    _bus_purge_table(bt->opipes, 0, buf);
+    _bus_purge_table(bt->ipipes, 1, buf);
+    _bus_purge_table(bt->bopipes, 0, buf);
+    _bus_purge_table(bt->bipipes, 1, buf);
+    FREE(buf);
+}
+
+static void
+_bus_heartbeat(bus_t* bt) {
+    life_t* life = &_bus_lives(bt->head)[bt->index];
+    uint32_t now = _bus_now();
+    if (life->beat != now)
+        atom_set(&life->beat, now);
+    // marked dead by others (e.g. heartbeat timeout), but still alive
+    if (life->state != BUS_TERM_ALIVE)
+        atom_set(&life->state, BUS_TERM_ALIVE);
+}
+
 // check bus version and do update
 void
 bus_poll(bus_t* bt) {
     if (!bt)
         return;
+    _bus_heartbeat(bt);
     // update terminals
     uint32_t tver = bt->head->tver;
     if (tver != bt->tver) {
-        lock_lock(bt->lock);
+        if (_bus_lock(bt) < 0)
+            return;
         _bus_update_terminals(bt);
-        lock_unlock(bt->lock);
+        plock_unlock(bt->lock);
+    }
+    // pipes reclaimed, or slots reused
+    uint32_t rver = bt->head->rver;
+    uint32_t pgen = bt->head->pgen;
+    if (rver != bt->rver || pgen != bt->pgen) {
+        if (_bus_lock(bt) < 0)
+            return;
+        _bus_update_reclaimed(bt);
+        if (pgen != bt->pgen) {
+            bt->pgen = pgen;
+            bt->pscan = 0;
+            bt->bscan = 0;
+            bt->pver = 0;
+        }
+        plock_unlock(bt->lock);
     }
     // udpate pipe
     uint32_t pver = bt->head->pver;
     if (pver != bt->pver) {
-        lock_lock(bt->lock);
+        if (_bus_lock(bt) < 0)
+            return;
         _bus_update_pipes(bt);
-        lock_unlock(bt->lock);
+        plock_unlock(bt->lock);
+    }
+    // flush spilled messages
+    if (bt->spilling)
+        _bus_spill_poll(bt);
+}
+
+// probe process at most once per heartbeat second unless forced,
+// failed sends to a full pipe come in bursts
+static int
+_bus_term_dead(bus_t* bt, life_t* life, int force) {
+    if (life->state == BUS_TERM_DEAD)
+        return 1;
+    uint32_t now = _bus_now();
+    if (bt->timeout > 0 && (int)(now - life->beat) > bt->timeout)
+        return 1;
+    if (!force && life->probe == now)
+        return 0;
+    atom_set(&life->probe, now);
+    pid_t pid = (pid_t)life->pid;
+    return pid > 0 && kill(pid, 0) < 0 && errno == ESRCH;
+}
+
+// check liveness of peer, and mark it if dead
+static int
+_bus_peer_dead(bus_t* bt, life_t* life, int force) {
+    if (!life || life == &_bus_lives(bt->head)[bt->index])
+        return 0;
+    if (_bus_term_dead(bt, life, force)) {
+        atom_set(&life->state, BUS_TERM_DEAD);
+        return 1;
+    }
+    return 0;
+}
+
+// the pipe being registered has the last key, and its sender is the one died
+static void
+_bus_repair_pipe(bus_t* bt, head_t* phead, int key) {
+    if (phead->dead || phead->key != key)
+        return;
+    life_t* life = _bus_life(bt->head, phead->from);
+    if (!life || _bus_term_dead(bt, life, 1))
+        _bus_pipe_reclaim(phead);
+}
+
+// the owner died holding the lock, repair what it may leave half done:
+// a terminal hashed but not counted, a pipe half registered, versions not bumped
+static void
+_bus_repair(bus_t* bt) {
+    bus_head* head = bt->head;
+    int32_t* hash = _bus_hash(head);
+    for (int i = 0; i < head->hsize && head->tcount < head->max_terms; ++ i) {
+        if (hash[i] == head->tcount + 1) {
+            ++ head->tcount;
+            break;
+        }
+    }
+    bus_addr_t* terms = _bus_terms(head);
+    for (int i = 0; i < head->tcount; ++ i) {
+        if (_bus_term_index(head, terms[i]) != i)
+            _bus_hash_add(head, terms[i], i);
+    }
+    // the slot next to count is included, as count is bumped at last
+    int key = head->key + head->ckey;
+    for (int i = 0; i <= head->pcount && i < head->max_pipes; ++ i)
+        _bus_repair_pipe(bt, _bus_pipe_at(head, i), key);
+    for (int i = 0; i <= head->bcount && i < head->max_bcasts; ++ i)
+        _bus_repair_pipe(bt, &_bus_bcast_at(head, i)->pipe, key);
+    // terminals rescan all
+    atom_inc(&head->tver);
+    atom_inc(&head->rver);
+    atom_inc(&head->pgen);
+    atom_inc(&head->pver);
+}
+
+// control plane lock, return < 0 if fail
+static int
+_bus_lock(bus_t* bt) {
+    int ret = plock_lock(bt->lock);
+    if (ret == PLOCK_OWNER_DEAD) {
+        _bus_repair(bt);
+        ret = 0;
+    }
+    return ret;
+}
+
+void
+bus_set_timeout(bus_t* bt, int seconds) {
+    if (bt)
+        bt->timeout = seconds;
+}
+
+int
+bus_reclaim(bus_t* bt) {
+    if (!bt)
+        return BUS_ERR_FAIL;
+    bus_poll(bt);
+    bus_head* head = bt->head;
+    bus_addr_t* terms = _bus_terms(head);
+    life_t* lives = _bus_lives(head);
+    int n = 0;
+    if (_bus_lock(bt) < 0)
+        return BUS_ERR_FAIL;
+    for (int i = 0; i < head->tcount; ++ i) {
+        if (!_bus_peer_dead(bt, &lives[i], 1))
+            continue;
+        bus_addr_t addr = terms[i];
+        for (int j = 0; j < head->pcount; ++ j) {
+            head_t* phead = _bus_pipe_at(head, j);
+            if (!phead->dead && (phead->from == addr || phead->to == addr)) {
+                _bus_pipe_reclaim(phead);
+                ++ n;
+            }
+        }
+        // broadcast pipes from it, or stop holding others
+        for (int j = 0; j < head->bcount; ++ j) {
+            bcast_t* bc = _bus_bcast_at(head, j);
+            if (bc->pipe.dead)
+                continue;
+            if (bc->pipe.from == addr) {
+                _bus_pipe_reclaim(&bc->pipe);
+                ++ n;
+            } else {
+                _bus_bcast_subs(head, bc)[i] = 0;
+            }
+        }
+    }
+    if (n > 0) {
+        atom_inc(&head->rver);
+        atom_inc(&head->pver);
+    }
+    plock_unlock(bt->lock);
+    bus_poll(bt);
+    return n;
+}
+
+// find or add
+static conf_t*
+_bus_conf(bus_t* bt, int by_type, int id) {
+    int i = 0;
+    for (; i < bt->ccount; ++ i) {
+        if (bt->confs[i].by_type == by_type && bt->confs[i].id == id)
+            return &bt->confs[i];
+    }
+    if (bt->ccount >= BUS_MAX_PIPE_CONF)
+        return NULL;
+    conf_t* conf = &bt->confs[bt->ccount ++];
+    memset(conf, 0, sizeof(*conf));
+    conf->by_type = by_type;
+    conf->id = id;
+    return conf;
+}
+
+static int
+_bus_conf_set(bus_t* bt, int by_type, int id, size_t size) {
+    if (!bt || size == 0 || size > BUS_PIPE_MAX_SIZE)
+        return BUS_ERR_FAIL;
+    conf_t* conf = _bus_conf(bt, by_type, id);
+    if (!conf)
+        return BUS_ERR_FAIL;
+    conf->size = size;
+    return BUS_OK;
+}
+
+int
+bus_set_pipe_size(bus_t* bt, bus_addr_t to, size_t size) {
+    return _bus_conf_set(bt, 0, to, size);
+}
+
+int
+bus_set_pipe_size_by_type(bus_t* bt, int type, size_t size) {
+    return _bus_conf_set(bt, 1, type, size);
+}
+
+static int
+_bus_conf_mpsc(bus_t* bt, int by_type, int id) {
+    if (!bt)
+        return BUS_ERR_FAIL;
+    conf_t* conf = _bus_conf(bt, by_type, id);
+    if (!conf)
+        return BUS_ERR_FAIL;
+    conf->mpsc = 1;
+    return BUS_OK;
+}
+
+int
+bus_set_pipe_mpsc(bus_t* bt, bus_addr_t to) {
+    return _bus_conf_mpsc(bt, 0, to);
+}
+
+int
+bus_set_pipe_mpsc_by_type(bus_t* bt, int type) {
+    return _bus_conf_mpsc(bt, 1, type);
+}
+
+static int
+_bus_conf_lanes(bus_t* bt, int by_type, int id, int lanes) {
+    if (!bt || lanes <= 0 || lanes > BUS_MAX_LANES)
+        return BUS_ERR_FAIL;
+    conf_t* conf = _bus_conf(bt, by_type, id);
+    if (!conf)
+        return BUS_ERR_FAIL;
+    conf->lanes = lanes;
+    return BUS_OK;
+}
+
+int
+bus_set_pipe_lanes(bus_t* bt, bus_addr_t to, int lanes) {
+    return _bus_conf_lanes(bt, 0, to, lanes);
+}
+
+int
+bus_set_pipe_lanes_by_type(bus_t* bt, int type, int lanes) {
+    return _bus_conf_lanes(bt, 1, type, lanes);
+}
+
+// configured size, round up by 2^n as ring-buffer requires
+static size_t
+_bus_pipe_size(bus_t* bt, int by_type, int id) {
+    size_t size = BUS_PIPE_DEFAULT_SIZE;
+    int type = by_type ? id : bus_addr_type(id);
+    int matched = 0;
+    for (int i = 0; i < bt->ccount; ++ i) {
+        conf_t* conf = &bt->confs[i];
+        if (conf->size == 0)
+            continue;
+        if (!by_type && !conf->by_type && conf->id == id) {
+            size = conf->size;
+            break;
+        }
+        if (conf->by_type && conf->id == type && !matched) {
+            size = conf->size;
+            matched = 1;
+        }
+    }
+    if (size & (size - 1)) {
+        size = ROUNDUP(size);
+    }
+    return size;
+}
+
+// set by address or type
+static int
+_bus_pipe_mpsc(bus_t* bt, bus_addr_t to) {
+    for (int i = 0; i < bt->ccount; ++ i) {
+        conf_t* conf = &bt->confs[i];
+        int id = conf->by_type ? bus_addr_type(to) : to;
+        if (conf->mpsc && conf->id == id)
+            return 1;
+    }
+    return 0;
+}
+
+// by address goes before by type
+static int
+_bus_pipe_lanes(bus_t* bt, bus_addr_t to) {
+    int lanes = 1;
+    for (int i = 0; i < bt->ccount; ++ i) {
+        conf_t* conf = &bt->confs[i];
+        if (conf->lanes == 0)
+            continue;
+        if (!conf->by_type && conf->id == to)
+            return conf->lanes;
+        if (conf->by_type && conf->id == bus_addr_type(to) && lanes == 1)
+            lanes = conf->lanes;
     }
+    return lanes;
+}
+
+// pipe shm key, 16 bits reserved by bus key
+static int
+_bus_pipe_key(bus_head* head) {
+    if (++ head->ckey == 0)
+        ++ head->ckey;
+    return head->key + head->ckey;
 }
 
 static pipe_t*
-_bus_register_pipe(bus_t* bt, bus_addr_t to, size_t sz) {
+_bus_register_pipe(bus_t* bt, bus_addr_t to, size_t sz, int mpsc, int lanes) {
     if (!bt)
         return NULL;
     // make sure same version
@@ -256,80 +1309,526 @@ _bus_register_pipe(bus_t* bt, bus_addr_t to, size_t sz) {
 
     // add lock
     bus_head* head = bt->head;
-    lock_lock(bt->lock);
+    if (_bus_lock(bt) < 0)
+        return NULL;
     if (bt->pver != head->pver) goto PIPE_CREATE_FAIL;
 
     // validate
-    if (head->pcount >= BUS_MAX_PIPE_COUNT)
+    life_t* life = _bus_life(head, to);
+    if (!life || life->state == BUS_TERM_DEAD || to == bt->self)
         goto PIPE_CREATE_FAIL;
-    int exist = -1;
-    for (int i = 0; i < head->tcount; ++ i) {
-        if (head->terms[i] == to) {
-            exist = 0;
-            break;
-        }
+    // reuse slot reclaimed if full
+    int slot = head->pcount;
+    if (slot >= head->max_pipes) {
+        for (slot = 0; slot < head->pcount && !_bus_pipe_at(head, slot)->dead; ++ slot);
+        if (slot == head->pcount)
+            goto PIPE_CREATE_FAIL;
     }
-    if (exist != 0 || to == bt->self)
-        goto PIPE_CREATE_FAIL;
 
     // create pipe
-    int key = head->key + (++ head->ckey);
-    head_t* bph = &head->pipes[head->pcount];
-    _head_t_assign(bph, key, bt->self, to, sz);
+    head_t* bph = _bus_pipe_at(head, slot);
+    _head_t_assign(bph, _bus_pipe_key(head), bt->self, to, sz);
+    bph->mpsc = mpsc;
+    bph->lanes = lanes;
     pipe_t* bp = _bus_pipe_create(bph, 0);
-    if (!bp)
+    if (!bp) {
+        bph->dead = 1;
         goto PIPE_CREATE_FAIL;
+    }
+    bp->bell = _bus_bell(head, to);
+    bp->life = life;
     int ret = idtable_add(bt->opipes, bph->to, bp);
     assert(0 == ret);
-    ++ bt->head->pcount;
+    if (slot == head->pcount) {
+        ++ bt->head->pcount;
+        ++ bt->pscan;
+    } else {
+        atom_inc(&bt->head->pgen);
+    }
 
     // version set. unlock
     atom_inc(&bt->head->pver);
     bt->pver = bt->head->pver;
-    lock_unlock(bt->lock);
+    plock_unlock(bt->lock);
     return bp;
 
 PIPE_CREATE_FAIL:
-    lock_unlock(bt->lock);
+    plock_unlock(bt->lock);
     return NULL;
 }
 
+static pipe_t*
+_bus_register_bcast(bus_t* bt, int type, size_t sz) {
+    if (!bt)
+        return NULL;
+    // make sure same version
+    bus_poll(bt);
+
+    // add lock
+    bus_head* head = bt->head;
+    if (_bus_lock(bt) < 0)
+        return NULL;
+    if (bt->pver != head->pver) goto BCAST_CREATE_FAIL;
+
+    // validate, reuse slot reclaimed if full
+    int slot = head->bcount;
+    if (slot >= head->max_bcasts) {
+        for (slot = 0; slot < head->bcount && !_bus_bcast_at(head, slot)->pipe.dead; ++ slot);
+        if (slot == head->bcount)
+            goto BCAST_CREATE_FAIL;
+    }
+
+    // create pipe, subscribed by all alive terminals of the type
+    bcast_t* bc = _bus_bcast_at(head, slot);
+    int8_t* subs = _bus_bcast_subs(head, bc);
+    bus_addr_t* terms = _bus_terms(head);
+    life_t* lives = _bus_lives(head);
+    _head_t_assign(&bc->pipe, _bus_pipe_key(head), bt->self, type, sz);
+    for (int i = 0; i < head->max_terms; ++ i) {
+        subs[i] = (i < head->tcount && terms[i] != bt->self
+            && bus_addr_type(terms[i]) == type
+            && lives[i].state == BUS_TERM_ALIVE);
+        atom_set(&bc->cursors[i], 0);
+    }
+    pipe_t* bp = _bus_pipe_create(&bc->pipe, 0);
+    if (!bp) {
+        bc->pipe.dead = 1;
+        goto BCAST_CREATE_FAIL;
+    }
+    bp->bcast = bc;
+    int ret = idtable_add(bt->bopipes, type, bp);
+    assert(0 == ret);
+    if (slot == head->bcount) {
+        ++ bt->head->bcount;
+        ++ bt->bscan;
+    } else {
+        atom_inc(&bt->head->pgen);
+    }
+
+    // version set. unlock
+    atom_inc(&bt->head->pver);
+    bt->pver = bt->head->pver;
+    plock_unlock(bt->lock);
+    return bp;
+
+BCAST_CREATE_FAIL:
+    plock_unlock(bt->lock);
+    return NULL;
+}
+
+// doorbell address of terminal
+static socklen_t
+_bus_bell_addr(bus_t* bt, bus_addr_t addr, struct sockaddr_un* un) {
+    memset(un, 0, sizeof(*un));
+    un->sun_family = AF_UNIX;
+#if defined(OS_LINUX)
+    // abstract namespace, leaves nothing in file system
+    int len = snprintf(un->sun_path + 1, sizeof(un->sun_path) - 1,
+        "gbase.bus.%x.%d", bt->head->key, addr);
+    return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + len);
+#else
+    snprintf(un->sun_path, sizeof(un->sun_path), "/tmp/gbase.bus.%x.%d",
+        bt->head->key, addr);
+    return (socklen_t)sizeof(*un);
+#endif
+}
+
+// wake up the receiver if it's sleeping, otherwise no syscall
+static void
+_bus_ring(bus_t* bt, bell_t* bell, bus_addr_t to) {
+    if (!bell || bell->waiting == BUS_BELL_NONE)
+        return;
+    atom_t mode = atom_set(&bell->waiting, BUS_BELL_NONE);
+    if (mode == BUS_BELL_FUTEX) {
+        atom_inc(&bell->seq);
+#if defined(OS_LINUX)
+        syscall(SYS_futex, &bell->seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+    } else if (mode == BUS_BELL_FD) {
+        // multi-producer threads may ring at the same time
+        if (bt->wfd == INVALID_SOCK) {
+            sock_t fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+            sock_set_nonblock(fd);
+            if (!__sync_bool_compare_and_swap(&bt->wfd, INVALID_SOCK, fd))
+                close(fd);
+        }
+        struct sockaddr_un un;
+        socklen_t len = _bus_bell_addr(bt, to, &un);
+        char c = 0;
+        sendto(bt->wfd, &c, sizeof(c), 0, (sockaddr_t*)&un, len);
+    }
+}
+
+// write pos is published by a release store, the fence keeps loads of
+// waiting behind it, pairing with the one in _bus_bell_arm
+static void
+_bus_pipe_ring(bus_t* bt, pipe_t* bp) {
+    __sync_synchronize();
+    if (bp->bcast) {
+        bus_head* head = bt->head;
+        int8_t* subs = _bus_bcast_subs(head, bp->bcast);
+        for (int i = 0; i < head->tcount; ++ i) {
+            if (subs[i])
+                _bus_ring(bt, &_bus_bells(head)[i], _bus_terms(head)[i]);
+        }
+    } else {
+        _bus_ring(bt, bp->bell, _head_t(bp)->to);
+    }
+}
+
+// set waiting flag, and make sure writers could see it
+static void
+_bus_bell_arm(bus_t* bt, atom_t mode) {
+    atom_set(&bt->bell->waiting, mode);
+    __sync_synchronize();
+}
+
+// any message in input pipes, or new pipes created
+static int
+_bus_recv_ready(bus_t* bt) {
+    if (bt->head->pver != bt->pver)
+        return 1;
+    for (int i = 0; i < bt->icount; ++ i) {
+        if (_bus_pipe_read_bytes(bt->ilist[i]) > 0)
+            return 1;
+    }
+    return 0;
+}
+
 int
-bus_send(bus_t* bt, const char* buf, size_t bufsz, bus_addr_t to) {
+bus_wait(bus_t* bt, int ms) {
     if (!bt)
         return BUS_ERR_FAIL;
+    if (_bus_recv_ready(bt))
+        return BUS_OK;
+#if defined(OS_LINUX)
+    atom_t seq = bt->bell->seq;
+    _bus_bell_arm(bt, BUS_BELL_FUTEX);
+    // check again, messages may arrive before armed
+    if (!_bus_recv_ready(bt)) {
+        struct timespec ts;
+        ts.tv_sec = ms / 1000;
+        ts.tv_nsec = (ms % 1000) * 1000000;
+        syscall(SYS_futex, &bt->bell->seq, FUTEX_WAIT, seq,
+            ms < 0 ? NULL : &ts, NULL, 0);
+    }
+    atom_set(&bt->bell->waiting, BUS_BELL_NONE);
+#else
+    // no futex, poll by fd
+    bus_fd(bt);
+    _bus_bell_arm(bt, BUS_BELL_FD);
+    if (!_bus_recv_ready(bt)) {
+        struct pollfd pfd;
+        pfd.fd = bt->rfd;
+        pfd.events = POLLIN;
+        poll(&pfd, 1, ms);
+    }
+#endif
+    return _bus_recv_ready(bt) ? BUS_OK : BUS_ERR_EMPTY;
+}
+
+int
+bus_fd(bus_t* bt) {
+    if (!bt)
+        return INVALID_SOCK;
+    if (bt->rfd != INVALID_SOCK)
+        return bt->rfd;
+    sock_t fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd == INVALID_SOCK)
+        return INVALID_SOCK;
+    struct sockaddr_un un;
+    socklen_t len = _bus_bell_addr(bt, bt->self, &un);
+#if !defined(OS_LINUX)
+    unlink(un.sun_path);
+#endif
+    if (bind(fd, (sockaddr_t*)&un, len) < 0 || sock_set_nonblock(fd) < 0) {
+        sock_close(fd);
+        return INVALID_SOCK;
+    }
+    bt->rfd = fd;
+    return fd;
+}
+
+// drain doorbell fd & arm it, before sleep in reactor
+static void
+_bus_fd_arm(bus_t* bt) {
+    char buf[64];
+    while (recv(bt->rfd, buf, sizeof(buf), 0) > 0);
+    _bus_bell_arm(bt, BUS_BELL_FD);
+}
+
+int
+bus_set_spill(bus_t* bt, size_t size, size_t high, size_t low,
+              bus_spill_func cb, void* arg) {
+    if (!bt || size > BUS_PIPE_MAX_SIZE || (size > 0 && (low > high || high > size)))
+        return BUS_ERR_FAIL;
+    bt->spill_size = size;
+    bt->spill_hwm = high;
+    bt->spill_lwm = low;
+    bt->spill_cb = cb;
+    bt->spill_arg = arg;
+    return BUS_OK;
+}
+
+static void
+_bus_spill_mark(bus_t* bt, pipe_t* bp) {
+    if (!bp->spill_high && bp->spill_bytes > 0 && bp->spill_bytes >= bt->spill_hwm) {
+        bp->spill_high = 1;
+        if (bt->spill_cb)
+            bt->spill_cb(bt, bp->head->to, 1, bt->spill_arg);
+    } else if (bp->spill_high && bp->spill_bytes <= bt->spill_lwm) {
+        bp->spill_high = 0;
+        if (bt->spill_cb)
+            bt->spill_cb(bt, bp->head->to, 0, bt->spill_arg);
+    }
+}
+
+static inline int
+_bus_spill_pending(pipe_t* bp, int lane) {
+    return bp->spills[lane] && rbuffer_read_bytes(bp->spills[lane]) > 0;
+}
+
+// queue locally, with enqueue stamp kept
+static int
+_bus_spill(bus_t* bt, pipe_t* bp, int lane, const char* buf, size_t bufsz) {
+    uint32_t rsize = rbuffer_record_size(bufsz);
+    if (bp->spill_bytes + rsize > bt->spill_size)
+        return -1;
+    if (!bp->spills[lane]) {
+        // lanes in total take no more than spill size
+        size_t size = bt->spill_size / bp->nlanes;
+        if (size < rsize)
+            return -1;
+        bp->spills[lane] = rbuffer_create(ROUNDDOWN(size));
+        if (!bp->spills[lane])
+            return -1;
+    }
+    if (rbuffer_write_stamp(bp->spills[lane], buf, bufsz, bt->stamp ? _bus_stamp() : 0) != 0)
+        return -1;
+    bp->spill_bytes += rsize;
+    ++ bp->head->send.spill_msgs;
+    bt->spilling = 1;
+    _bus_spill_mark(bt, bp);
+    return 0;
+}
+
+// move spilled messages into pipe, higher lanes first
+// return 0 if all flushed
+static int
+_bus_spill_flush(bus_t* bt, pipe_t* bp) {
+    int flushed = 0;
+    for (int i = bp->nlanes - 1; i >= 0; -- i) {
+        rbuffer_t* r = bp->spills[i];
+        const char* data;
+        size_t len;
+        while (r && (data = rbuffer_peek_ptr(r, &len)) != NULL) {
+            if (rbuffer_write_stamp(bp->lanes[i], data, len, rbuffer_stamp(data)) != 0)
+                break;
+            _bus_stat_send(bp, len);
+            bp->spill_bytes -= rbuffer_record_size(len);
+            rbuffer_consume(r);
+            ++ flushed;
+        }
+    }
+    if (flushed > 0) {
+        _bus_pipe_ring(bt, bp);
+        _bus_spill_mark(bt, bp);
+    }
+    return bp->spill_bytes > 0 ? -1 : 0;
+}
+
+static int
+_bus_spill_loop(void* data, void* arg) {
+    pipe_t* bp = (pipe_t*)data;
+    bus_t* bt = (bus_t*)arg;
+    if (bp->spill_bytes > 0 && !_bus_pipe_dead(bp) && _bus_spill_flush(bt, bp) != 0)
+        bt->spilling = 1;
+    return 0;
+}
+
+static void
+_bus_spill_poll(bus_t* bt) {
+    bt->spilling = 0;
+    idtable_loop(bt->opipes, _bus_spill_loop, bt, 0);
+}
+
+static pipe_t*
+_bus_opipe(bus_t* bt, bus_addr_t to) {
     pipe_t* bp = (pipe_t*)idtable_get(bt->opipes, to);
+    // reclaimed, peer may restart
+    if (bp && _bus_pipe_dead(bp)) {
+        bus_poll(bt);
+        bp = (pipe_t*)idtable_get(bt->opipes, to);
+    }
     if (!bp) {
-        bp = _bus_register_pipe(bt, to, BUS_PIPE_DEFAULT_SIZE);
-        if (!bp)
-            return BUS_ERR_PIPE_FAIL;
+        bp = _bus_register_pipe(bt, to, _bus_pipe_size(bt, 0, to),
+            _bus_pipe_mpsc(bt, to), _bus_pipe_lanes(bt, to));
     }
-    int ret = rbuffer_write(_bus_pipe_rbuffer(bp), buf, bufsz);
-    return ret == 0 ? BUS_OK : BUS_ERR_SEND_FAIL;
+    return bp;
+}
+
+static int
+_bus_opipe_fail(bus_t* bt, bus_addr_t to) {
+    life_t* life = _bus_life(bt->head, to);
+    if (life && life->state == BUS_TERM_DEAD)
+        return BUS_ERR_PEER_DEAD;
+    return BUS_ERR_PIPE_FAIL;
+}
+
+// fail fast if peer is known dead, check it when pipe is full
+static int
+_bus_opipe_full(bus_t* bt, pipe_t* bp, int err) {
+    _bus_stat_fail(bp);
+    return _bus_peer_dead(bt, bp->life, 0) ? BUS_ERR_PEER_DEAD : err;
 }
 
 int
-bus_send_by_type(bus_t* bt, const char* buf, size_t bufsz, int type) {
+bus_send(bus_t* bt, const char* buf, size_t bufsz, bus_addr_t to) {
+    return bus_send_prio(bt, buf, bufsz, to, 0);
+}
+
+int
+bus_send_prio(bus_t* bt, const char* buf, size_t bufsz, bus_addr_t to, int prio) {
+    if (!bt || prio < 0)
+        return BUS_ERR_FAIL;
+    pipe_t* bp = _bus_opipe(bt, to);
+    if (!bp)
+        return _bus_opipe_fail(bt, to);
+    if (bp->life->state == BUS_TERM_DEAD)
+        return BUS_ERR_PEER_DEAD;
+    // keep order behind spilled messages
+    int lane = _bus_pipe_lane(bp, prio);
     int ret = -1;
-    for (int i = 0; i < bt->tcount; ++ i) {
-        if (bt->terms[i] != bt->self && bus_addr_type(bt->terms[i]) == type) {
-            ret = bus_send(bt, buf, bufsz, bt->terms[i]);
-            if (ret)
-                return ret;
+    if (!_bus_spill_pending(bp, lane) || _bus_spill_flush(bt, bp) == 0
+        || !_bus_spill_pending(bp, lane)) {
+        ret = _bus_pipe_write(bt, bp, lane, buf, bufsz);
+    }
+    if (ret != 0) {
+        if (bt->spill_size == 0 || bp->head->mpsc)
+            return _bus_opipe_full(bt, bp, BUS_ERR_SEND_FAIL);
+        // peer checked before spilling, not again when spill fails
+        if (_bus_peer_dead(bt, bp->life, 0)) {
+            _bus_stat_fail(bp);
+            return BUS_ERR_PEER_DEAD;
         }
+        if (_bus_spill(bt, bp, lane, buf, bufsz) != 0) {
+            ++ bp->head->send.spill_drops;
+            _bus_stat_fail(bp);
+            return BUS_ERR_SEND_FAIL;
+        }
+        return BUS_OK;
     }
-    return ret ? BUS_ERR_PEER_NOT_FOUND : BUS_OK;
+    _bus_pipe_ring(bt, bp);
+    return BUS_OK;
 }
 
 int
-bus_send_all(bus_t* bt, const char* buf, size_t bufsz) {
-    for (int i = 0; i < bt->tcount; ++ i) {
-        if (bt->terms[i] != bt->self) {
-            int ret = bus_send(bt, buf, bufsz, bt->terms[i]);
-            if (ret)
-                return ret;
+bus_send_reserve(bus_t* bt, char** buf, size_t bufsz, bus_addr_t to) {
+    if (!bt || !buf)
+        return BUS_ERR_FAIL;
+    pipe_t* bp = _bus_opipe(bt, to);
+    if (!bp)
+        return _bus_opipe_fail(bt, to);
+    if (bp->life->state == BUS_TERM_DEAD)
+        return BUS_ERR_PEER_DEAD;
+    // commit by size can't find the record among multi writers
+    if (_head_t(bp)->mpsc)
+        return BUS_ERR_FAIL;
+    // keep order behind spilled messages
+    if (_bus_spill_pending(bp, 0) && _bus_spill_flush(bt, bp) != 0
+        && _bus_spill_pending(bp, 0))
+        return _bus_opipe_full(bt, bp, BUS_ERR_PIPE_FULL);
+    *buf = rbuffer_reserve(_bus_pipe_rbuffer(bp), bufsz);
+    if (!*buf)
+        return _bus_opipe_full(bt, bp, BUS_ERR_PIPE_FULL);
+    return BUS_OK;
+}
+
+int
+bus_send_commit(bus_t* bt, size_t bufsz, bus_addr_t to) {
+    if (!bt)
+        return BUS_ERR_FAIL;
+    pipe_t* bp = (pipe_t*)idtable_get(bt->opipes, to);
+    if (!bp)
+        return BUS_ERR_PEER_NOT_FOUND;
+    int ret = rbuffer_commit_stamp(_bus_pipe_rbuffer(bp), bufsz,
+        bt->stamp ? _bus_stamp() : 0);
+    if (ret != 0)
+        return BUS_ERR_SEND_FAIL;
+    _bus_stat_send(bp, bufsz);
+    _bus_pipe_ring(bt, bp);
+    return BUS_OK;
+}
+
+// move read position to the slowest alive subscriber
+// return the slowest subscriber index, -1 if none
+static int
+_bus_bcast_sync(bus_t* bt, pipe_t* bp) {
+    bcast_t* bc = bp->bcast;
+    int8_t* subs = _bus_bcast_subs(bt->head, bc);
+    life_t* lives = _bus_lives(bt->head);
+    uint32_t wpos = rbuffer_write_pos(bp->r);
+    uint32_t slowest = wpos;
+    int index = -1;
+    for (int i = 0; i < bt->head->tcount; ++ i) {
+        if (subs[i] && lives[i].state != BUS_TERM_DEAD) {
+            uint32_t cursor = atom_load_acquire(&bc->cursors[i]);
+            if (wpos - cursor > wpos - slowest) {
+                slowest = cursor;
+                index = i;
+            }
         }
     }
+    rbuffer_cursor_sync(bp->r, slowest);
+    return index;
+}
+
+static int
+_bus_has_type(bus_t* bt, int type) {
+    for (int i = 0; i < bt->tycount; ++ i) {
+        if (bt->types[i] == type)
+            return 1;
+    }
+    return 0;
+}
+
+int
+bus_send_by_type(bus_t* bt, const char* buf, size_t bufsz, int type) {
+    if (!bt)
+        return BUS_ERR_FAIL;
+    pipe_t* bp = (pipe_t*)idtable_get(bt->bopipes, type);
+    if (!bp) {
+        if (!_bus_has_type(bt, type))
+            return BUS_ERR_PEER_NOT_FOUND;
+        bp = _bus_register_bcast(bt, type, _bus_pipe_size(bt, 1, type));
+        if (!bp)
+            return BUS_ERR_PIPE_FAIL;
+    }
+    // write once for all subscribers
+    // when full, skip the slowest ones if they are dead
+    while (_bus_pipe_write(bt, bp, 0, buf, bufsz) != 0) {
+        int index = _bus_bcast_sync(bt, bp);
+        if (_bus_pipe_write(bt, bp, 0, buf, bufsz) == 0)
+            break;
+        if (index < 0 || !_bus_peer_dead(bt, &_bus_lives(bt->head)[index], 0)) {
+            _bus_stat_fail(bp);
+            return BUS_ERR_SEND_FAIL;
+        }
+    }
+    _bus_pipe_ring(bt, bp);
+    return BUS_OK;
+}
+
+int
+bus_send_all(bus_t* bt, const char* buf, size_t bufsz) {
+    if (!bt)
+        return BUS_ERR_FAIL;
+    // broadcast by each terminal type
+    for (int i = 0; i < bt->tycount; ++ i) {
+        int ret = bus_send_by_type(bt, buf, bufsz, bt->types[i]);
+        if (ret)
+            return ret;
+    }
     return BUS_OK;
 }
 
@@ -340,41 +1839,133 @@ bus_recv(bus_t* bt, char* buf, size_t* bufsz, bus_addr_t from) {
     pipe_t* bp = (pipe_t*)idtable_get(bt->ipipes, from);
     if (!bp)
         return BUS_ERR_PEER_NOT_FOUND;
-    int ret = rbuffer_read(_bus_pipe_rbuffer(bp), buf, bufsz);
-    return ret == 0 ? BUS_ERR_EMPTY : BUS_OK;
+    int ret = _bus_pipe_read(bp, buf, bufsz);
+    if (ret == BUS_ERR_OVERSIZE)
+        return ret;
+    return ret == 0 ? BUS_OK : BUS_ERR_EMPTY;
+}
+
+int
+bus_recv_peek(bus_t* bt, const char** buf, size_t* bufsz, bus_addr_t from) {
+    if (!bt || !buf || !bufsz)
+        return BUS_ERR_FAIL;
+    pipe_t* bp = (pipe_t*)idtable_get(bt->ipipes, from);
+    if (!bp)
+        return BUS_ERR_PEER_NOT_FOUND;
+    *buf = _bus_pipe_peek(bp, bufsz);
+    return *buf ? BUS_OK : BUS_ERR_EMPTY;
 }
 
-typedef struct bus_loop_param_t {
-    size_t* size;
-    char* buf;
-    bus_addr_t* from;
-} loop_t;
+int
+bus_recv_consume(bus_t* bt, bus_addr_t from) {
+    if (!bt)
+        return BUS_ERR_FAIL;
+    pipe_t* bp = (pipe_t*)idtable_get(bt->ipipes, from);
+    if (!bp)
+        return BUS_ERR_PEER_NOT_FOUND;
+    int ret = _bus_pipe_consume(bp);
+    return ret == 0 ? BUS_OK : BUS_ERR_EMPTY;
+}
 
+// higher lanes of all pipes go first, then round-robin as usual
 static int
-_bus_recv_loop(void* data, void* arg) {
-    pipe_t* bp = (pipe_t*)data;
-    head_t* head = _head_t(bp);
-    loop_t* param = (loop_t*)arg;
-    int ret = rbuffer_read(_bus_pipe_rbuffer(bp), param->buf, param->size);
-    if (ret == 0) {
-        *(param->from) = head->from;
-        return 1;
+_bus_recv_prio(bus_t* bt, bus_msg_t* msgs, int max, int* oversize) {
+    int n = 0;
+    for (int lane = bt->ilanes - 1; lane > 0 && n < max; -- lane) {
+        int idle = 0;
+        while (n < max && idle < bt->icount) {
+            pipe_t* bp = bt->ilist[bt->icursor];
+            bt->icursor = (bt->icursor + 1) % bt->icount;
+            bus_msg_t* msg = &msgs[n];
+            int ret = _bus_pipe_read_lane(bp, lane, msg->buf, &msg->bufsz);
+            if (ret == 0) {
+                msg->from = _head_t(bp)->from;
+                idle = 0;
+                ++ n;
+            } else {
+                *oversize |= (ret == BUS_ERR_OVERSIZE);
+                ++ idle;
+            }
+        }
+    }
+    return n;
+}
+
+static int
+_bus_recv_round(bus_t* bt, bus_msg_t* msgs, int max, int* oversize) {
+    // one message per pipe each round, until all pipes are empty
+    int n = bt->ilanes > 1 ? _bus_recv_prio(bt, msgs, max, oversize) : 0;
+    int idle = 0;
+    while (n < max && idle < bt->icount) {
+        pipe_t* bp = bt->ilist[bt->icursor];
+        bt->icursor = (bt->icursor + 1) % bt->icount;
+        bus_msg_t* msg = &msgs[n];
+        int ret = _bus_pipe_read(bp, msg->buf, &msg->bufsz);
+        if (ret == 0) {
+            msg->from = _head_t(bp)->from;
+            idle = 0;
+            ++ n;
+        } else {
+            *oversize |= (ret == BUS_ERR_OVERSIZE);
+            ++ idle;
+        }
+    }
+    return n;
+}
+
+int
+bus_recv_batch(bus_t* bt, bus_msg_t* msgs, int max) {
+    if (!bt || !msgs || max <= 0)
+        return BUS_ERR_FAIL;
+    int oversize = 0;
+    int n = _bus_recv_round(bt, msgs, max, &oversize);
+    // drained under fd mode, arm doorbell and check again
+    if (n < max && bt->rfd != INVALID_SOCK
+        && bt->bell->waiting != BUS_BELL_FD) {
+        _bus_fd_arm(bt);
+        n += _bus_recv_round(bt, msgs + n, max - n, &oversize);
+    }
+    return (n == 0 && oversize) ? BUS_ERR_OVERSIZE : n;
+}
+
+int
+bus_recv_oversize(bus_t* bt, size_t max, bus_msg_t* msg) {
+    if (!bt || !msg || (msg->bufsz > 0 && !msg->buf))
+        return BUS_ERR_FAIL;
+    for (int i = 0; i < bt->icount; ++ i) {
+        pipe_t* bp = bt->ilist[i];
+        int lanes = bp->cursor ? 1 : bp->nlanes;
+        for (int lane = 0; lane < lanes; ++ lane) {
+            size_t len;
+            const char* data = bp->cursor ? _bus_pipe_peek(bp, &len)
+                : rbuffer_peek_ptr(bp->lanes[lane], &len);
+            if (!data || len <= max)
+                continue;
+            if (msg->bufsz > 0)
+                memcpy(msg->buf, data, len < msg->bufsz ? len : msg->bufsz);
+            msg->bufsz = len;
+            msg->from = _head_t(bp)->from;
+            bp->lane = lane;
+            _bus_pipe_consume(bp);
+            return 1;
+        }
     }
     return 0;
 }
 
-// TODO: not thread safe, as with static index
 int
 bus_recv_all(bus_t* bt, char* buf, size_t* bufsz, bus_addr_t* from) {
     if (!bt || !buf || !bufsz || !from)
         return BUS_ERR_FAIL;
-    loop_t param;
-    param.size = bufsz;
-    param.buf = buf;
-    param.from = from;
-    static int index = 0;
-    int ret = idtable_loop(bt->ipipes, _bus_recv_loop, &param, index ++);
-    return ret == 0 ? BUS_ERR_EMPTY : BUS_OK;
+    bus_msg_t msg;
+    msg.buf = buf;
+    msg.bufsz = *bufsz;
+    int ret = bus_recv_batch(bt, &msg, 1);
+    if (ret != 1)
+        return ret == BUS_ERR_OVERSIZE ? ret : BUS_ERR_EMPTY;
+    *bufsz = msg.bufsz;
+    *from = msg.from;
+    return BUS_OK;
 }
 
 typedef struct bus_dump_param_t {
@@ -390,8 +1981,13 @@ _bus_dump_loop(void* data, void* arg) {
     dump_t* param = (dump_t*)arg;
     size_t len = strnlen(param->debug, param->sz);
     snprintf(param->debug + len, param->sz - len,
-        "%d->%d: size=%d, read bytes %u, write bytes %d\n", head->from,
-        head->to, (int)head->size, rbuffer_read_bytes(r), rbuffer_write_bytes(r));
+        "%d->%s%d: size=%d, read bytes %u, write bytes %d, "
+        "send %"PRIu64", recv %"PRIu64", fail %"PRIu64", peak %u\n", head->from,
+        bp->bcast ? "type " : "", head->to, (int)head->size,
+        _bus_pipe_read_bytes(bp), rbuffer_write_bytes(r),
+        head->send.send_msgs, head->recv.recv_msgs, head->send.send_fails,
+        head->recv.peak_bytes > head->send.peak_bytes
+            ? head->recv.peak_bytes : head->send.peak_bytes);
     return 0;
 }
 
@@ -410,6 +2006,50 @@ bus_dump(bus_t* bt, char* debug, size_t debugsz) {
     param.sz = debugsz;
     idtable_loop(bt->ipipes, _bus_dump_loop, &param, 0);
     idtable_loop(bt->opipes, _bus_dump_loop, &param, 0);
+    idtable_loop(bt->bipipes, _bus_dump_loop, &param, 0);
+    idtable_loop(bt->bopipes, _bus_dump_loop, &param, 0);
+}
+
+void
+bus_set_stamp(bus_t* bt, int enable) {
+    if (bt)
+        bt->stamp = enable;
+}
+
+static void
+_bus_stat_assign(bus_pipe_stat_t* stat, head_t* head, int bcast) {
+    stat->from = head->from;
+    stat->to = head->to;
+    stat->bcast = bcast;
+    stat->size = head->size;
+    bus_stat_t* st = &stat->stat;
+    st->send_msgs = head->send.send_msgs;
+    st->send_bytes = head->send.send_bytes;
+    st->send_fails = head->send.send_fails;
+    st->spill_msgs = head->send.spill_msgs;
+    st->spill_drops = head->send.spill_drops;
+    st->recv_msgs = head->recv.recv_msgs;
+    st->recv_bytes = head->recv.recv_bytes;
+    st->peak_bytes = bcast ? head->send.peak_bytes : head->recv.peak_bytes;
+    memcpy(st->latency, head->recv.latency, sizeof(st->latency));
+}
+
+int
+bus_stat(bus_t* bt, bus_pipe_stat_t* stats, int max) {
+    if (!bt || !stats || max < 0)
+        return BUS_ERR_FAIL;
+    int n = 0;
+    for (int i = 0; i < bt->head->pcount && n < max; ++ i) {
+        head_t* head = _bus_pipe_at(bt->head, i);
+        if (!head->dead)
+            _bus_stat_assign(&stats[n ++], head, 0);
+    }
+    for (int i = 0; i < bt->head->bcount && n < max; ++ i) {
+        head_t* head = &_bus_bcast_at(bt->head, i)->pipe;
+        if (!head->dead)
+            _bus_stat_assign(&stats[n ++], head, 1);
+    }
+    return n;
 }
 
 uint32_t
@@ -423,6 +2063,6 @@ uint32_t
 bus_recv_bytes(bus_t* bt, bus_addr_t from) {
     assert(bt);
     pipe_t* bp = (pipe_t*)idtable_get(bt->ipipes, from);
-    return bp ? rbuffer_read_bytes(_bus_pipe_rbuffer(bp)) : 0;
+    return bp ? _bus_pipe_read_bytes(bp) : 0;
 }
 
@@ -7,10 +7,21 @@ extern "C" {
 
 #include "core/os_def.h"
 
-#define BUS_MAX_PIPE_COUNT 1024
-#define BUS_MAX_TERMINAL_COUNT 64
+// default capacity of bus, decided by the terminal creating it
+#define BUS_DEFAULT_TERMINAL_COUNT 256
+#define BUS_DEFAULT_PIPE_COUNT 4096
+#define BUS_DEFAULT_BCAST_COUNT 128
+#define BUS_MAX_TERMINAL_COUNT 65536
 
 #define BUS_PIPE_DEFAULT_SIZE 102400
+#define BUS_PIPE_MAX_SIZE (1 << 30)
+// pipes not less than it are backed by huge pages if possible
+#define BUS_PIPE_HUGE_SIZE (2 * 1024 * 1024)
+#define BUS_MAX_PIPE_CONF 64
+// priority lanes of a pipe
+#define BUS_MAX_LANES 4
+
+#define BUS_STAT_LATENCY_BUCKETS 20
 
 typedef int bus_addr_t;
 
@@ -19,6 +30,43 @@ typedef int bus_addr_t;
 
 typedef struct bus_t bus_t;
 
+// spilled bytes of the pipe reach high watermark (high = 1), or fall back to low (high = 0)
+typedef void (*bus_spill_func)(bus_t*, bus_addr_t to, int high, void* arg);
+
+typedef struct bus_msg_t {
+    bus_addr_t from;
+    // receiving buffer, set by caller
+    char* buf;
+    // in: buffer size, out: message size
+    size_t bufsz;
+} bus_msg_t;
+
+// pipe statistics, stored in bus shm
+typedef struct bus_stat_t {
+    uint64_t send_msgs;
+    uint64_t send_bytes;
+    uint64_t send_fails;
+    uint64_t recv_msgs;
+    uint64_t recv_bytes;
+    // peak occupancy bytes, sampled by receiver (sender if broadcast)
+    uint32_t peak_bytes;
+    // messages queued locally as pipe is full, and dropped as queue is full too
+    uint64_t spill_msgs;
+    uint64_t spill_drops;
+    // enqueue to dequeue latency of stamped messages
+    // latency[i] counts [2^(i-1), 2^i) us, the last one counts all above
+    uint64_t latency[BUS_STAT_LATENCY_BUCKETS];
+} bus_stat_t;
+
+typedef struct bus_pipe_stat_t {
+    bus_addr_t from;
+    // terminal address, or terminal type if broadcast
+    bus_addr_t to;
+    int bcast;
+    size_t size;
+    bus_stat_t stat;
+} bus_pipe_stat_t;
+
 enum {
     BUS_ERR_PEER_NOT_FOUND = -100,
     BUS_ERR_SEND_FAIL,
@@ -29,29 +77,126 @@ enum {
     BUS_ERR_PIPE_FAIL,
     BUS_ERR_EMPTY,
     BUS_ERR_FAIL,
+    BUS_ERR_PEER_DEAD,
+    BUS_ERR_OVERSIZE,
     BUS_OK = 0,
 };
 
 // key: 16 bits, reserved 16 bits for channels
 // distinct address is ensured by user
 bus_t* bus_create(int16_t key, bus_addr_t addr);
+// capacity takes effect only if the bus is created by this call, <= 0 means default
+bus_t* bus_create_sized(int16_t key, bus_addr_t addr, int max_terms,
+                        int max_pipes, int max_bcasts);
 void bus_release(bus_t*);
 
-// check bus version and do update
+// check bus version and do update, stamp heartbeat
 // we should check in every tick
 void bus_poll(bus_t*);
 
+// a terminal is dead if its process exits, or heartbeat timeout (if set)
+// sending to a dead peer fails fast by BUS_ERR_PEER_DEAD until it restarts
+// failed sends probe the peer process at most once a second
+void bus_set_timeout(bus_t*, int seconds);
+
+// unlink pipes from & to dead terminals and free their shm
+// return pipes reclaimed
+int bus_reclaim(bus_t*);
+
 int bus_send(bus_t*, const char* buf, size_t bufsz, bus_addr_t to);
+
+// send by priority lane, 0 is the lane of bus_send, higher lanes are received first
+// priority is clamped by lanes of the pipe, see bus_set_pipe_lanes
+int bus_send_prio(bus_t*, const char* buf, size_t bufsz, bus_addr_t to, int prio);
+
+// broadcast by a shared pipe per (sender, type), written once for all subscribers
+// terminals subscribe since they poll the pipe, and receive it by bus_recv_all/batch
+// order is not kept between broadcast and bus_send messages
 int bus_send_by_type(bus_t*, const char* buf, size_t bufsz, int type);
 int bus_send_all(bus_t*, const char* buf, size_t bufsz);
 int bus_recv(bus_t*, char* buf, size_t* bufsz, bus_addr_t from);
 int bus_recv_all(bus_t*, char* buf, size_t* bufsz, bus_addr_t* from);
 
+// drain at most max messages from all input pipes, fair round-robin
+// return >= 0, received message count
+// return BUS_ERR_OVERSIZE, none received but a pipe is blocked by a larger message
+// return < 0, fail
+int bus_recv_batch(bus_t*, bus_msg_t* msgs, int max);
+
+// a message larger than receiving buffer stays at the head of its pipe,
+// on BUS_ERR_OVERSIZE, take out the first one larger than max from input pipes,
+// so the pipe goes on:
+// at most msg->bufsz bytes are copied (0 to drop), and msg->bufsz is set to its size
+// return 1 if taken out, 0 if none
+int bus_recv_oversize(bus_t*, size_t max, bus_msg_t* msg);
+
+// zero-copy sending: reserve space in pipe, serialize message in place, then commit
+// commit size should be no more than reserved size
+int bus_send_reserve(bus_t*, char** buf, size_t bufsz, bus_addr_t to);
+int bus_send_commit(bus_t*, size_t bufsz, bus_addr_t to);
+
+// zero-copy receiving: parse message in pipe in place, then consume it
+int bus_recv_peek(bus_t*, const char** buf, size_t* bufsz, bus_addr_t from);
+int bus_recv_consume(bus_t*, bus_addr_t from);
+
+// doorbell, so receiver could sleep instead of polling
+// writers make the wake-up syscall only when receiver is sleeping
+//
+// wait until messages arrive (or new pipes created, bus_poll needed)
+// ms < 0 means wait infinitely
+// return BUS_OK if messages arrive, BUS_ERR_EMPTY if timeout
+int bus_wait(bus_t*, int ms);
+
+// doorbell fd, could be registered into reactor with EVENT_IN
+// it's armed when bus_recv_batch (or bus_recv_all) drains all pipes,
+// so keep receiving until empty on readable, before sleep in reactor
+int bus_fd(bus_t*);
+
 uint32_t bus_send_bytes(bus_t*, bus_addr_t to);
 uint32_t bus_recv_bytes(bus_t*, bus_addr_t from);
 
 void bus_dump(bus_t*, char* debug, size_t debugsz);
 
+// size of pipes sent to the address or terminal type, round up by 2^n
+// by address goes before by type, type also works for broadcast pipes
+// only pipes created after config take effect
+int bus_set_pipe_size(bus_t*, bus_addr_t to, size_t size);
+int bus_set_pipe_size_by_type(bus_t*, int type, size_t size);
+
+// pipes sent to the address or terminal type are multi-producer,
+// so threads of the sender could bus_send to it concurrently without lock:
+//  the pipe should be created first by one thread (e.g. the first bus_send)
+//  bus_poll could run meanwhile, but not bus_reclaim (or peers reclaimed),
+//  as pipes reclaimed are released in bus_poll
+//  zero-copy sending is not supported, bus_send_reserve fails
+// only pipes created after config take effect
+int bus_set_pipe_mpsc(bus_t*, bus_addr_t to);
+int bus_set_pipe_mpsc_by_type(bus_t*, int type);
+
+// pipes sent to the address or terminal type have lanes (<= BUS_MAX_LANES) rings,
+// each one has the pipe size and all share the receiver's doorbell
+// receiving drains higher lanes of all pipes first, so control messages
+// don't wait behind bulk ones. broadcast and zero-copy sending use lane 0
+// only pipes created after config take effect
+int bus_set_pipe_lanes(bus_t*, bus_addr_t to, int lanes);
+int bus_set_pipe_lanes_by_type(bus_t*, int type, int lanes);
+
+// when a pipe is full, bus_send queues messages locally instead of failing,
+// and they are flushed in order by bus_poll or later sendings
+// at most size bytes per pipe, split evenly by its lanes, a message takes
+// its size and an 8 bytes head (aligned by 8), watermarks count the same bytes
+// func is called on watermarks crossed, so producers could throttle
+// size 0 means disabled (by default), not for multi-producer pipes
+int bus_set_spill(bus_t*, size_t size, size_t high, size_t low,
+                  bus_spill_func func, void* arg);
+
+// stamp enqueue time into messages, so receivers could record latency
+void bus_set_stamp(bus_t*, int enable);
+
+// snapshot statistics of all pipes in bus, not only the terminal's
+// return pipe count, at most max
+int bus_stat(bus_t*, bus_pipe_stat_t* stats, int max);
+
 #ifdef __cpluplus
 }
 #endif
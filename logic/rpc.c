@@ -0,0 +1,375 @@
+#include <assert.h>
+#include "rpc.h"
+
+#define RPC_MAGIC 0x52504300
+#define RPC_MAGIC_MASK 0xffffff00
+#define RPC_REQUEST 1
+#define RPC_RESPONSE 2
+
+typedef struct rpc_head_t {
+    // magic | type
+    uint32_t flag;
+    // correlation id
+    uint32_t id;
+} rpc_head_t;
+
+// pending call slot, id = generation << shift | slot
+typedef struct rpc_call_t {
+    // 0 means free
+    uint32_t id;
+    uint32_t gen;
+    bus_addr_t to;
+    int timer_id;
+    rpc_callback cb;
+    void* arg;
+    rpc_t* rpc;
+    // free list
+    int next;
+} call_t;
+
+struct rpc_t {
+    bus_t* bus;
+    timerheap_t* timer;
+    // slots count 2^n
+    int max;
+    int shift;
+    int count;
+    int free;
+    call_t* calls;
+    rpc_handler handler;
+    void* handler_arg;
+    int max_msg;
+    char* rbuf;
+    char* sbuf;
+    // received but not dispatched
+    uint64_t rejects;
+};
+
+rpc_t*
+rpc_create(bus_t* bus, timerheap_t* timer, int max_pending, int max_msg) {
+    if (!bus)
+        return NULL;
+    if (max_pending <= 0)
+        max_pending = RPC_DEFAULT_PENDING;
+    if (max_pending & (max_pending - 1))
+        max_pending = ROUNDUP(max_pending);
+    if (max_msg <= 0)
+        max_msg = RPC_DEFAULT_MSG_SIZE;
+
+    rpc_t* rpc = (rpc_t*)MALLOC(sizeof(*rpc));
+    if (!rpc)
+        goto RPC_FAIL;
+    memset(rpc, 0, sizeof(*rpc));
+    rpc->bus = bus;
+    rpc->timer = timer;
+    rpc->max = max_pending;
+    rpc->shift = ILOG2(max_pending);
+    rpc->max_msg = max_msg + sizeof(rpc_head_t);
+    rpc->calls = (call_t*)MALLOC(sizeof(call_t) * rpc->max);
+    if (!rpc->calls)
+        goto RPC_FAIL1;
+    rpc->rbuf = (char*)MALLOC(rpc->max_msg);
+    if (!rpc->rbuf)
+        goto RPC_FAIL2;
+    rpc->sbuf = (char*)MALLOC(rpc->max_msg);
+    if (!rpc->sbuf)
+        goto RPC_FAIL3;
+
+    for (int i = 0; i < rpc->max; ++ i) {
+        call_t* call = &rpc->calls[i];
+        memset(call, 0, sizeof(*call));
+        call->timer_id = TIMER_INVALID_ID;
+        call->rpc = rpc;
+        call->next = (i + 1 < rpc->max) ? i + 1 : -1;
+    }
+    rpc->free = 0;
+    return rpc;
+
+RPC_FAIL3:
+    FREE(rpc->rbuf);
+RPC_FAIL2:
+    FREE(rpc->calls);
+RPC_FAIL1:
+    FREE(rpc);
+RPC_FAIL:
+    return NULL;
+}
+
+static call_t*
+_rpc_call_alloc(rpc_t* rpc) {
+    if (rpc->free < 0)
+        return NULL;
+    int slot = rpc->free;
+    call_t* call = &rpc->calls[slot];
+    rpc->free = call->next;
+    // id 0 is reserved for free slot
+    do {
+        ++ call->gen;
+        call->id = (call->gen << rpc->shift) | (uint32_t)slot;
+    } while (call->id == 0);
+    ++ rpc->count;
+    return call;
+}
+
+static void
+_rpc_call_free(rpc_t* rpc, call_t* call) {
+    call->id = 0;
+    call->timer_id = TIMER_INVALID_ID;
+    call->cb = NULL;
+    call->arg = NULL;
+    call->next = rpc->free;
+    rpc->free = (int)(call - rpc->calls);
+    -- rpc->count;
+}
+
+static call_t*
+_rpc_call_find(rpc_t* rpc, uint32_t id) {
+    call_t* call = &rpc->calls[id & (rpc->max - 1)];
+    return (id && call->id == id) ? call : NULL;
+}
+
+// slot is free before callback, so callback could call again
+static void
+_rpc_call_finish(rpc_t* rpc, call_t* call, int err, const char* buf, size_t bufsz) {
+    rpc_callback cb = call->cb;
+    void* arg = call->arg;
+    if (call->timer_id != TIMER_INVALID_ID)
+        timer_unregister(rpc->timer, call->timer_id);
+    _rpc_call_free(rpc, call);
+    cb(rpc, err, buf, bufsz, arg);
+}
+
+// timer erases itself as return < 0
+static int
+_rpc_timeout(void* args) {
+    call_t* call = (call_t*)args;
+    call->timer_id = TIMER_INVALID_ID;
+    _rpc_call_finish(call->rpc, call, RPC_ERR_TIMEOUT, NULL, 0);
+    return -1;
+}
+
+void
+rpc_release(rpc_t* rpc) {
+    if (!rpc)
+        return;
+    for (int i = 0; i < rpc->max; ++ i) {
+        call_t* call = &rpc->calls[i];
+        if (call->id)
+            _rpc_call_finish(rpc, call, RPC_ERR_CANCEL, NULL, 0);
+    }
+    FREE(rpc->sbuf);
+    FREE(rpc->rbuf);
+    FREE(rpc->calls);
+    FREE(rpc);
+}
+
+void
+rpc_set_handler(rpc_t* rpc, rpc_handler handler, void* arg) {
+    if (rpc) {
+        rpc->handler = handler;
+        rpc->handler_arg = arg;
+    }
+}
+
+// serialize in pipe if possible
+static int
+_rpc_send(rpc_t* rpc, bus_addr_t to, uint32_t type, uint32_t id,
+          const char* buf, size_t bufsz) {
+    rpc_head_t head;
+    size_t sz = sizeof(head) + bufsz;
+    if (sz > (size_t)rpc->max_msg)
+        return RPC_ERR_FAIL;
+    head.flag = RPC_MAGIC | type;
+    head.id = id;
+
+    char* data = NULL;
+    int ret = bus_send_reserve(rpc->bus, &data, sz, to);
+    if (ret == BUS_OK) {
+        memcpy(data, &head, sizeof(head));
+        if (bufsz > 0)
+            memcpy(data + sizeof(head), buf, bufsz);
+        ret = bus_send_commit(rpc->bus, sz, to);
+    } else if (ret == BUS_ERR_FAIL) {
+        // multi-producer pipe
+        memcpy(rpc->sbuf, &head, sizeof(head));
+        if (bufsz > 0)
+            memcpy(rpc->sbuf + sizeof(head), buf, bufsz);
+        ret = bus_send(rpc->bus, rpc->sbuf, sz, to);
+    }
+    return ret == BUS_OK ? RPC_OK : RPC_ERR_SEND;
+}
+
+int
+rpc_call(rpc_t* rpc, bus_addr_t to, const char* buf, size_t bufsz,
+         int timeout_ms, rpc_callback cb, void* arg) {
+    if (!rpc || !cb || (bufsz > 0 && !buf))
+        return RPC_ERR_FAIL;
+    call_t* call = _rpc_call_alloc(rpc);
+    if (!call)
+        return RPC_ERR_FULL;
+    call->to = to;
+    call->cb = cb;
+    call->arg = arg;
+    if (rpc->timer && timeout_ms > 0) {
+        tv_t delay;
+        delay.tv_sec = timeout_ms / 1000;
+        delay.tv_usec = (timeout_ms % 1000) * 1000;
+        call->timer_id = timer_register(rpc->timer, NULL, &delay, _rpc_timeout, call);
+        if (call->timer_id == TIMER_INVALID_ID) {
+            _rpc_call_free(rpc, call);
+            return RPC_ERR_FAIL;
+        }
+    }
+    int ret = _rpc_send(rpc, to, RPC_REQUEST, call->id, buf, bufsz);
+    if (ret != RPC_OK) {
+        if (call->timer_id != TIMER_INVALID_ID)
+            timer_unregister(rpc->timer, call->timer_id);
+        _rpc_call_free(rpc, call);
+    }
+    return ret;
+}
+
+#if defined(OS_LINUX)
+
+// coroutine waiting for response
+typedef struct rpc_waiter_t {
+    crt_t* crt;
+    int id;
+    int done;
+    int err;
+    char* rsp;
+    size_t rspsz;
+} waiter_t;
+
+static void
+_rpc_wake(rpc_t* rpc, int err, const char* buf, size_t bufsz, void* arg) {
+    waiter_t* w = (waiter_t*)arg;
+    w->err = err;
+    if (err == RPC_OK) {
+        if (bufsz > w->rspsz) {
+            w->err = RPC_ERR_TRUNCATE;
+        } else if (bufsz > 0) {
+            memcpy(w->rsp, buf, bufsz);
+        }
+        w->rspsz = bufsz;
+    }
+    w->done = 1;
+    crt_resume(w->crt, w->id);
+}
+
+int
+rpc_call_crt(rpc_t* rpc, crt_t* crt, bus_addr_t to, const char* buf, size_t bufsz,
+             int timeout_ms, char* rsp, size_t* rspsz) {
+    if (!crt || !rspsz || (*rspsz > 0 && !rsp))
+        return RPC_ERR_FAIL;
+    // coroutine stack is kept while suspended
+    waiter_t w;
+    w.crt = crt;
+    w.id = crt_current(crt);
+    w.done = 0;
+    w.err = RPC_ERR_FAIL;
+    w.rsp = rsp;
+    w.rspsz = *rspsz;
+    if (w.id == CRT_INVALID_ID)
+        return RPC_ERR_FAIL;
+    int ret = rpc_call(rpc, to, buf, bufsz, timeout_ms, _rpc_wake, &w);
+    if (ret != RPC_OK)
+        return ret;
+    while (!w.done) {
+        crt_yield(crt);
+    }
+    *rspsz = w.rspsz;
+    return w.err;
+}
+
+#endif
+
+int
+rpc_reply(rpc_t* rpc, bus_addr_t to, uint32_t id, const char* buf, size_t bufsz) {
+    if (!rpc || (bufsz > 0 && !buf))
+        return RPC_ERR_FAIL;
+    return _rpc_send(rpc, to, RPC_RESPONSE, id, buf, bufsz);
+}
+
+int
+rpc_dispatch(rpc_t* rpc, bus_addr_t from, const char* buf, size_t bufsz) {
+    rpc_head_t head;
+    if (!rpc || !buf || bufsz < sizeof(head))
+        return RPC_ERR_FAIL;
+    memcpy(&head, buf, sizeof(head));
+    if ((head.flag & RPC_MAGIC_MASK) != RPC_MAGIC)
+        return RPC_ERR_FAIL;
+    buf += sizeof(head);
+    bufsz -= sizeof(head);
+
+    switch (head.flag & ~RPC_MAGIC_MASK) {
+        case RPC_REQUEST:
+            if (rpc->handler)
+                rpc->handler(rpc, from, head.id, buf, bufsz, rpc->handler_arg);
+            return RPC_OK;
+        case RPC_RESPONSE: {
+            // expired or canceled call is dropped
+            call_t* call = _rpc_call_find(rpc, head.id);
+            if (call && call->to == from)
+                _rpc_call_finish(rpc, call, RPC_OK, buf, bufsz);
+            return RPC_OK;
+        }
+        default:
+            return RPC_ERR_FAIL;
+    }
+}
+
+// larger than max_msg, only the head is taken out
+// the call fails if it's a response, a request is dropped
+static void
+_rpc_oversize(rpc_t* rpc, bus_addr_t from, const char* buf, size_t bufsz) {
+    rpc_head_t head;
+    ++ rpc->rejects;
+    if (bufsz < sizeof(head))
+        return;
+    memcpy(&head, buf, sizeof(head));
+    if (head.flag != (RPC_MAGIC | RPC_RESPONSE))
+        return;
+    call_t* call = _rpc_call_find(rpc, head.id);
+    if (call && call->to == from)
+        _rpc_call_finish(rpc, call, RPC_ERR_TRUNCATE, NULL, 0);
+}
+
+int
+rpc_poll(rpc_t* rpc, int max) {
+    if (!rpc)
+        return 0;
+    int n = 0;
+    bus_msg_t msg;
+    while (n < max) {
+        msg.buf = rpc->rbuf;
+        msg.bufsz = rpc->max_msg;
+        int ret = bus_recv_batch(rpc->bus, &msg, 1);
+        if (ret == BUS_ERR_OVERSIZE) {
+            // a larger one blocks its pipe, take it out and go on
+            msg.bufsz = sizeof(rpc_head_t);
+            if (bus_recv_oversize(rpc->bus, rpc->max_msg, &msg) != 1)
+                break;
+            _rpc_oversize(rpc, msg.from, msg.buf, sizeof(rpc_head_t));
+            continue;
+        }
+        if (ret != 1)
+            break;
+        if (rpc_dispatch(rpc, msg.from, msg.buf, msg.bufsz) == RPC_OK) {
+            ++ n;
+        } else {
+            ++ rpc->rejects;
+        }
+    }
+    return n;
+}
+
+int
+rpc_pending(rpc_t* rpc) {
+    return rpc ? rpc->count : 0;
+}
+
+uint64_t
+rpc_rejects(rpc_t* rpc) {
+    return rpc ? rpc->rejects : 0;
+}
@@ -0,0 +1,86 @@
+#ifndef RPC_H_
+#define RPC_H_
+
+//
+// request & response over bus
+// every message carries a head with correlation id,
+// pending calls are kept in a fix sized slot table indexed by the id,
+// and expired by timer heap polled by user
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "core/os_def.h"
+#include "core/coroutine.h"
+#include "base/timer.h"
+#include "logic/bus.h"
+
+#define RPC_DEFAULT_PENDING 4096
+#define RPC_DEFAULT_MSG_SIZE (64 * 1024)
+
+enum {
+    RPC_ERR_FAIL = -200,
+    // too many pending calls
+    RPC_ERR_FULL,
+    // bus send fail
+    RPC_ERR_SEND,
+    RPC_ERR_TIMEOUT,
+    // rpc released before response
+    RPC_ERR_CANCEL,
+    // response is larger than buffer, or max_msg of rpc_poll
+    RPC_ERR_TRUNCATE,
+    RPC_OK = 0,
+};
+
+typedef struct rpc_t rpc_t;
+
+// response arrives with RPC_OK, otherwise buf is NULL
+typedef void (*rpc_callback)(rpc_t*, int err, const char* buf, size_t bufsz, void* arg);
+
+// request arrives, reply it by from & id, at once or later
+typedef void (*rpc_handler)(rpc_t*, bus_addr_t from, uint32_t id,
+                            const char* buf, size_t bufsz, void* arg);
+
+// max_msg: max payload size, max_pending & max_msg <= 0 means default
+rpc_t* rpc_create(bus_t*, timerheap_t*, int max_pending, int max_msg);
+// pending calls fail by RPC_ERR_CANCEL
+void rpc_release(rpc_t*);
+
+void rpc_set_handler(rpc_t*, rpc_handler, void* arg);
+
+// timeout_ms <= 0 (or no timer) means never timeout
+// return RPC_OK, or fail and cb is never called
+int rpc_call(rpc_t*, bus_addr_t to, const char* buf, size_t bufsz,
+             int timeout_ms, rpc_callback cb, void* arg);
+
+#if defined(OS_LINUX)
+// call in coroutine, suspended until response or fail
+// rspsz: in buffer size, out response size
+// messages should be dispatched out of coroutines
+int rpc_call_crt(rpc_t*, crt_t*, bus_addr_t to, const char* buf, size_t bufsz,
+                 int timeout_ms, char* rsp, size_t* rspsz);
+#endif
+
+int rpc_reply(rpc_t*, bus_addr_t to, uint32_t id, const char* buf, size_t bufsz);
+
+// receive at most max messages from bus and dispatch them, bus_poll is up to user
+// messages larger than max_msg are dropped, and their calls fail by RPC_ERR_TRUNCATE
+// return messages dispatched
+int rpc_poll(rpc_t*, int max);
+
+// bus shared with other messages: dispatch one received by user
+// return RPC_ERR_FAIL if it's not a rpc message
+int rpc_dispatch(rpc_t*, bus_addr_t from, const char* buf, size_t bufsz);
+
+int rpc_pending(rpc_t*);
+
+// messages received by rpc_poll but dropped, as not rpc or larger than max_msg
+uint64_t rpc_rejects(rpc_t*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RPC_H_
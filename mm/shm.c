@@ -10,17 +10,27 @@ struct shm_t {
     void* mem;
 };
 
-// excl == 0: means return null if shm exists
-shm_t*
-shm_create(int shmkey, size_t size, int excl) {
+static shm_t*
+_shm_create(int shmkey, size_t size, int excl, int huge) {
     // malloc shm
     shm_t* shm = (shm_t*)MALLOC(sizeof(*shm));
     if (!shm) return NULL;
     shm->mem = NULL;
 
     // size round up, pagesize must be 2^n
-    shm->size = ROUNDUP2(size, getpagesize());
-    shm->id = shmget(shmkey, shm->size, 0666 | IPC_CREAT | IPC_EXCL);
+    int flag = 0666 | IPC_CREAT | IPC_EXCL;
+    if (huge) {
+#if defined(SHM_HUGETLB)
+        shm->size = ROUNDUP2(size, SHM_HUGE_PAGE_SIZE);
+        flag |= SHM_HUGETLB;
+#else
+        FREE(shm);
+        return NULL;
+#endif
+    } else {
+        shm->size = ROUNDUP2(size, getpagesize());
+    }
+    shm->id = shmget(shmkey, shm->size, flag);
     if (shm->id < 0) {
         if (errno == EEXIST && excl) {
             // already exsit, validate shm size
@@ -41,6 +51,36 @@ shm_create(int shmkey, size_t size, int excl) {
     return shm;
 }
 
+// excl == 0: means return null if shm exists
+shm_t*
+shm_create(int shmkey, size_t size, int excl) {
+    return _shm_create(shmkey, size, excl, 0);
+}
+
+shm_t*
+shm_create_huge(int shmkey, size_t size, int excl) {
+    return _shm_create(shmkey, size, excl, 1);
+}
+
+shm_t*
+shm_attach(int shmkey) {
+    shm_t* shm = (shm_t*)MALLOC(sizeof(*shm));
+    if (!shm) return NULL;
+    shm->id = shmget(shmkey, 0, 0666);
+    struct shmid_ds sd;
+    if (shm->id < 0 || shmctl(shm->id, IPC_STAT, &sd) < 0) {
+        FREE(shm);
+        return NULL;
+    }
+    shm->size = sd.shm_segsz;
+    shm->mem = shmat(shm->id, NULL, 0);
+    if (shm->mem == (void*)-1) {
+        FREE(shm);
+        return NULL;
+    }
+    return shm;
+}
+
 inline shm_id_t
 shm_id(shm_t* shm) {
     return shm ? shm->id : SHM_INVALID_ID;
@@ -69,3 +109,11 @@ shm_release(shm_t* shm) {
     if (shm) FREE(shm);
 }
 
+void
+shm_detach(shm_t* shm) {
+    if (shm) {
+        if (shm->mem) shmdt(shm->mem);
+        FREE(shm);
+    }
+}
+
@@ -17,9 +17,18 @@ typedef int shm_id_t;
 
 #define SHM_INVALID_ID 0
 
+#define SHM_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
 // excl == 0: means return null if shm exists
 shm_t* shm_create(int shmkey, size_t size, int excl);
 
+// backed by huge pages, size round up by SHM_HUGE_PAGE_SIZE
+// return null if huge pages not supported or not enough
+shm_t* shm_create_huge(int shmkey, size_t size, int excl);
+
+// attach an exist one, whatever size it is
+shm_t* shm_attach(int shmkey);
+
 shm_id_t shm_id(shm_t*);
 
 size_t shm_size(shm_t*);
@@ -32,6 +41,9 @@ void shm_destroy(shm_t*);
 
 void shm_release(shm_t*);
 
+// release and unmap it, memory address is invalid then
+void shm_detach(shm_t*);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,27 +1,60 @@
 #include "net/acceptor.h"
 #include "net/sock.h"
 
+// accepts per event, so a connection storm doesn't starve others
+#define ACCEPTOR_BUDGET 64
+
 struct acceptor_t {
     // handler must be at head
     handler_t h;
     reactor_t* r;
+    // reserved for EMFILE, to accept & close pending connections
+    int idle;
     acc_read_func on_read;
     void* read_arg;
     acc_close_func on_close;
     void* close_arg;
 };
 
+//  accept until EAGAIN, at most budget times
 //  return -1, means fail, reactor will remove & close acceptor
+//  return > 0, stopped by budget
 static int
 _acc_read(handler_t* h) {
     acc_t* a = (acc_t*)h;
-    sockaddr_t addr;
-    sock_t nsock = sock_accept(a->h.fd, &addr);
-    if (nsock == INVALID_SOCK)
-        return -1;
-    if (a->on_read)
-        return a->on_read(nsock, a->read_arg);
-    return 0;
+    for (int i = 0; i < ACCEPTOR_BUDGET; ++ i) {
+        sockaddr_t addr;
+        sock_t nsock = sock_accept_nonblock(a->h.fd, &addr);
+        if (nsock == INVALID_SOCK) {
+            // drained
+            if (EAGAIN == errno || EWOULDBLOCK == errno)
+                return 0;
+            // the peer gave up, or interrupted
+            if (EINTR == errno || ECONNABORTED == errno || EPROTO == errno)
+                continue;
+            // out of fds, refuse the pending one, or it keeps readable
+            if ((EMFILE == errno || ENFILE == errno) && a->idle >= 0) {
+                close(a->idle);
+                a->idle = INVALID_SOCK;
+                nsock = sock_accept(a->h.fd, &addr);
+                if (nsock != INVALID_SOCK)
+                    sock_close(nsock);
+                a->idle = open("/dev/null", O_RDONLY | O_CLOEXEC);
+                continue;
+            }
+            // retry in next event
+            if (EMFILE == errno || ENFILE == errno
+                || ENOBUFS == errno || ENOMEM == errno)
+                return 0;
+            return -1;
+        }
+        if (a->on_read) {
+            int ret = a->on_read(nsock, a->read_arg, &addr);
+            if (ret < 0)
+                return ret;
+        }
+    }
+    return 1;
 }
 
 static int
@@ -43,6 +76,7 @@ acc_create(reactor_t* r) {
     a->h.fd = sock_tcp();
     a->h.in_func = _acc_read;
     a->h.close_func = _acc_close;
+    a->idle = open("/dev/null", O_RDONLY | O_CLOEXEC);
     return a;
 }
 
@@ -66,11 +100,18 @@ int
 acc_release(acc_t* a) {
     if (a) {
         acc_stop(a);
+        if (a->idle >= 0)
+            close(a->idle);
         FREE(a);
     }
     return 0;
 }
 
+int
+acc_set_reuseport(acc_t* a) {
+    return a ? sock_set_reuseport(a->h.fd) : -1;
+}
+
 int
 acc_start(acc_t* a, sockaddr_t* laddr) {
     if (!a || a->h.fd == INVALID_SOCK) {
@@ -80,6 +121,10 @@ acc_start(acc_t* a, sockaddr_t* laddr) {
     if (res < 0) {
         return res;
     }
+    // accept in loop
+    if (sock_set_nonblock(a->h.fd) < 0) {
+        return -1;
+    }
     return reactor_register(a->r, &a->h, EVENT_IN);
 }
 
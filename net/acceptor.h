@@ -10,7 +10,8 @@ extern "C" {
 #include "net/reactor.h"
 
 typedef struct acceptor_t acc_t;
-typedef int (*acc_read_func)(sock_t, void* arg);
+// accepted socket is nonblocking, peer is its address
+typedef int (*acc_read_func)(sock_t, void* arg, const sockaddr_t* peer);
 typedef void (*acc_close_func)(sock_t, void* arg);
 
 acc_t* acc_create(reactor_t*);
@@ -19,6 +20,9 @@ int acc_release(acc_t* a);
 void acc_set_read_func(acc_t*, acc_read_func, void*);
 void acc_set_close_func(acc_t*, acc_close_func, void*);
 
+// share the address with other acceptors, before start
+int acc_set_reuseport(acc_t*);
+
 int acc_start(acc_t*, sockaddr_t* laddr);
 int acc_stop(acc_t*);
 
@@ -1,6 +1,27 @@
+#include "core/atom.h"
 #include "net/connector.h"
 
 #define CONNECTOR_BUFFER_SIZE (64 * 1024)
+// reads per event, so a busy socket doesn't starve others
+#define CONNECTOR_READ_BUDGET 16
+// segments per writev
+#define CONNECTOR_IOV_MAX 64
+// min segment allocated by connector, small sendings are appended
+#define CONNECTOR_SEG_SIZE (16 * 1024)
+
+struct con_seg_t {
+    atom_t ref;
+    int len;
+    int cap;
+    char data[0];
+};
+
+// queued after wbuf
+typedef struct con_node_t {
+    con_seg_t* seg;
+    int off;
+    struct con_node_t* next;
+} node_t;
 
 struct connector_t {
     handler_t h;
@@ -9,8 +30,13 @@ struct connector_t {
     // malloc by connector
     int8_t flag_rbuf: 1;
     int8_t flag_wbuf : 1;
+    // sock is nonblocking
+    int8_t flag_nonblock : 1;
     buffer_t* rbuf;
     buffer_t* wbuf;
+    node_t* head;
+    node_t* tail;
+    int queued;
 
     // callback function
     con_read_func on_read;
@@ -19,63 +45,196 @@ struct connector_t {
     void* close_arg;
 };
 
+// read until EAGAIN (or a short read), at most budget times
+// return > 0 if stopped by budget
 static int
 _con_read(handler_t* h) {
     con_t* con = (con_t*)h;
-    int nwrite = buffer_write_len(con->rbuf);
-    assert(nwrite >= 0);
-    // read buffer full fail
-    if (0 == nwrite) {
-        printf("fd[%d] read buffer full.\n", con->h.fd);
-        return -1;
-    }
-    // read socket
-    char* buffer = buffer_write_buffer(con->rbuf);
-    int res = read(con->h.fd, buffer, nwrite);
-    if (res < 0) {
-        // can't read now
-        if (EAGAIN == errno || EINTR == errno) {
+    for (int i = 0; i < CONNECTOR_READ_BUDGET; ++ i) {
+        // stopped in callback
+        if (con->h.fd == INVALID_SOCK)
             return 0;
-        } else {
+        int nwrite = buffer_write_len(con->rbuf);
+        assert(nwrite >= 0);
+        // read buffer full fail
+        if (0 == nwrite) {
+            printf("fd[%d] read buffer full.\n", con->h.fd);
+            return -1;
+        }
+        // read socket
+        char* buffer = buffer_write_buffer(con->rbuf);
+        int res = read(con->h.fd, buffer, nwrite);
+        if (res < 0) {
+            if (EINTR == errno)
+                continue;
+            // can't read now, idle storage is given back
+            if (EAGAIN == errno || EWOULDBLOCK == errno) {
+                buffer_shrink(con->rbuf);
+                return 0;
+            }
             return -errno;
+        } else if (0 == res) {
+            return -1;
         }
-    } else if (0 == res) {
-        return -1;
-    } else {
         buffer_write_nocopy(con->rbuf, res);
         buffer = buffer_read_buffer(con->rbuf);
         int nread = buffer_read_len(con->rbuf);
         assert(buffer && nread);
-        res = con->on_read(con->h.fd, con->read_arg, buffer, nread);
-        return res > 0 ?  buffer_read_nocopy(con->rbuf, res) : res;
+        int ret = con->on_read(con->h.fd, con->read_arg, buffer, nread);
+        if (ret < 0)
+            return ret;
+        if (ret > 0)
+            buffer_read_nocopy(con->rbuf, ret);
+        // socket is drained
+        if (res < nwrite) {
+            buffer_shrink(con->rbuf);
+            return 0;
+        }
     }
+    return 1;
+}
+
+static void
+_con_queue_pop(con_t* con) {
+    node_t* node = con->head;
+    con->head = node->next;
+    if (!con->head)
+        con->tail = NULL;
+    con->queued -= node->seg->len - node->off;
+    con_seg_release(node->seg);
+    FREE(node);
+}
+
+static void
+_con_queue_clean(con_t* con) {
+    while (con->head)
+        _con_queue_pop(con);
+}
+
+static int
+_con_queue_push(con_t* con, con_seg_t* seg) {
+    node_t* node = (node_t*)MALLOC(sizeof(node_t));
+    if (!node)
+        return -1;
+    node->seg = seg;
+    node->off = 0;
+    node->next = NULL;
+    if (con->tail) {
+        con->tail->next = node;
+    } else {
+        con->head = node;
+    }
+    con->tail = node;
+    con->queued += seg->len;
     return 0;
 }
 
+// copy iov (except skip bytes written) into tail segment if it's owned only by queue,
+// or a new one
 static int
-_con_write(handler_t* h) {
-    con_t* con = (con_t*)h;
+_con_queue_copy(con_t* con, const struct iovec* iov, int iovcnt, int skip, int total) {
+    con_seg_t* seg = con->tail ? con->tail->seg : NULL;
+    if (!seg || seg->cap - seg->len < total || atom_load_acquire(&seg->ref) != 1) {
+        int cap = total > CONNECTOR_SEG_SIZE ? total : CONNECTOR_SEG_SIZE;
+        seg = (con_seg_t*)MALLOC(sizeof(con_seg_t) + cap);
+        if (!seg)
+            return -1;
+        seg->ref = 1;
+        seg->len = 0;
+        seg->cap = cap;
+        if (_con_queue_push(con, seg) < 0) {
+            FREE(seg);
+            return -1;
+        }
+    }
+    for (int i = 0; i < iovcnt; ++ i) {
+        int len = (int)iov[i].iov_len;
+        if (skip >= len) {
+            skip -= len;
+            continue;
+        }
+        memcpy(seg->data + seg->len, (const char*)iov[i].iov_base + skip, len - skip);
+        seg->len += len - skip;
+        skip = 0;
+    }
+    con->queued += total;
+    return 0;
+}
+
+static void
+_con_buffer_copy(con_t* con, const struct iovec* iov, int iovcnt, int skip) {
+    for (int i = 0; i < iovcnt; ++ i) {
+        int len = (int)iov[i].iov_len;
+        if (skip >= len) {
+            skip -= len;
+            continue;
+        }
+        buffer_write(con->wbuf, (const char*)iov[i].iov_base + skip, len - skip);
+        skip = 0;
+    }
+}
+
+// wbuf first, then queued segments
+static int
+_con_iov(con_t* con, struct iovec* iov) {
+    int n = buffer_read_iov(con->wbuf, iov);
+    for (node_t* node = con->head; node && n < CONNECTOR_IOV_MAX; node = node->next) {
+        iov[n].iov_base = node->seg->data + node->off;
+        iov[n ++].iov_len = node->seg->len - node->off;
+    }
+    return n;
+}
+
+static void
+_con_consume(con_t* con, int res) {
     int nwrite = buffer_read_len(con->wbuf);
-    if (nwrite <= 0)
-        return 0;
+    if (nwrite > 0) {
+        nwrite = res < nwrite ? res : nwrite;
+        buffer_read_nocopy(con->wbuf, nwrite);
+        res -= nwrite;
+    }
+    while (res > 0) {
+        node_t* node = con->head;
+        int left = node->seg->len - node->off;
+        if (res < left) {
+            node->off += res;
+            con->queued -= res;
+            return;
+        }
+        res -= left;
+        _con_queue_pop(con);
+    }
+}
 
-    char* buffer = buffer_read_buffer(con->wbuf);
-    int res = write(con->h.fd, buffer, nwrite);
-    if (res < 0) {
-        // can't write now
-        if (EAGAIN == errno || EINTR == errno) {
-            return 0;
-        } else {
+// write until buffer & queue are empty or socket is full
+static int
+_con_write(handler_t* h) {
+    con_t* con = (con_t*)h;
+    struct iovec iov[CONNECTOR_IOV_MAX];
+    int n;
+    while ((n = _con_iov(con, iov)) > 0) {
+        ssize_t nwrite = 0;
+        for (int i = 0; i < n; ++ i)
+            nwrite += iov[i].iov_len;
+        ssize_t res = (1 == n) ? write(con->h.fd, iov[0].iov_base, iov[0].iov_len)
+                               : writev(con->h.fd, iov, n);
+        if (res < 0) {
+            if (EINTR == errno)
+                continue;
+            // can't write now
+            if (EAGAIN == errno || EWOULDBLOCK == errno)
+                return 0;
             return -errno;
+        } else if (0 == res) {
+            return -1;
         }
-    } else if (0 == res) {
-        return -1;
-    } else {
-        buffer_read_nocopy(con->wbuf, res);
-        if (res == nwrite) {
-            reactor_modify(con->r, &con->h, EVENT_IN);
-        }
+        _con_consume(con, (int)res);
+        if (res < nwrite)
+            return 0;
     }
+    // all flushed, idle storage is given back
+    buffer_shrink(con->wbuf);
+    reactor_modify(con->r, &con->h, EVENT_IN);
     return 0;
 }
 
@@ -124,6 +283,7 @@ int
 con_release(con_t* con) {
     if (con) {
         con_stop(con);
+        _con_queue_clean(con);
         if (con->flag_rbuf) {
             buffer_release(con->rbuf);
         }
@@ -146,6 +306,12 @@ con_set_sock(con_t* con, sock_t fd) {
         con->h.fd = fd;
 }
 
+inline void
+con_set_nonblock(con_t* con) {
+    if (con)
+        con->flag_nonblock = 1;
+}
+
 int
 con_start(con_t* con) {
     if (!con || con->h.fd == INVALID_SOCK)
@@ -160,7 +326,8 @@ con_start(con_t* con) {
         assert(con->wbuf);
         con->flag_wbuf = 1;
     }
-    sock_set_nonblock(con->h.fd);
+    if (!con->flag_nonblock)
+        sock_set_nonblock(con->h.fd);
     sock_set_nodelay(con->h.fd);
     return reactor_register(con->r, &con->h, EVENT_IN);
 }
@@ -169,18 +336,108 @@ con_start(con_t* con) {
 //  return < 0, fail, maybe full
 int
 con_send(con_t* con, const char* buffer, int buflen) {
+    if (!buffer || buflen < 0)
+        return -1;
+    struct iovec iov;
+    iov.iov_base = (void*)buffer;
+    iov.iov_len = buflen;
+    return con_sendv(con, &iov, 1);
+}
+
+int
+con_sendv(con_t* con, const struct iovec* iov, int iovcnt) {
     if (!con || con->h.fd == INVALID_SOCK || !con->wbuf)
         return -1;
-    if (!buffer || buflen < 0)
+    if (!iov || iovcnt < 0)
+        return -1;
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; ++ i)
+        total += iov[i].iov_len;
+    if (total > CONNECTOR_QUEUE_MAX - con->queued)
+        return -1;
+    // nothing pending, write at once, and arm writing only if partial
+    int skip = 0;
+    if (!con->head && 0 == buffer_read_len(con->wbuf) && total > 0) {
+        skip = sock_writev(con->h.fd, iov, iovcnt < CONNECTOR_IOV_MAX ? iovcnt : CONNECTOR_IOV_MAX);
+        if (skip < 0)
+            return -1;
+        if (skip == (int)total)
+            return 0;
+    }
+    // wbuf only if nothing queued, to keep order
+    int left = (int)total - skip;
+    if (!con->head && left <= buffer_write_len(con->wbuf)) {
+        _con_buffer_copy(con, iov, iovcnt, skip);
+    } else if (_con_queue_copy(con, iov, iovcnt, skip, left) < 0) {
+        return -1;
+    }
+    reactor_modify(con->r, &con->h, (EVENT_IN | EVENT_OUT));
+    return 0;
+}
+
+con_seg_t*
+con_seg_create(const char* data, int len) {
+    if (!data || len < 0)
+        return NULL;
+    con_seg_t* seg = (con_seg_t*)MALLOC(sizeof(con_seg_t) + len);
+    if (!seg)
+        return NULL;
+    seg->ref = 1;
+    seg->len = len;
+    seg->cap = len;
+    memcpy(seg->data, data, len);
+    return seg;
+}
+
+con_seg_t*
+con_seg_ref(con_seg_t* seg) {
+    if (seg)
+        atom_inc(&seg->ref);
+    return seg;
+}
+
+void
+con_seg_release(con_seg_t* seg) {
+    if (seg && 0 == atom_dec(&seg->ref))
+        FREE(seg);
+}
+
+int
+con_send_seg(con_t* con, con_seg_t* seg) {
+    if (!con || con->h.fd == INVALID_SOCK || !con->wbuf || !seg)
+        return -1;
+    if (seg->len > CONNECTOR_QUEUE_MAX - con->queued)
         return -1;
-    int nwrite = buffer_write_len(con->wbuf);
-    if (buflen > nwrite)
+    int skip = 0;
+    if (!con->head && 0 == buffer_read_len(con->wbuf) && seg->len > 0) {
+        struct iovec iov;
+        iov.iov_base = seg->data;
+        iov.iov_len = seg->len;
+        skip = sock_writev(con->h.fd, &iov, 1);
+        if (skip < 0)
+            return -1;
+        if (skip == seg->len)
+            return 0;
+    }
+    if (_con_queue_push(con, con_seg_ref(seg)) < 0) {
+        con_seg_release(seg);
         return -1;
-    buffer_write(con->wbuf, buffer, buflen);
+    }
+    con->tail->off = skip;
+    con->queued -= skip;
     reactor_modify(con->r, &con->h, (EVENT_IN | EVENT_OUT));
     return 0;
 }
 
+int
+con_flush(con_t* con) {
+    if (!con || con->h.fd == INVALID_SOCK || !con->wbuf)
+        return -1;
+    if (buffer_read_len(con->wbuf) > 0 || con->head)
+        return reactor_modify(con->r, &con->h, (EVENT_IN | EVENT_OUT));
+    return 0;
+}
+
 int
 con_stop(con_t* con) {
     if (!con || con->h.fd == INVALID_SOCK)
@@ -194,6 +451,7 @@ con_stop(con_t* con) {
     if (con->wbuf) {
         buffer_reset(con->wbuf);
     }
+    _con_queue_clean(con);
     return 0;
 }
 
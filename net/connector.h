@@ -5,12 +5,17 @@
 extern "C" {
 #endif
 
+#include <sys/uio.h>
 #include "core/os_def.h"
 #include "base/buffer.h"
 #include "net/sock.h"
 #include "net/reactor.h"
 
 typedef struct connector_t con_t;
+typedef struct con_seg_t con_seg_t;
+
+// max bytes queued besides wbuf
+#define CONNECTOR_QUEUE_MAX (64 << 20)
 
 // return buffer size processed
 // return -1 means process fail, reactor will close it
@@ -29,13 +34,30 @@ int con_set_wbuf(con_t*, buffer_t*);
 
 sock_t con_sock(con_t*);
 void con_set_sock(con_t*, sock_t);
+// sock is nonblocking already (accepted by acceptor), con_start skips fcntl
+void con_set_nonblock(con_t*);
 
 int con_start(con_t*);
 int con_stop(con_t*);
 
+// sendings are copied into wbuf, or queued as segments if wbuf is full,
+// and flushed by writev in order
 //  return = 0 success
-//  return < 0, fail, maybe full
+//  return < 0, fail, maybe queued bytes over CONNECTOR_QUEUE_MAX
 int con_send(con_t*, const char* buffer, int buflen);
+int con_sendv(con_t*, const struct iovec* iov, int iovcnt);
+
+// refcounted payload, queued by connections without copy (e.g. broadcast)
+// created with one reference, released by creator after sendings
+con_seg_t* con_seg_create(const char* data, int len);
+con_seg_t* con_seg_ref(con_seg_t*);
+void con_seg_release(con_seg_t*);
+int con_send_seg(con_t*, con_seg_t*);
+
+// data is written into customized wbuf directly, arm writing
+// so sendings in a dispatch go out by one write
+// (it's out of order if mixed with queued sendings)
+int con_flush(con_t*);
 
 #ifdef __cplusplus
 }
@@ -1,22 +1,18 @@
+#include <limits.h>
+
 #include "net/reactor.h"
 #include "net/reactor_inner.inl"
+#include "util/util_time.h"
 
-reactor_t*
-reactor_create() {
+static reactor_t*
+_reactor_create(const reactor_impl_t* impl) {
     reactor_t* reactor = (reactor_t*)MALLOC(sizeof(reactor_t));
     if (!reactor)
         return NULL;
     reactor->name = NULL;
     reactor->data = 0;
-#if defined(OS_LINUX)
-    reactor->impl = &reactor_epoll;
-#elif defined(OS_CYGWIN)
-    reactor->impl = &reactor_select;
-#elif defined(OS_MAC)
-    reactor->impl = &reactor_kqueue;
-#else
-    reactor->impl = &reactor_select;
-#endif
+    reactor->impl = impl;
+    reactor->timer = NULL;
     int ret = reactor->impl->create(reactor);
     if (ret < 0) {
         FREE(reactor);
@@ -25,6 +21,28 @@ reactor_create() {
     return reactor;
 }
 
+reactor_t*
+reactor_create() {
+#if defined(OS_LINUX)
+    return _reactor_create(&reactor_epoll);
+#elif defined(OS_CYGWIN)
+    return _reactor_create(&reactor_select);
+#elif defined(OS_MAC)
+    return _reactor_create(&reactor_kqueue);
+#else
+    return _reactor_create(&reactor_select);
+#endif
+}
+
+reactor_t*
+reactor_create_uring() {
+#if defined(OS_LINUX)
+    return _reactor_create(&reactor_uring);
+#else
+    return NULL;
+#endif
+}
+
 void
 reactor_release(reactor_t* reactor) {
     if (reactor) {
@@ -35,7 +53,12 @@ reactor_release(reactor_t* reactor) {
 
 int
 reactor_register(reactor_t* reactor, struct handler_t* h, int events) {
-    return reactor ? reactor->impl->add(reactor, h, events) : -1;
+    if (!reactor || !h)
+        return -1;
+    int ret = reactor->impl->add(reactor, h, events);
+    if (0 == ret)
+        h->events = events;
+    return ret;
 }
 
 int
@@ -45,11 +68,60 @@ reactor_unregister(reactor_t* reactor, struct handler_t* h) {
 
 int
 reactor_modify(reactor_t* reactor, struct handler_t* h, int events) {
-    return reactor ? reactor->impl->modify(reactor, h, events) : -1;
+    if (!reactor || !h)
+        return -1;
+    // interest cached, saves a syscall
+    if (h->events == events)
+        return 0;
+    int ret = reactor->impl->modify(reactor, h, events);
+    if (0 == ret)
+        h->events = events;
+    return ret;
+}
+
+int
+reactor_set_edge(reactor_t* reactor, int enable) {
+    if (!reactor || !reactor->impl->edge)
+        return -1;
+    return reactor->impl->edge(reactor, enable);
+}
+
+int
+reactor_set_timer(reactor_t* reactor, timerheap_t* timer) {
+    if (!reactor)
+        return -1;
+    reactor->timer = timer;
+    return 0;
+}
+
+// rounded up, so it doesn't wake up before due
+static int
+_reactor_wait_ms(tv_t* now, tv_t* due) {
+    if (util_time_compare(due, now) <= 0)
+        return 0;
+    tv_t diff;
+    util_time_sub(due, now, &diff);
+    if (diff.tv_sec >= INT_MAX / 1000 - 1)
+        return INT_MAX;
+    return (int)(diff.tv_sec * 1000 + (diff.tv_usec + 999) / 1000);
 }
 
 int
 reactor_dispatch(reactor_t* reactor, int ms) {
-    return reactor ? reactor->impl->dispatch(reactor, ms) : -1;
+    if (!reactor)
+        return -1;
+    if (!reactor->timer)
+        return reactor->impl->dispatch(reactor, ms);
+    tv_t now, due;
+    if (0 == timer_next(reactor->timer, &due)) {
+        gettimeofday(&now, NULL);
+        int wait = _reactor_wait_ms(&now, &due);
+        if (ms < 0 || wait < ms)
+            ms = wait;
+    }
+    int ret = reactor->impl->dispatch(reactor, ms);
+    gettimeofday(&now, NULL);
+    timer_poll(reactor->timer, &now);
+    return ret;
 }
 
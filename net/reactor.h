@@ -7,6 +7,7 @@ extern "C" {
 
 #include "core/os_def.h"
 #include "net/sock.h"
+#include "base/timer.h"
 
 struct reactor_impl_t;
 typedef struct reactor_t reactor_t;
@@ -14,23 +15,40 @@ typedef struct reactor_t reactor_t;
 typedef struct handler_t {
     sock_t fd;
     // return < 0 means to close handle fd
+    // return > 0 means stopped by budget, and fd may be still ready
     int (*in_func)(struct handler_t*);
     int (*out_func)(struct handler_t*);
     int (*close_func)(struct handler_t*);
+    // interest events & registered slot, kept by reactor
+    int events;
+    int slot;
 } handler_t;
 
 #define EVENT_IN 1
 #define EVENT_OUT 2
 
 reactor_t* reactor_create();
+// io_uring backend (linux >= 5.11), NULL if not supported
+reactor_t* reactor_create_uring();
 void reactor_release(reactor_t*);
 int reactor_register(reactor_t*, handler_t*, int events);
 int reactor_unregister(reactor_t*, handler_t*);
+// nothing to do if events is the same as interest
 int reactor_modify(reactor_t*, handler_t*, int events);
 
+// edge-triggered mode (epoll only), for handlers registered after it
+// handlers should read & write until EAGAIN, or return > 0 if stopped by budget,
+// then reactor re-arms it for another event
+// connector, acceptor & wsconn work in both modes
+int reactor_set_edge(reactor_t*, int enable);
+
+// timers are polled in dispatch, which waits no longer than the nearest one
+// heap is owned by user, NULL to detach
+int reactor_set_timer(reactor_t*, timerheap_t*);
+
 //  return = 0, nothing happened
 //  return < 0, fail
-//  return > 0, return callback times
+//  return > 0, return callback times (timers not counted)
 int reactor_dispatch(reactor_t*, int ms);
 
 #ifdef __cplusplus
@@ -1,7 +1,6 @@
 #include "core/os_def.h"
 #include "net/reactor.h"
 #include "net/reactor_inner.inl"
-#include "base/slist.h"
 
 #if defined(OS_LINUX)
 #include <sys/epoll.h>
@@ -9,10 +8,13 @@
 typedef struct epoll_event event_t;
 
 #define EPOLL_SIZE 10240
+
 typedef struct epoll_t {
     int epoll_fd;
     event_t events[EPOLL_SIZE];
-    slist_t* expired;
+    reactor_slots_t slots;
+    // EPOLLET
+    int edge;
 } epoll_t;
 
 static const char* EPOLL_NAME = "epoll";
@@ -31,17 +33,13 @@ epoll_init(reactor_t* reactor) {
         goto EPOLL_FAIL1;
     }
     memset(epoll->events, 0, sizeof(epoll->events));
+    epoll->edge = 0;
 
-    epoll->expired = slist_create();
-    if (!epoll->expired) {
-        goto EPOLL_FAIL2;
-    }
+    reactor_slots_init(&epoll->slots);
     reactor->data = (void*)epoll;
     reactor->name = EPOLL_NAME;
     return 0;
 
-EPOLL_FAIL2:
-    close(epoll->epoll_fd);
 EPOLL_FAIL1:
     FREE(epoll);
 EPOLL_FAIL:
@@ -57,8 +55,8 @@ _epoll_set(epoll_t* epoll, handler_t* h, int option, int events) {
         return epoll_ctl(epoll->epoll_fd, EPOLL_CTL_DEL, h->fd, 0);
     }
     event_t ep_event;
-    ep_event.events = 0;
-    ep_event.data.ptr = h;
+    ep_event.events = epoll->edge ? EPOLLET : 0;
+    ep_event.data.u64 = reactor_slots_data(&epoll->slots, h);
     if (EVENT_IN & events) {
         ep_event.events |= (EPOLLIN | EPOLLERR);
     }
@@ -73,7 +71,16 @@ epoll_register(reactor_t* reactor, handler_t* h, int events) {
     if (!reactor || !reactor->data || !h) {
         return -1;
     }
-    return _epoll_set((epoll_t*)reactor->data, h, EPOLL_CTL_ADD, events);
+    epoll_t* epoll = (epoll_t*)reactor->data;
+    int slot = reactor_slots_alloc(&epoll->slots, h);
+    if (slot < 0) {
+        return -1;
+    }
+    int ret = _epoll_set(epoll, h, EPOLL_CTL_ADD, events);
+    if (ret < 0) {
+        reactor_slots_free(&epoll->slots, slot);
+    }
+    return ret;
 }
 
 int
@@ -82,8 +89,10 @@ epoll_unregister(reactor_t* reactor, handler_t* h) {
         return -1;
     }
     epoll_t* epoll = (epoll_t*)reactor->data;
-    // add to expire-list
-    slist_push_front(epoll->expired, h);
+    if (!reactor_slots_check(&epoll->slots, h)) {
+        return -1;
+    }
+    reactor_slots_free(&epoll->slots, h->slot);
     return _epoll_set(epoll, h, EPOLL_CTL_DEL, 0);
 }
 
@@ -92,7 +101,20 @@ epoll_modify(reactor_t* reactor, handler_t* h, int events) {
     if (!reactor || !reactor->data || !h) {
         return -1;
     }
-    return _epoll_set((epoll_t*)reactor->data, h, EPOLL_CTL_MOD, events);
+    epoll_t* epoll = (epoll_t*)reactor->data;
+    if (!reactor_slots_check(&epoll->slots, h)) {
+        return -1;
+    }
+    return _epoll_set(epoll, h, EPOLL_CTL_MOD, events);
+}
+
+int
+epoll_edge(reactor_t* reactor, int enable) {
+    if (!reactor || !reactor->data) {
+        return -1;
+    }
+    ((epoll_t*)reactor->data)->edge = enable ? 1 : 0;
+    return 0;
 }
 
 //  return = 0, success & process
@@ -110,16 +132,21 @@ epoll_dispatch(reactor_t* reactor, int ms) {
     }
     for (int i = 0; i < res; i++) {
         int type = epoll->events[i].events;
-        handler_t* h = (handler_t*)epoll->events[i].data.ptr;
-        // check if expired
-        if (0 == slist_find(epoll->expired, h))
+        uint64_t data = epoll->events[i].data.u64;
+        // unregistered in this loop
+        handler_t* h = reactor_slots_get(&epoll->slots, data);
+        if (!h)
             continue;
+        int more = 0;
         if ((EPOLLIN & type) || (EPOLLHUP & type)) {
             int ret = h->in_func(h);
             if (ret < 0) {
                 h->close_func(h);
                 continue;
             }
+            more |= ret;
+            if (!reactor_slots_get(&epoll->slots, data))
+                continue;
         }
         if (EPOLLOUT & type) {
             int ret = h->out_func(h);
@@ -127,13 +154,19 @@ epoll_dispatch(reactor_t* reactor, int ms) {
                 h->close_func(h);
                 continue;
             }
+            more |= ret;
+            if (!reactor_slots_get(&epoll->slots, data))
+                continue;
         }
         if (EPOLLERR & type) {
             h->close_func(h);
+            continue;
+        }
+        // stopped by budget, modify re-arms another edge if still ready
+        if (more > 0 && epoll->edge && reactor_slots_get(&epoll->slots, data)) {
+            _epoll_set(epoll, h, EPOLL_CTL_MOD, h->events);
         }
     }
-    // clean expired list
-    slist_clean(epoll->expired);
     return res;
 }
 
@@ -141,7 +174,7 @@ void
 epoll_release(reactor_t* reactor) {
     if (reactor && reactor->data) {
         epoll_t* epoll = (epoll_t*)(reactor->data);
-        slist_release(epoll->expired);
+        reactor_slots_release(&epoll->slots);
         close(epoll->epoll_fd);
         epoll->epoll_fd = -1;
         FREE(epoll);
@@ -157,6 +190,7 @@ reactor_impl_t reactor_epoll = {
     epoll_unregister,
     epoll_modify,
     epoll_dispatch,
+    epoll_edge,
 };
 
 #endif
@@ -0,0 +1,384 @@
+#include <assert.h>
+#include <pthread.h>
+#if defined(OS_LINUX)
+#include <sched.h>
+#endif
+
+#include "core/atom.h"
+#include "core/thread.h"
+#include "net/acceptor.h"
+#include "net/reactor_group.h"
+
+// closure, or a handed off connection if func is NULL
+typedef struct rgroup_post_t {
+    rgroup_func func;
+    void* arg;
+    sock_t fd;
+    struct rgroup_post_t* next;
+} post_t;
+
+typedef struct rgroup_loop_t {
+    // handler must be at head
+    handler_t wake;
+    rgroup_t* g;
+    int index;
+    reactor_t* r;
+    pthread_t tid;
+    int started;
+    int running;
+    acc_t* acc;
+    // posted closures, woken up by pipe
+    void* lock;
+    post_t* head;
+    post_t* tail;
+    sock_t pipe[2];
+} loop_t;
+
+struct rgroup_t {
+    int pin;
+    int started;
+    rgroup_accept_func on_accept;
+    void* accept_arg;
+    // round-robin for handoff
+    uint32_t next;
+    int nloops;
+    loop_t loops[0];
+};
+
+static void
+_rgroup_accepted(loop_t* l, sock_t fd) {
+    if (l->g->on_accept) {
+        l->g->on_accept(l->r, fd, l->g->accept_arg);
+    } else {
+        sock_close(fd);
+    }
+}
+
+static void
+_rgroup_notify(loop_t* l) {
+    char c = 0;
+    // pipe full means it's notified already
+    ssize_t n = write(l->pipe[1], &c, 1);
+    (void)n;
+}
+
+static int
+_rgroup_push(loop_t* l, rgroup_func func, void* arg, sock_t fd) {
+    post_t* p = (post_t*)MALLOC(sizeof(post_t));
+    if (!p)
+        return -1;
+    p->func = func;
+    p->arg = arg;
+    p->fd = fd;
+    p->next = NULL;
+
+    thread_lock(l->lock);
+    int empty = l->head ? 0 : 1;
+    if (l->tail) {
+        l->tail->next = p;
+    } else {
+        l->head = p;
+    }
+    l->tail = p;
+    thread_unlock(l->lock);
+
+    // the loop drains pipe before taking the queue, so one byte is enough
+    if (empty) {
+        _rgroup_notify(l);
+    }
+    return 0;
+}
+
+static int
+_rgroup_wake(handler_t* h) {
+    loop_t* l = (loop_t*)h;
+    char buf[64];
+    while (read(l->pipe[0], buf, sizeof(buf)) > 0);
+
+    thread_lock(l->lock);
+    post_t* p = l->head;
+    l->head = l->tail = NULL;
+    thread_unlock(l->lock);
+
+    while (p) {
+        post_t* next = p->next;
+        if (p->func) {
+            p->func(l->r, p->arg);
+        } else {
+            _rgroup_accepted(l, p->fd);
+        }
+        FREE(p);
+        p = next;
+    }
+    return 0;
+}
+
+static int
+_rgroup_wake_close(handler_t* h) {
+    return 0;
+}
+
+static void*
+_rgroup_run(void* arg) {
+    loop_t* l = (loop_t*)arg;
+#if defined(OS_LINUX)
+    if (l->g->pin) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(l->index % (cores > 0 ? cores : 1), &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+#endif
+    while (atom_load_acquire(&l->running)) {
+        reactor_dispatch(l->r, RGROUP_DISPATCH_MS);
+    }
+    return NULL;
+}
+
+static int
+_rgroup_loop_init(rgroup_t* g, int index) {
+    loop_t* l = &g->loops[index];
+    memset(l, 0, sizeof(*l));
+    l->g = g;
+    l->index = index;
+    l->pipe[0] = l->pipe[1] = INVALID_SOCK;
+
+    l->r = reactor_create();
+    if (!l->r) {
+        goto LOOP_FAIL;
+    }
+    l->lock = thread_lock_alloc();
+    if (!l->lock) {
+        goto LOOP_FAIL;
+    }
+    if (pipe(l->pipe) < 0) {
+        l->pipe[0] = l->pipe[1] = INVALID_SOCK;
+        goto LOOP_FAIL;
+    }
+    if (sock_set_nonblock(l->pipe[0]) < 0 || sock_set_nonblock(l->pipe[1]) < 0) {
+        goto LOOP_FAIL;
+    }
+    l->wake.fd = l->pipe[0];
+    l->wake.in_func = _rgroup_wake;
+    l->wake.close_func = _rgroup_wake_close;
+    if (reactor_register(l->r, &l->wake, EVENT_IN) < 0) {
+        goto LOOP_FAIL;
+    }
+    return 0;
+
+LOOP_FAIL:
+    return -1;
+}
+
+static void
+_rgroup_loop_release(loop_t* l) {
+    if (l->acc) {
+        acc_release(l->acc);
+        l->acc = NULL;
+    }
+    post_t* p = l->head;
+    while (p) {
+        post_t* next = p->next;
+        if (!p->func) {
+            sock_close(p->fd);
+        }
+        FREE(p);
+        p = next;
+    }
+    l->head = l->tail = NULL;
+    if (l->r) {
+        if (l->wake.in_func) {
+            reactor_unregister(l->r, &l->wake);
+        }
+        reactor_release(l->r);
+        l->r = NULL;
+    }
+    if (l->pipe[0] != INVALID_SOCK) {
+        close(l->pipe[0]);
+        close(l->pipe[1]);
+    }
+    if (l->lock) {
+        thread_lock_free(l->lock);
+        l->lock = NULL;
+    }
+}
+
+rgroup_t*
+rgroup_create(int loops, int pin) {
+    if (loops <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        loops = cores > 0 ? (int)cores : 1;
+    }
+    if (loops > RGROUP_MAX_LOOPS) {
+        loops = RGROUP_MAX_LOOPS;
+    }
+    rgroup_t* g = (rgroup_t*)MALLOC(sizeof(rgroup_t) + sizeof(loop_t) * loops);
+    if (!g)
+        return NULL;
+    memset(g, 0, sizeof(rgroup_t));
+    g->pin = pin;
+    for (int i = 0; i < loops; ++ i) {
+        // counted first, so a failed loop is released too
+        g->nloops = i + 1;
+        if (_rgroup_loop_init(g, i) < 0) {
+            rgroup_release(g);
+            return NULL;
+        }
+    }
+    return g;
+}
+
+void
+rgroup_release(rgroup_t* g) {
+    if (g) {
+        rgroup_stop(g);
+        for (int i = 0; i < g->nloops; ++ i) {
+            _rgroup_loop_release(&g->loops[i]);
+        }
+        FREE(g);
+    }
+}
+
+int
+rgroup_size(rgroup_t* g) {
+    return g ? g->nloops : 0;
+}
+
+reactor_t*
+rgroup_reactor(rgroup_t* g, int loop) {
+    return (g && loop >= 0 && loop < g->nloops) ? g->loops[loop].r : NULL;
+}
+
+static int
+_rgroup_accept(sock_t fd, void* arg, const sockaddr_t* peer) {
+    _rgroup_accepted((loop_t*)arg, fd);
+    return 0;
+}
+
+// accepted by loop 0, others are waken up
+static int
+_rgroup_handoff(sock_t fd, void* arg, const sockaddr_t* peer) {
+    rgroup_t* g = (rgroup_t*)arg;
+    loop_t* l = &g->loops[g->next ++ % g->nloops];
+    if (l->index == 0) {
+        _rgroup_accepted(l, fd);
+    } else if (_rgroup_push(l, NULL, NULL, fd) < 0) {
+        sock_close(fd);
+    }
+    return 0;
+}
+
+// acceptor is released by reactor
+static void
+_rgroup_acc_close(sock_t fd, void* arg) {
+    ((loop_t*)arg)->acc = NULL;
+}
+
+static acc_t*
+_rgroup_acc(loop_t* l, int reuseport) {
+    acc_t* a = acc_create(l->r);
+    if (!a)
+        return NULL;
+    if (reuseport && acc_set_reuseport(a) < 0) {
+        acc_release(a);
+        return NULL;
+    }
+    if (reuseport) {
+        acc_set_read_func(a, _rgroup_accept, l);
+    } else {
+        acc_set_read_func(a, _rgroup_handoff, l->g);
+    }
+    acc_set_close_func(a, _rgroup_acc_close, l);
+    return a;
+}
+
+int
+rgroup_listen(rgroup_t* g, sockaddr_t* laddr, rgroup_accept_func on_accept, void* arg) {
+    if (!g || !laddr || !on_accept || g->started || g->loops[0].acc) {
+        return -1;
+    }
+    g->on_accept = on_accept;
+    g->accept_arg = arg;
+
+    // only linux balances reuseport listeners
+    int reuseport = 0;
+#if defined(OS_LINUX) && defined(SO_REUSEPORT)
+    reuseport = g->nloops > 1 ? 1 : 0;
+#endif
+    if (reuseport) {
+        for (int i = 0; i < g->nloops; ++ i) {
+            loop_t* l = &g->loops[i];
+            l->acc = _rgroup_acc(l, 1);
+            if (!l->acc || acc_start(l->acc, laddr) < 0) {
+                for (int j = 0; j <= i; ++ j) {
+                    acc_release(g->loops[j].acc);
+                    g->loops[j].acc = NULL;
+                }
+                // fallback to handoff, as kernel may not support
+                reuseport = 0;
+                break;
+            }
+        }
+    }
+    if (!reuseport) {
+        loop_t* l = &g->loops[0];
+        l->acc = _rgroup_acc(l, 0);
+        if (!l->acc) {
+            return -1;
+        }
+        if (acc_start(l->acc, laddr) < 0) {
+            acc_release(l->acc);
+            l->acc = NULL;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int
+rgroup_start(rgroup_t* g) {
+    if (!g || g->started)
+        return -1;
+    g->started = 1;
+    for (int i = 0; i < g->nloops; ++ i) {
+        loop_t* l = &g->loops[i];
+        l->running = 1;
+        if (pthread_create(&l->tid, NULL, _rgroup_run, l)) {
+            l->running = 0;
+            rgroup_stop(g);
+            return -1;
+        }
+        l->started = 1;
+    }
+    return 0;
+}
+
+int
+rgroup_stop(rgroup_t* g) {
+    if (!g || !g->started)
+        return -1;
+    for (int i = 0; i < g->nloops; ++ i) {
+        loop_t* l = &g->loops[i];
+        if (l->started) {
+            atom_store_release(&l->running, 0);
+            _rgroup_notify(l);
+        }
+    }
+    for (int i = 0; i < g->nloops; ++ i) {
+        loop_t* l = &g->loops[i];
+        if (l->started) {
+            pthread_join(l->tid, NULL);
+            l->started = 0;
+        }
+    }
+    g->started = 0;
+    return 0;
+}
+
+int
+rgroup_post(rgroup_t* g, int loop, rgroup_func func, void* arg) {
+    if (!g || loop < 0 || loop >= g->nloops || !func)
+        return -1;
+    return _rgroup_push(&g->loops[loop], func, arg, INVALID_SOCK);
+}
@@ -0,0 +1,53 @@
+#ifndef REACTOR_GROUP_H_
+#define REACTOR_GROUP_H_
+
+//
+// reactor loops, one per thread (maybe pinned to cores)
+// a listener is balanced by SO_REUSEPORT with an acceptor per loop,
+// or accepted by loop 0 and handed off round-robin if not supported.
+// closures could be posted to any loop from any thread,
+// handlers should be registered & released in their own loop.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "core/os_def.h"
+#include "net/sock.h"
+#include "net/reactor.h"
+
+#define RGROUP_MAX_LOOPS 64
+#define RGROUP_DISPATCH_MS 100
+
+typedef struct rgroup_t rgroup_t;
+
+// run in loop thread
+typedef void (*rgroup_func)(reactor_t*, void* arg);
+// connection accepted, run in the loop it belongs to, fd is owned by callee
+typedef void (*rgroup_accept_func)(reactor_t*, sock_t, void* arg);
+
+// loops <= 0 means cores online
+// pin: loop i is pinned to core i (linux only)
+rgroup_t* rgroup_create(int loops, int pin);
+// stop & release, pending closures are dropped
+void rgroup_release(rgroup_t*);
+
+int rgroup_size(rgroup_t*);
+reactor_t* rgroup_reactor(rgroup_t*, int loop);
+
+// listen before start, one listener per group
+int rgroup_listen(rgroup_t*, sockaddr_t* laddr, rgroup_accept_func, void* arg);
+
+int rgroup_start(rgroup_t*);
+// wait until loops exit
+int rgroup_stop(rgroup_t*);
+
+// thread safe, run in loop's thread orderly
+int rgroup_post(rgroup_t*, int loop, rgroup_func, void* arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // REACTOR_GROUP_H_
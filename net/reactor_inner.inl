@@ -11,6 +11,7 @@ struct reactor_t {
     const char* name;
     void* data;
     const struct reactor_impl_t* impl;
+    timerheap_t* timer;
 };
 
 typedef struct reactor_impl_t {
@@ -24,10 +25,97 @@ typedef struct reactor_impl_t {
     //  return < 0, fail
     //  return > 0, noting to do
     int (*dispatch)(reactor_t*, int);
+
+    // NULL means not supported
+    int (*edge)(reactor_t*, int);
 } reactor_impl_t;
 
+// registered handlers for epoll & io_uring, events carry slot & generation,
+// so events of handlers unregistered (maybe freed) in dispatch are skipped
+// without touching them, and in O(1)
+#define REACTOR_SLOTS_INIT 1024
+
+typedef struct reactor_slot_t {
+    handler_t* h;
+    uint32_t gen;
+    // free list
+    int next;
+} reactor_slot_t;
+
+typedef struct reactor_slots_t {
+    reactor_slot_t* slots;
+    int nslots;
+    int free;
+} reactor_slots_t;
+
+static inline void
+reactor_slots_init(reactor_slots_t* s) {
+    s->slots = NULL;
+    s->nslots = 0;
+    s->free = -1;
+}
+
+static inline void
+reactor_slots_release(reactor_slots_t* s) {
+    FREE(s->slots);
+    reactor_slots_init(s);
+}
+
+// double slots if all used
+static inline int
+reactor_slots_alloc(reactor_slots_t* s, handler_t* h) {
+    if (s->free < 0) {
+        int n = s->nslots > 0 ? s->nslots * 2 : REACTOR_SLOTS_INIT;
+        reactor_slot_t* slots = (reactor_slot_t*)REALLOC(s->slots, sizeof(reactor_slot_t) * n);
+        if (!slots) {
+            return -1;
+        }
+        for (int i = s->nslots; i < n; ++ i) {
+            slots[i].h = NULL;
+            slots[i].gen = 0;
+            slots[i].next = (i + 1 < n) ? i + 1 : -1;
+        }
+        s->free = s->nslots;
+        s->slots = slots;
+        s->nslots = n;
+    }
+    int slot = s->free;
+    s->free = s->slots[slot].next;
+    s->slots[slot].h = h;
+    h->slot = slot;
+    return slot;
+}
+
+// generation changes, so events on the way are stale
+static inline void
+reactor_slots_free(reactor_slots_t* s, int slot) {
+    s->slots[slot].h = NULL;
+    ++ s->slots[slot].gen;
+    s->slots[slot].next = s->free;
+    s->free = slot;
+}
+
+// is h registered
+static inline int
+reactor_slots_check(reactor_slots_t* s, handler_t* h) {
+    return h->slot >= 0 && h->slot < s->nslots && s->slots[h->slot].h == h;
+}
+
+static inline uint64_t
+reactor_slots_data(reactor_slots_t* s, handler_t* h) {
+    return ((uint64_t)s->slots[h->slot].gen << 32) | (uint32_t)h->slot;
+}
+
+// NULL if stale
+static inline handler_t*
+reactor_slots_get(reactor_slots_t* s, uint64_t data) {
+    reactor_slot_t* slot = &s->slots[(uint32_t)data];
+    return slot->gen == (uint32_t)(data >> 32) ? slot->h : NULL;
+}
+
 #if defined(OS_LINUX)
 extern reactor_impl_t reactor_epoll;
+extern reactor_impl_t reactor_uring;
 #elif defined(OS_CYGWIN)
 extern reactor_impl_t reactor_select;
 #elif defined(OS_MAC)
@@ -161,6 +161,7 @@ reactor_impl_t reactor_kqueue =
     kqueue_unregister,
     kqueue_modify,
     kqueue_dispatch,
+    NULL,
 };
 
 #endif
@@ -206,6 +206,7 @@ reactor_impl_t reactor_select = {
     select_unregister,
     select_modify,
     select_dispatch,
+    NULL,
 };
 
 #endif
@@ -0,0 +1,393 @@
+#include "core/os_def.h"
+#include "core/atom.h"
+#include "net/reactor.h"
+#include "net/reactor_inner.inl"
+
+#if defined(OS_LINUX)
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+// one-shot poll per handler, re-armed after dispatch, as level-triggered
+#define URING_ENTRIES 4096
+// user data of poll removing, never a handler
+#define URING_DATA_NONE UINT64_MAX
+
+typedef struct uring_t {
+    int fd;
+    // submission ring, tail is published at once,
+    // and kernel consumes it by io_uring_enter
+    uint32_t* sq_head;
+    uint32_t* sq_tail;
+    uint32_t* sq_array;
+    uint32_t sq_mask;
+    uint32_t sq_entries;
+    struct io_uring_sqe* sqes;
+    uint32_t pending;
+    // completion ring
+    uint32_t* cq_head;
+    uint32_t* cq_tail;
+    uint32_t cq_mask;
+    struct io_uring_cqe* cqes;
+    // mapped
+    void* sq_ptr;
+    size_t sq_size;
+    void* cq_ptr;
+    size_t cq_size;
+    size_t sqes_size;
+    reactor_slots_t slots;
+    // handler in dispatching, its poll is re-armed after callbacks
+    uint64_t current;
+} uring_t;
+
+static const char* URING_NAME = "io_uring";
+
+static inline int
+_uring_enter(uring_t* u, uint32_t submit, uint32_t wait, uint32_t flags, void* arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, u->fd, submit, wait, flags, arg, argsz);
+}
+
+static int
+_uring_submit(uring_t* u) {
+    if (u->pending == 0) {
+        return 0;
+    }
+    int ret = _uring_enter(u, u->pending, 0, 0, NULL, 0);
+    if (ret < 0) {
+        return -1;
+    }
+    u->pending -= (uint32_t)ret;
+    return ret;
+}
+
+// submit pending if ring is full
+static struct io_uring_sqe*
+_uring_sqe(uring_t* u) {
+    uint32_t tail = *u->sq_tail;
+    if (tail - atom_load_acquire(u->sq_head) >= u->sq_entries) {
+        _uring_submit(u);
+        if (tail - atom_load_acquire(u->sq_head) >= u->sq_entries) {
+            return NULL;
+        }
+    }
+    struct io_uring_sqe* sqe = &u->sqes[tail & u->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+static void
+_uring_push(uring_t* u) {
+    uint32_t tail = *u->sq_tail;
+    u->sq_array[tail & u->sq_mask] = tail & u->sq_mask;
+    atom_store_release(u->sq_tail, tail + 1);
+    ++ u->pending;
+}
+
+static int
+_uring_poll(uring_t* u, handler_t* h, int events) {
+    struct io_uring_sqe* sqe = _uring_sqe(u);
+    if (!sqe) {
+        return -1;
+    }
+    // POLLERR & POLLHUP are always reported
+    uint32_t mask = 0;
+    if (EVENT_IN & events) {
+        mask |= POLLIN;
+    }
+    if (EVENT_OUT & events) {
+        mask |= POLLOUT;
+    }
+#if defined(OS_BIG_ENDIAN)
+    mask = (mask << 16) | (mask >> 16);
+#endif
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = h->fd;
+    sqe->poll32_events = mask;
+    sqe->user_data = reactor_slots_data(&u->slots, h);
+    _uring_push(u);
+    return 0;
+}
+
+static int
+_uring_poll_remove(uring_t* u, uint64_t data) {
+    struct io_uring_sqe* sqe = _uring_sqe(u);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = data;
+    sqe->user_data = URING_DATA_NONE;
+    _uring_push(u);
+    return 0;
+}
+
+static void
+_uring_unmap(uring_t* u) {
+    if (u->sqes) {
+        munmap(u->sqes, u->sqes_size);
+    }
+    if (u->cq_ptr && u->cq_ptr != u->sq_ptr) {
+        munmap(u->cq_ptr, u->cq_size);
+    }
+    if (u->sq_ptr) {
+        munmap(u->sq_ptr, u->sq_size);
+    }
+    u->sqes = NULL;
+    u->cq_ptr = u->sq_ptr = NULL;
+}
+
+static int
+_uring_map(uring_t* u, struct io_uring_params* p) {
+    u->sq_size = p->sq_off.array + p->sq_entries * sizeof(uint32_t);
+    u->cq_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+    if (p->features & IORING_FEAT_SINGLE_MMAP) {
+        if (u->cq_size > u->sq_size) {
+            u->sq_size = u->cq_size;
+        }
+        u->cq_size = u->sq_size;
+    }
+    void* ptr = mmap(NULL, u->sq_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == ptr) {
+        return -1;
+    }
+    u->sq_ptr = ptr;
+    if (p->features & IORING_FEAT_SINGLE_MMAP) {
+        u->cq_ptr = u->sq_ptr;
+    } else {
+        ptr = mmap(NULL, u->cq_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+        if (MAP_FAILED == ptr) {
+            return -1;
+        }
+        u->cq_ptr = ptr;
+    }
+    u->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+    ptr = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (MAP_FAILED == ptr) {
+        return -1;
+    }
+    u->sqes = (struct io_uring_sqe*)ptr;
+
+    char* sq = (char*)u->sq_ptr;
+    u->sq_head = (uint32_t*)(sq + p->sq_off.head);
+    u->sq_tail = (uint32_t*)(sq + p->sq_off.tail);
+    u->sq_array = (uint32_t*)(sq + p->sq_off.array);
+    u->sq_mask = *(uint32_t*)(sq + p->sq_off.ring_mask);
+    u->sq_entries = *(uint32_t*)(sq + p->sq_off.ring_entries);
+    char* cq = (char*)u->cq_ptr;
+    u->cq_head = (uint32_t*)(cq + p->cq_off.head);
+    u->cq_tail = (uint32_t*)(cq + p->cq_off.tail);
+    u->cq_mask = *(uint32_t*)(cq + p->cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe*)(cq + p->cq_off.cqes);
+    return 0;
+}
+
+int
+uring_init(reactor_t* reactor) {
+    if (!reactor || reactor->data) {
+        return -1;
+    }
+    uring_t* u = (uring_t*)MALLOC(sizeof(*u));
+    if (!u) {
+        goto URING_FAIL;
+    }
+    memset(u, 0, sizeof(*u));
+    reactor_slots_init(&u->slots);
+    u->current = URING_DATA_NONE;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    u->fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (u->fd < 0) {
+        goto URING_FAIL1;
+    }
+    // dispatch timeout by enter argument (>= 5.11)
+    if (!(p.features & IORING_FEAT_EXT_ARG)) {
+        goto URING_FAIL2;
+    }
+    if (_uring_map(u, &p) < 0) {
+        goto URING_FAIL2;
+    }
+    reactor->data = (void*)u;
+    reactor->name = URING_NAME;
+    return 0;
+
+URING_FAIL2:
+    _uring_unmap(u);
+    close(u->fd);
+URING_FAIL1:
+    FREE(u);
+URING_FAIL:
+    return -1;
+}
+
+int
+uring_register(reactor_t* reactor, handler_t* h, int events) {
+    if (!reactor || !reactor->data || !h) {
+        return -1;
+    }
+    uring_t* u = (uring_t*)reactor->data;
+    int slot = reactor_slots_alloc(&u->slots, h);
+    if (slot < 0) {
+        return -1;
+    }
+    if (_uring_poll(u, h, events) < 0) {
+        reactor_slots_free(&u->slots, slot);
+        return -1;
+    }
+    return 0;
+}
+
+int
+uring_unregister(reactor_t* reactor, handler_t* h) {
+    if (!reactor || !reactor->data || !h) {
+        return -1;
+    }
+    uring_t* u = (uring_t*)reactor->data;
+    if (!reactor_slots_check(&u->slots, h)) {
+        return -1;
+    }
+    uint64_t data = reactor_slots_data(&u->slots, h);
+    reactor_slots_free(&u->slots, h->slot);
+    // the poll is consumed already in dispatching
+    if (data == u->current) {
+        return 0;
+    }
+    return _uring_poll_remove(u, data);
+}
+
+int
+uring_modify(reactor_t* reactor, handler_t* h, int events) {
+    if (!reactor || !reactor->data || !h) {
+        return -1;
+    }
+    uring_t* u = (uring_t*)reactor->data;
+    if (!reactor_slots_check(&u->slots, h)) {
+        return -1;
+    }
+    // re-armed by h->events after callbacks
+    uint64_t data = reactor_slots_data(&u->slots, h);
+    if (data == u->current) {
+        return 0;
+    }
+    if (_uring_poll_remove(u, data) < 0) {
+        return -1;
+    }
+    // new generation, so completion of the removed poll is stale
+    ++ u->slots.slots[h->slot].gen;
+    return _uring_poll(u, h, events);
+}
+
+//  return = 0, success & process
+//  return < 0, fail
+//  return > 0, noting to do
+int
+uring_dispatch(reactor_t* reactor, int ms) {
+    if (!reactor || !reactor->data) {
+        return -1;
+    }
+    uring_t* u = (uring_t*)(reactor->data);
+
+    // submit & wait in one call, completions overflowed (EBUSY) are reaped first
+    uint32_t head = *u->cq_head;
+    if (head == atom_load_acquire(u->cq_tail) && ms != 0) {
+        struct __kernel_timespec ts;
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.sigmask_sz = _NSIG / 8;
+        if (ms > 0) {
+            ts.tv_sec = ms / 1000;
+            ts.tv_nsec = (ms % 1000) * 1000000;
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+        }
+        int ret = _uring_enter(u, u->pending, 1,
+                               IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+        if (ret > 0) {
+            u->pending -= (uint32_t)ret;
+        } else if (ret < 0 && ETIME != errno && EINTR != errno && EBUSY != errno) {
+            return -errno;
+        }
+    } else if (_uring_submit(u) < 0 && EINTR != errno && EBUSY != errno) {
+        return -errno;
+    }
+
+    int res = 0;
+    uint32_t tail = atom_load_acquire(u->cq_tail);
+    while (head != tail) {
+        struct io_uring_cqe* cqe = &u->cqes[head & u->cq_mask];
+        uint64_t data = cqe->user_data;
+        int32_t type = cqe->res;
+        // release the entry before callbacks, which may submit
+        atom_store_release(u->cq_head, ++ head);
+        if (URING_DATA_NONE == data) {
+            continue;
+        }
+        // unregistered or modified
+        handler_t* h = reactor_slots_get(&u->slots, data);
+        if (!h) {
+            continue;
+        }
+        ++ res;
+        if (type < 0) {
+            h->close_func(h);
+            continue;
+        }
+        u->current = data;
+        if ((POLLIN & type) || (POLLHUP & type)) {
+            if (h->in_func(h) < 0) {
+                h->close_func(h);
+                continue;
+            }
+            if (!reactor_slots_get(&u->slots, data))
+                continue;
+        }
+        if (POLLOUT & type) {
+            if (h->out_func(h) < 0) {
+                h->close_func(h);
+                continue;
+            }
+            if (!reactor_slots_get(&u->slots, data))
+                continue;
+        }
+        if (POLLERR & type) {
+            h->close_func(h);
+            continue;
+        }
+        u->current = URING_DATA_NONE;
+        _uring_poll(u, h, h->events);
+    }
+    u->current = URING_DATA_NONE;
+    return res;
+}
+
+void
+uring_release(reactor_t* reactor) {
+    if (reactor && reactor->data) {
+        uring_t* u = (uring_t*)(reactor->data);
+        reactor_slots_release(&u->slots);
+        _uring_unmap(u);
+        close(u->fd);
+        u->fd = -1;
+        FREE(u);
+        reactor->data = 0;
+        reactor->name = NULL;
+    }
+}
+
+reactor_impl_t reactor_uring = {
+    uring_init,
+    uring_release,
+    uring_register,
+    uring_unregister,
+    uring_modify,
+    uring_dispatch,
+    NULL,
+};
+
+#endif
+
@@ -67,6 +67,23 @@ sock_accept(sock_t sock, sockaddr_t* addr) {
     return accept(sock, addr, &addr_len);
 }
 
+sock_t
+sock_accept_nonblock(sock_t sock, sockaddr_t* addr) {
+    socklen_t addr_len = sizeof(sockaddr_t);
+#if defined(OS_LINUX)
+    return accept4(sock, addr, &addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+    sock_t nsock = accept(sock, addr, &addr_len);
+    if (nsock == INVALID_SOCK)
+        return INVALID_SOCK;
+    if (sock_set_nonblock(nsock) < 0 || fcntl(nsock, F_SETFD, FD_CLOEXEC) < 0) {
+        sock_close(nsock);
+        return INVALID_SOCK;
+    }
+    return nsock;
+#endif
+}
+
 inline int
 sock_close(sock_t sock) {
     if (sock < 0)
@@ -78,6 +95,19 @@ sock_close(sock_t sock) {
     return ret;
 }
 
+int
+sock_writev(sock_t sock, const struct iovec* iov, int iovcnt) {
+    if (sock < 0)
+        return -1;
+    ssize_t ret;
+    do {
+        ret = writev(sock, iov, iovcnt);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0)
+        return (EAGAIN == errno || EWOULDBLOCK == errno) ? 0 : -1;
+    return (int)ret;
+}
+
 inline int
 sock_set_nonblock(sock_t sock) {
     if (sock < 0)
@@ -111,6 +141,19 @@ sock_set_reuseaddr(sock_t sock) {
     return setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char*)&optval, optlen);
 }
 
+inline int
+sock_set_reuseport(sock_t sock) {
+    if (sock < 0)
+        return -1;
+#if defined(SO_REUSEPORT)
+    int optval = 1;
+    socklen_t optlen = sizeof(optval);
+    return setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (const char*)&optval, optlen);
+#else
+    return -1;
+#endif
+}
+
 inline int
 sock_set_nodelay(sock_t sock) {
     if (sock < 0)
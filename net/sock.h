@@ -11,6 +11,7 @@ extern "C" {
 #include <sys/time.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <netinet/tcp.h>
 #include <errno.h>
 
@@ -30,11 +31,18 @@ sock_t sock_udp();
 int sock_nonblock_connect(sock_t sock, const char* ip_str, uint16_t port, struct timeval);
 int sock_listen(sock_t sock, sockaddr_t* addr);
 sock_t sock_accept(sock_t sock, sockaddr_t* addr);
+// accepted socket is nonblocking & close-on-exec, by one syscall on linux
+sock_t sock_accept_nonblock(sock_t sock, sockaddr_t* addr);
 int sock_close(sock_t sock);
 
+// nonblocking socket, return bytes written, 0 if EAGAIN, < 0 if fail
+int sock_writev(sock_t sock, const struct iovec* iov, int iovcnt);
+
 int sock_set_nonblock(sock_t sock);
 int sock_set_block(sock_t sock);
 int sock_set_reuseaddr(sock_t sock);
+// load balanced listeners on the same address, before listen
+int sock_set_reuseport(sock_t sock);
 int sock_set_nodelay(sock_t sock);
 int sock_set_sndbuf(sock_t sock, int size);
 int sock_set_rcvbuf(sock_t sock, int size);
@@ -5,6 +5,8 @@
 #include "wsconn.h"
 
 #define WSCONN_BUFFER_SIZE (64 * 1024)
+// reads per event, so a busy socket doesn't starve others
+#define WSCONN_READ_BUDGET 16
 
 struct wsconn_t {
     handler_t h;
@@ -528,41 +530,14 @@ _wsconn_frame(wsconn_t* con, char* data, int sz) {
     return (int)frame.payload_len + frame.mask_shift + (frame.is_masked ? 4 : 0);
 }
 
+// handshake, then frames as many as possible
+// return < 0 means fail, reactor will close connection
 static int
-_wsconn_read(struct handler_t* h) {
-    char* buffer;
-    int nread, nwrite, res;
-    wsconn_t* con = (wsconn_t*)h;
-    nwrite = buffer_write_len(con->rbuf);
-    assert(nwrite >= 0);
-
-    // read buffer, fail
-    if (0 == nwrite) {
-        printf("fd[%d] read buffer full fail\n", con->h.fd);
-        return -1;
-    }
-
-    // still full, read fail, reactor will close connector
-    if (0 == nwrite) return -1;
-
-    // read socket
-    buffer = buffer_write_buffer(con->rbuf);
-    res = read(con->h.fd, buffer, nwrite);
-    if (res < 0) {
-        // can't read now
-        if (EAGAIN == errno || EINTR == errno) {
-            return 0;
-        } else {
-            printf("fd[%d] read errno=%d\n", con->h.fd, errno);
-            return -errno;
-        }
-    } else if (0 == res) {
-        return -1;
-    } else {
-        buffer_write_nocopy(con->rbuf, res);
-        buffer = buffer_read_buffer(con->rbuf);
-        nread = buffer_read_len(con->rbuf);
-        assert(buffer && nread);
+_wsconn_process(wsconn_t* con) {
+    while (buffer_read_len(con->rbuf) > 0) {
+        char* buffer = buffer_read_buffer(con->rbuf);
+        int nread = buffer_read_len(con->rbuf);
+        int res = 0;
         if (0 != wsconn_established(con)) {
             int from = 0;
             while (from <= nread - 4) {
@@ -578,36 +553,85 @@ _wsconn_read(struct handler_t* h) {
         } else {
             res = _wsconn_frame(con, buffer, nread);
         }
-        if (res < 0) return res;
+        // not enough data
+        if (res <= 0) return res;
         buffer_read_nocopy(con->rbuf, res);
     }
     return 0;
 }
 
+// read until EAGAIN (or a short read), at most budget times
+// return > 0 if stopped by budget
+static int
+_wsconn_read(struct handler_t* h) {
+    char* buffer;
+    int nwrite, res, i;
+    wsconn_t* con = (wsconn_t*)h;
+    for (i = 0; i < WSCONN_READ_BUDGET; ++ i) {
+        // stopped in callback
+        if (con->h.fd == INVALID_SOCK) return 0;
+        nwrite = buffer_write_len(con->rbuf);
+        assert(nwrite >= 0);
+
+        // read buffer full, fail
+        if (0 == nwrite) {
+            printf("fd[%d] read buffer full fail\n", con->h.fd);
+            return -1;
+        }
+
+        // read socket
+        buffer = buffer_write_buffer(con->rbuf);
+        res = read(con->h.fd, buffer, nwrite);
+        if (res < 0) {
+            if (EINTR == errno) continue;
+            // can't read now, idle storage is given back
+            if (EAGAIN == errno || EWOULDBLOCK == errno) {
+                buffer_shrink(con->rbuf);
+                buffer_shrink(con->rrbuf);
+                return 0;
+            }
+            printf("fd[%d] read errno=%d\n", con->h.fd, errno);
+            return -errno;
+        } else if (0 == res) {
+            return -1;
+        }
+        buffer_write_nocopy(con->rbuf, res);
+        if (_wsconn_process(con) < 0) return -1;
+
+        // socket is drained
+        if (res < nwrite) {
+            buffer_shrink(con->rbuf);
+            buffer_shrink(con->rrbuf);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// write until buffer is empty or socket is full
 static int
 _wsconn_write(struct handler_t* h) {
     char* buffer;
     int nwrite, res;
     wsconn_t* con = (wsconn_t*)h;
-    nwrite = buffer_read_len(con->wbuf);
-    if (nwrite <= 0) return 0;
-    buffer = buffer_read_buffer(con->wbuf);
-    res = write(con->h.fd, buffer, nwrite);
-    if (res < 0) {
-        // can't write now
-        if (EAGAIN == errno || EINTR == errno) {
-            return 0;
-        } else {
+    while ((nwrite = buffer_read_len(con->wbuf)) > 0) {
+        buffer = buffer_read_buffer(con->wbuf);
+        res = write(con->h.fd, buffer, nwrite);
+        if (res < 0) {
+            if (EINTR == errno) continue;
+            // can't write now
+            if (EAGAIN == errno || EWOULDBLOCK == errno) return 0;
             printf("write %d errno=%d\n", con->h.fd, errno);
             return -errno;
+        } else if (0 == res) {
+            return -1;
         }
-    } else if (0 == res) {
-        return -1;
-    } else {
         buffer_read_nocopy(con->wbuf, res);
-        if (res == nwrite)
-            reactor_modify(con->r, &con->h, EVENT_IN);
+        if (res < nwrite) return 0;
     }
+    // all flushed, idle storage is given back
+    buffer_shrink(con->wbuf);
+    reactor_modify(con->r, &con->h, EVENT_IN);
     return 0;
 }
 
@@ -734,55 +758,48 @@ wsconn_start(wsconn_t* con) {
 // return < 0, fail maybe full
 int
 wsconn_send(wsconn_t* con, const char* buffer, int buflen) {
-    int nwrite;
-    int8_t head, sz, c;
-    int16_t len;
-    int64_t len64;
+    char head[10];
+    int nhead;
     if (!con || !buffer || buflen < 0) return -1;
     if (0 != wsconn_established(con)) return -1;
 
-    nwrite = buffer_write_len(con->wbuf);
-    // text mode
-    head = 0x81;
-    buffer_write(con->wbuf, (char*)&head, 1);
+    // text mode, length in network order
+    head[0] = (char)0x81;
     if (buflen < 126) {
-        if (nwrite < buflen + 2) return -1;
-        sz = buflen;
-        buffer_write(con->wbuf, (char*)&sz, 1);
-        buffer_write(con->wbuf, buffer, buflen);
+        head[1] = (char)buflen;
+        nhead = 2;
     } else if (buflen <= 65535) {
-        if (nwrite < buflen + 4) return -1;
-        c = 126;
-        buffer_write(con->wbuf, (char*)&c, 1);
-        len = buflen;
-#if defined(OS_LITTLE_ENDIAN)
-        buffer_write(con->wbuf, (char*)&len + 1, 1);
-        buffer_write(con->wbuf, (char*)&len, 1);
-#elif defined(OS_BIG_ENDIAN)
-        buffer_write(con->wbuf, (char*)&len, 2);
-#endif
-        buffer_write(con->wbuf, buffer, buflen);
+        head[1] = 126;
+        head[2] = (char)(buflen >> 8);
+        head[3] = (char)buflen;
+        nhead = 4;
     } else {
-        if (nwrite < buflen + 10) return -1;
-        c = 127;
-        buffer_write(con->wbuf, (char*)&c, 1);
-        len64 = buflen;
-#if defined(OS_LITTLE_ENDIAN)
-        buffer_write(con->wbuf, (char*)&len64 + 7, 1);
-        buffer_write(con->wbuf, (char*)&len64 + 6, 1);
-        buffer_write(con->wbuf, (char*)&len64 + 5, 1);
-        buffer_write(con->wbuf, (char*)&len64 + 4, 1);
-        buffer_write(con->wbuf, (char*)&len64 + 3, 1);
-        buffer_write(con->wbuf, (char*)&len64 + 2, 1);
-        buffer_write(con->wbuf, (char*)&len64 + 1, 1);
-        buffer_write(con->wbuf, (char*)&len64, 1);
-#elif defined(OS_BIG_ENDIAN)
-        buffer_write(con->wbuf, (char*)&len64, 8);
-#endif
+        uint64_t len64 = buflen;
+        head[1] = 127;
+        for (int i = 0; i < 8; ++ i)
+            head[2 + i] = (char)(len64 >> (56 - 8 * i));
+        nhead = 10;
+    }
+    if (buffer_write_len(con->wbuf) < nhead + buflen) return -1;
+
+    // nothing buffered, write at once, and arm writing only if partial
+    int nwrite = 0;
+    if (0 == buffer_read_len(con->wbuf)) {
+        struct iovec iov[2];
+        iov[0].iov_base = head;
+        iov[0].iov_len = nhead;
+        iov[1].iov_base = (void*)buffer;
+        iov[1].iov_len = buflen;
+        nwrite = sock_writev(con->h.fd, iov, 2);
+        if (nwrite < 0) return -1;
+        if (nwrite == nhead + buflen) return 0;
+    }
+    if (nwrite < nhead) {
+        buffer_write(con->wbuf, head + nwrite, nhead - nwrite);
         buffer_write(con->wbuf, buffer, buflen);
+    } else {
+        buffer_write(con->wbuf, buffer + nwrite - nhead, buflen - (nwrite - nhead));
     }
-
-    // add out events (no buffer before send)
     reactor_modify(con->r, &con->h, (EVENT_IN | EVENT_OUT));
     return 0;
 }
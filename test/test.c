@@ -10,16 +10,20 @@
 #define COLOR_RED   31
 #define COLOR_GREEN 32
 
+extern int test_base_buffer(const char*);
 extern int test_base_conhash(const char*);
 extern int test_base_bitset(const char*);
 extern int test_base_heap(const char*);
 extern int test_base_rbtree(const char*);
 extern int test_base_rbuffer(const char*);
+extern int test_base_rbuffer_nocopy(const char*);
+extern int test_base_rbuffer_mpsc(const char*);
 extern int test_base_slist(const char*);
 extern int test_base_skiplist(const char*);
 extern int test_base_skiplist_duplicate(const char*);
 extern int test_base_skiplist_find(const char*);
 extern int test_base_timer(const char*);
+extern int test_base_timer_order(const char*);
 
 extern int test_core_atomic(const char*);
 #ifdef OS_LINUX
@@ -27,17 +31,42 @@ extern int test_core_coroutine(const char*);
 #endif
 extern int test_core_fsm(const char*);
 extern int test_core_lock(const char*);
+extern int test_core_plock(const char*);
 extern int test_core_spin(const char*);
 extern int test_core_thread(const char*);
 
+extern int test_logic_bus(const char*);
+extern int test_logic_bus_wait(const char*);
+extern int test_logic_bus_wait_stress(const char*);
+extern int test_logic_bus_bcast(const char*);
+extern int test_logic_bus_stat(const char*);
+extern int test_logic_bus_pipe_size(const char*);
+extern int test_logic_bus_scale(const char*);
+extern int test_logic_bus_reclaim(const char*);
+extern int test_logic_bus_lock(const char*);
+extern int test_logic_bus_mpsc(const char*);
+extern int test_logic_bus_prio(const char*);
+extern int test_logic_bus_spill(const char*);
+extern int test_logic_rpc(const char*);
+extern int test_logic_bridge(const char*);
+extern int test_logic_bridge_connect(const char*);
+extern int test_logic_bridge_slow_connect(const char*);
 extern int test_logic_dirty(const char*);
 extern int test_logic_task(const char*);
 
 extern int test_mm_slab(const char*);
 extern int test_mm_shm(const char*);
 
+extern int test_net_acceptor_emfile(const char*);
+extern int test_net_connector_sendv(const char*);
 extern int test_net_curl(const char*);
 extern int test_net_echo(const char*);
+extern int test_net_echo_edge(const char*);
+extern int test_net_echo_uring(const char*);
+extern int test_net_reactor_stale(const char*);
+extern int test_net_reactor_stale_uring(const char*);
+extern int test_net_reactor_group(const char*);
+extern int test_net_reactor_timer(const char*);
 
 extern int test_util_base64(const char*);
 extern int test_util_cjson_text(const char*);
@@ -75,16 +104,20 @@ usage() {
 static void
 run() {
     cmd_t* cmd = cmd_create(".history", "~>");
+    cmd_register(cmd, "base buffer",                test_base_buffer);
     cmd_register(cmd, "base conhash",               test_base_conhash);
     cmd_register(cmd, "base bitset",                test_base_bitset);
     cmd_register(cmd, "base heap",                  test_base_heap);
     cmd_register(cmd, "base rbtree",                test_base_rbtree);
     cmd_register(cmd, "base rbuffer",               test_base_rbuffer);
+    cmd_register(cmd, "base rbuffer nocopy",        test_base_rbuffer_nocopy);
+    cmd_register(cmd, "base rbuffer mpsc",          test_base_rbuffer_mpsc);
     cmd_register(cmd, "base slist",                 test_base_slist);
     cmd_register(cmd, "base skiplist",              test_base_skiplist);
     cmd_register(cmd, "base skiplist find",         test_base_skiplist_find);
     cmd_register(cmd, "base skiplist duplicate",    test_base_skiplist_duplicate);
     cmd_register(cmd, "base timer",                 test_base_timer);
+    cmd_register(cmd, "base timer order",           test_base_timer_order);
     cmd_register(cmd, "core atomic",                test_core_atomic);
 #ifdef OS_LINUX
     // seems some memory error ...
@@ -92,14 +125,39 @@ run() {
 #endif
     cmd_register(cmd, "core fsm",                   test_core_fsm);
     cmd_register(cmd, "core lock",                  test_core_lock);
+    cmd_register(cmd, "core plock",                 test_core_plock);
     cmd_register(cmd, "core spin",                  test_core_spin);
     cmd_register(cmd, "core thread",                test_core_thread);
+    cmd_register(cmd, "logic bus",                  test_logic_bus);
+    cmd_register(cmd, "logic bus wait",             test_logic_bus_wait);
+    cmd_register(cmd, "logic bus wait stress",      test_logic_bus_wait_stress);
+    cmd_register(cmd, "logic bus bcast",            test_logic_bus_bcast);
+    cmd_register(cmd, "logic bus stat",             test_logic_bus_stat);
+    cmd_register(cmd, "logic bus pipe size",        test_logic_bus_pipe_size);
+    cmd_register(cmd, "logic bus scale",            test_logic_bus_scale);
+    cmd_register(cmd, "logic bus reclaim",          test_logic_bus_reclaim);
+    cmd_register(cmd, "logic bus lock",             test_logic_bus_lock);
+    cmd_register(cmd, "logic bus mpsc",             test_logic_bus_mpsc);
+    cmd_register(cmd, "logic bus prio",             test_logic_bus_prio);
+    cmd_register(cmd, "logic bus spill",            test_logic_bus_spill);
+    cmd_register(cmd, "logic rpc",                  test_logic_rpc);
+    cmd_register(cmd, "logic bridge",               test_logic_bridge);
+    cmd_register(cmd, "logic bridge connect",       test_logic_bridge_connect);
+    cmd_register(cmd, "logic bridge slow connect",  test_logic_bridge_slow_connect);
     cmd_register(cmd, "logic dirty",                test_logic_dirty);
     cmd_register(cmd, "logic task",                 test_logic_task);
     cmd_register(cmd, "mm slab",                    test_mm_slab);
     cmd_register(cmd, "mm shm",                     test_mm_shm);
+    cmd_register(cmd, "net acceptor emfile",        test_net_acceptor_emfile);
+    cmd_register(cmd, "net connector sendv",        test_net_connector_sendv);
     cmd_register(cmd, "net curl",                   test_net_curl);
     cmd_register(cmd, "net echo",                   test_net_echo);
+    cmd_register(cmd, "net echo edge",              test_net_echo_edge);
+    cmd_register(cmd, "net echo uring",             test_net_echo_uring);
+    cmd_register(cmd, "net reactor stale",          test_net_reactor_stale);
+    cmd_register(cmd, "net reactor stale uring",    test_net_reactor_stale_uring);
+    cmd_register(cmd, "net reactor group",          test_net_reactor_group);
+    cmd_register(cmd, "net reactor timer",          test_net_reactor_timer);
     cmd_register(cmd, "util base64",                test_util_base64);
     cmd_register(cmd, "util cjson text",            test_util_cjson_text);
     cmd_register(cmd, "util cjson file",            test_util_cjson_file);
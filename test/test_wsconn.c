@@ -50,7 +50,7 @@ _wscon_close(int fd, void* arg) {
 }
 
 static int
-_accept_read(sock_t fd, void* arg) {
+_accept_read(sock_t fd, void* arg, const sockaddr_t* peer) {
     WSCtx* ctx = (WSCtx*)MALLOC(sizeof(WSCtx));
     assert(ctx);
     ctx->con = wsconn_create(r);
@@ -0,0 +1,84 @@
+#include <assert.h>
+#include <string.h>
+#include "base/buffer.h"
+
+#define TEST_BUFFER_SIZE 1024
+
+static int
+_allocated(buffer_t* cb) {
+    return strstr(buffer_debug(cb), "alloc=1") ? 1 : 0;
+}
+
+int
+test_base_buffer(const char* param) {
+    buffer_t* cb = buffer_create(TEST_BUFFER_SIZE, MALLOC, FREE);
+    assert(cb);
+    // no storage until written
+    assert(!_allocated(cb));
+    assert(TEST_BUFFER_SIZE == buffer_write_len(cb));
+    assert(0 == buffer_read_len(cb));
+    assert(!buffer_read_buffer(cb));
+    struct iovec iov;
+    assert(0 == buffer_read_iov(cb, &iov));
+    assert(!_allocated(cb));
+
+    // storage is kept across messages, and given back by shrink
+    char src[TEST_BUFFER_SIZE], dst[TEST_BUFFER_SIZE];
+    for (int i = 0; i < TEST_BUFFER_SIZE; ++ i) {
+        src[i] = (char)i;
+    }
+    assert(100 == buffer_write(cb, src, 100));
+    assert(_allocated(cb));
+    assert(1 == buffer_read_iov(cb, &iov) && 100 == iov.iov_len);
+    assert(40 == buffer_read(cb, dst, 40));
+    assert(_allocated(cb));
+    assert(60 == buffer_read(cb, dst + 40, 100));
+    assert(0 == memcmp(src, dst, 100));
+    assert(_allocated(cb) && !buffer_read_buffer(cb));
+    assert(TEST_BUFFER_SIZE == buffer_write_len(cb));
+    assert(0 == buffer_shrink(cb));
+    assert(!_allocated(cb));
+
+    // storage taken but nothing written
+    assert(1 == buffer_write_iov(cb, &iov) && TEST_BUFFER_SIZE == iov.iov_len);
+    assert(_allocated(cb));
+    assert(0 == buffer_shrink(cb));
+    assert(!_allocated(cb));
+
+    // stream in chunks, unread data is kept across compaction
+    int wpos = 0, rpos = 0, chunk = 300;
+    char stream[TEST_BUFFER_SIZE * 8];
+    for (int i = 0; i < (int)sizeof(stream); ++ i) {
+        stream[i] = (char)(i * 7);
+    }
+    while (rpos < (int)sizeof(stream)) {
+        int n = (int)sizeof(stream) - wpos;
+        n = n < chunk ? n : chunk;
+        n = n < buffer_write_len(cb) ? n : buffer_write_len(cb);
+        if (n > 0) {
+            memcpy(buffer_write_buffer(cb), stream + wpos, n);
+            assert(n == buffer_write_nocopy(cb, n));
+            wpos += n;
+        }
+        n = buffer_read_len(cb) < 170 ? buffer_read_len(cb) : 170;
+        assert(0 == memcmp(buffer_read_buffer(cb), stream + rpos, n));
+        assert(n == buffer_read_nocopy(cb, n));
+        rpos += n;
+        // shrink keeps data
+        assert(0 == buffer_shrink(cb));
+        assert(buffer_read_len(cb) == wpos - rpos);
+    }
+    assert(wpos == rpos);
+    assert(!_allocated(cb));
+
+    // full, then reset
+    assert(TEST_BUFFER_SIZE == buffer_write(cb, src, TEST_BUFFER_SIZE));
+    assert(0 == buffer_write_len(cb));
+    assert(0 == buffer_write(cb, src, 1));
+    assert(0 == buffer_reset(cb));
+    assert(!_allocated(cb));
+    assert(TEST_BUFFER_SIZE == buffer_write_len(cb));
+
+    buffer_release(cb);
+    return 0;
+}
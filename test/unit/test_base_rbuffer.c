@@ -49,8 +49,52 @@ _read(void* arg) {
     return NULL;
 }
 
-int
-test_base_rbuffer(const char* param) {
+static void*
+_reserve(void* arg) {
+    int loop = 0;
+    do {
+        // variable size, to make records wrap at buffer tail
+        size_t size = loop % BYTES_SIZE + 1;
+        char* data = rbuffer_reserve(_rbuffer, size);
+        if (!data) {
+            usleep(100);
+        } else {
+            memcpy(data, _bytes, size);
+            int ret = rbuffer_commit(_rbuffer, size);
+            assert(0 == ret);
+            loop ++;
+            if (loop % 1000 == 0) {
+                printf("thread reserve: %d\n", loop);
+            }
+        }
+    } while(loop < _loop);
+    return NULL;
+}
+
+static void*
+_peek(void* arg) {
+    int loop = 0;
+    do {
+        size_t size;
+        const char* data = rbuffer_peek_ptr(_rbuffer, &size);
+        if (!data) {
+            usleep(100);
+        } else {
+            assert(size == (size_t)(loop % BYTES_SIZE + 1));
+            assert(0 == memcmp(data, _bytes, size));
+            int ret = rbuffer_consume(_rbuffer);
+            assert(0 == ret);
+            loop ++;
+            if (loop % 1000 == 0) {
+                printf("thread peek: %d\n", loop);
+            }
+        }
+    } while(loop < _loop);
+    return NULL;
+}
+
+static int
+_test_rbuffer(const char* param, void* (*writer)(void*), void* (*reader)(void*)) {
     if (param) {
         _loop = atoi(param);
     }
@@ -70,8 +114,8 @@ test_base_rbuffer(const char* param) {
     pthread_attr_setstacksize(&attr, (1 << 20));
 
     pthread_t p1, p2;
-    pthread_create(&p1, &attr, _write, NULL);
-    pthread_create(&p2, &attr, _read, NULL);
+    pthread_create(&p1, &attr, writer, NULL);
+    pthread_create(&p2, &attr, reader, NULL);
     pthread_attr_destroy(&attr);
 
     pthread_join(p1, NULL);
@@ -81,3 +125,106 @@ test_base_rbuffer(const char* param) {
     return 0;
 }
 
+
+#define MPSC_WRITERS 4
+
+typedef struct mpsc_msg_t {
+    int writer;
+    int seq;
+} mpsc_msg_t;
+
+// variable size, odd writers reserve more and commit less to leave gaps
+static void*
+_mpsc_write(void* arg) {
+    int writer = (int)(intptr_t)arg;
+    int loop = 0;
+    do {
+        size_t size = sizeof(mpsc_msg_t) + (loop + writer) % 1000;
+        size_t reserved = (writer & 1) ? size + 100 : size;
+        char* data = rbuffer_reserve(_rbuffer, reserved);
+        if (!data) {
+            usleep(100);
+            continue;
+        }
+        mpsc_msg_t* msg = (mpsc_msg_t*)data;
+        msg->writer = writer;
+        msg->seq = loop;
+        memcpy(data + sizeof(*msg), _bytes, size - sizeof(*msg));
+        int ret = rbuffer_commit_ptr(_rbuffer, data, size, 0);
+        assert(0 == ret);
+        loop ++;
+    } while(loop < _loop);
+    return NULL;
+}
+
+static void*
+_mpsc_read(void* arg) {
+    int seqs[MPSC_WRITERS] = { 0 };
+    int loop = 0;
+    do {
+        size_t size;
+        const char* data = rbuffer_peek_ptr(_rbuffer, &size);
+        if (!data) {
+            usleep(100);
+            continue;
+        }
+        const mpsc_msg_t* msg = (const mpsc_msg_t*)data;
+        assert(msg->writer >= 0 && msg->writer < MPSC_WRITERS);
+        assert(msg->seq == seqs[msg->writer]);
+        assert(size == sizeof(*msg) + (msg->seq + msg->writer) % 1000);
+        assert(0 == memcmp(data + sizeof(*msg), _bytes, size - sizeof(*msg)));
+        ++ seqs[msg->writer];
+        int ret = rbuffer_consume(_rbuffer);
+        assert(0 == ret);
+        loop ++;
+        if (loop % 10000 == 0) {
+            printf("thread mpsc read: %d\n", loop);
+        }
+    } while(loop < _loop * MPSC_WRITERS);
+    return NULL;
+}
+
+int
+test_base_rbuffer_mpsc(const char* param) {
+    if (param) {
+        _loop = atoi(param);
+    }
+    for (int i = 0; i < BYTES_SIZE; i++) {
+        _bytes[i] = i % 26 + 'a';
+    }
+    // small buffer, to make records wrap & writers wait
+    _rbuffer = rbuffer_create_mpsc(64 * 1024);
+    if (!_rbuffer) {
+        fprintf(stderr, "rbuffer create fail\n");
+        return -1;
+    }
+    assert(1 == rbuffer_mpsc(_rbuffer));
+    assert(-1 == rbuffer_commit(_rbuffer, 1));
+
+    pthread_t writers[MPSC_WRITERS], reader;
+    pthread_create(&reader, NULL, _mpsc_read, NULL);
+    for (int i = 0; i < MPSC_WRITERS; ++ i) {
+        pthread_create(&writers[i], NULL, _mpsc_write, (void*)(intptr_t)i);
+    }
+    for (int i = 0; i < MPSC_WRITERS; ++ i) {
+        pthread_join(writers[i], NULL);
+    }
+    pthread_join(reader, NULL);
+    // trailing gap is passed by peek
+    size_t size;
+    assert(NULL == rbuffer_peek_ptr(_rbuffer, &size));
+    assert(0 == rbuffer_read_bytes(_rbuffer));
+
+    rbuffer_release(_rbuffer);
+    return 0;
+}
+
+int
+test_base_rbuffer(const char* param) {
+    return _test_rbuffer(param, _write, _read);
+}
+
+int
+test_base_rbuffer_nocopy(const char* param) {
+    return _test_rbuffer(param, _reserve, _peek);
+}
@@ -1,3 +1,4 @@
+#include <assert.h>
 #include <unistd.h>
 #include <sys/time.h>
 
@@ -72,3 +73,56 @@ test_base_timer(const char* param) {
     return 0;
 }
 
+
+// delays in 10ms, the first due fires at once, then registers shorter ones,
+// and the third registers another. erasing a fired timer which is not the top
+// any more must keep the order
+static timerheap_t* _order_timer;
+static int _order_origins[] = { 134, 133, 170 };
+static int _order_first[] = { 28, 41, 14, 18 };
+static int _order_third[] = { 67 };
+static int _order_expect[] = { 133, 14, 18, 28, 41, 67, 134, 170 };
+static int _order_fired[8];
+static int _order_count;
+
+static int _order_cb(void* args);
+
+static void
+_order_register(int* delays, int n) {
+    for (int i = 0; i < n; ++ i) {
+        struct timeval delay;
+        delay.tv_sec = delays[i] / 100;
+        delay.tv_usec = delays[i] % 100 * 10000;
+        assert(timer_register(_order_timer, NULL, &delay, _order_cb, &delays[i]) >= 0);
+    }
+}
+
+static int
+_order_cb(void* args) {
+    if (_order_count == 0)
+        _order_register(_order_first, sizeof(_order_first) / sizeof(int));
+    else if (_order_count == 2)
+        _order_register(_order_third, sizeof(_order_third) / sizeof(int));
+    _order_fired[_order_count ++] = *(int*)args;
+    return 0;
+}
+
+int
+test_base_timer_order(const char* param) {
+    _order_timer = timer_create_heap();
+    assert(_order_timer);
+    _order_count = 0;
+    _order_register(_order_origins, sizeof(_order_origins) / sizeof(int));
+
+    // all due, fire by order
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    now.tv_sec += 10;
+    timer_poll(_order_timer, &now);
+    int n = sizeof(_order_expect) / sizeof(int);
+    assert(_order_count == n);
+    for (int i = 0; i < n; ++ i)
+        assert(_order_fired[i] == _order_expect[i]);
+    timer_release(_order_timer);
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "core/plock.h"
+
+#define TEST_PLOCK_KEY 0x1237
+
+static plock_t* _plock;
+static int _plock_loop = 10000;
+static int _plock_count = 0;
+
+static void*
+_plock_func(void* arg) {
+    for (int i = 0; i < _plock_loop; ++ i) {
+        assert(0 == plock_lock(_plock));
+        ++ _plock_count;
+        plock_unlock(_plock);
+    }
+    return NULL;
+}
+
+int
+test_core_plock(const char* param) {
+    _plock = plock_create(TEST_PLOCK_KEY);
+    if (!_plock) {
+        fprintf(stderr, "plock create fail\n");
+        return -1;
+    }
+
+    // threads contention
+    int count = param ? atoi(param) : 4;
+    pthread_t tid[count];
+    _plock_count = 0;
+    for (int i = 0; i < count; ++ i) {
+        pthread_create(&tid[i], NULL, _plock_func, NULL);
+    }
+    for (int i = 0; i < count; ++ i) {
+        pthread_join(tid[i], NULL);
+    }
+    assert(_plock_count == count * _plock_loop);
+
+    // attached by key in another process
+    pid_t pid = fork();
+    if (pid == 0) {
+        plock_t* l = plock_create(TEST_PLOCK_KEY);
+        assert(l);
+        assert(0 == plock_try_lock(l));
+        plock_unlock(l);
+        plock_release(l);
+        exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && 0 == WEXITSTATUS(status));
+
+    // owner died holding the lock
+    pid = fork();
+    if (pid == 0) {
+        plock_lock(_plock);
+        _exit(0);
+    }
+    waitpid(pid, &status, 0);
+#if defined(OS_LINUX)
+    assert(PLOCK_OWNER_DEAD == plock_lock(_plock));
+    plock_unlock(_plock);
+    assert(0 == plock_lock(_plock));
+    plock_unlock(_plock);
+#endif
+
+    plock_destroy(_plock);
+    plock_release(_plock);
+    return 0;
+}
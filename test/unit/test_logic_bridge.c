@@ -0,0 +1,235 @@
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "net/reactor.h"
+#include "logic/bridge.h"
+#include "util/util_time.h"
+
+#define TEST_BRIDGE_KEY_A 0x1238
+#define TEST_BRIDGE_KEY_B 0x1239
+#define TEST_BRIDGE_IP "127.0.0.1"
+#define TEST_BRIDGE_PORT 8100
+#define TEST_BRIDGE_MSGS 100
+#define TEST_BRIDGE_CONNECT_MS 100
+
+// terminal a in bus A, b in bus B
+static bus_addr_t _a_addr = (1 << 16) + 1;
+static bus_addr_t _b_addr = (1 << 16) + 2;
+
+static void
+_pump(reactor_t* r, bridge_t* ba, bridge_t* bb, bus_t* a, bus_t* b) {
+    bridge_poll(ba);
+    bridge_poll(bb);
+    reactor_dispatch(r, 1);
+    bus_poll(a);
+    bus_poll(b);
+}
+
+int
+test_logic_bridge(const char* param) {
+    reactor_t* r = reactor_create();
+    assert(r);
+    bridge_t* ba = bridge_create(TEST_BRIDGE_KEY_A, 1, r, 0);
+    bridge_t* bb = bridge_create(TEST_BRIDGE_KEY_B, 2, r, 0);
+    assert(ba && bb);
+    assert(0 == bridge_listen(ba, TEST_BRIDGE_IP, TEST_BRIDGE_PORT));
+    assert(0 == bridge_add_route(ba, _b_addr, _b_addr, 2));
+    assert(0 == bridge_add_peer(bb, 1, TEST_BRIDGE_IP, TEST_BRIDGE_PORT));
+    assert(0 == bridge_add_route(bb, _a_addr, _a_addr, 1));
+    // overlapped
+    assert(0 != bridge_add_route(bb, _a_addr - 1, _a_addr, 3));
+
+    bus_t* a = bus_create(TEST_BRIDGE_KEY_A, _a_addr);
+    bus_t* b = bus_create(TEST_BRIDGE_KEY_B, _b_addr);
+    assert(a && b);
+
+    // messages left by last time
+    char buf[256];
+    size_t bufsz;
+    bus_addr_t from;
+    for (int i = 0; i < 50; ++ i) {
+        _pump(r, ba, bb, a, b);
+        bufsz = sizeof(buf);
+        while (BUS_OK == bus_recv_all(a, buf, &bufsz, &from))
+            bufsz = sizeof(buf);
+        while (BUS_OK == bus_recv_all(b, buf, &bufsz, &from))
+            bufsz = sizeof(buf);
+    }
+
+    // a -> b through bridges, in order
+    for (int i = 0; i < TEST_BRIDGE_MSGS; ++ i) {
+        int n = snprintf(buf, sizeof(buf), "msg %d", i);
+        assert(BUS_OK == bus_send(a, buf, n + 1, _b_addr));
+    }
+    int recv = 0;
+    for (int i = 0; i < 1000 && recv < TEST_BRIDGE_MSGS; ++ i) {
+        _pump(r, ba, bb, a, b);
+        bufsz = sizeof(buf);
+        while (BUS_OK == bus_recv_all(b, buf, &bufsz, &from)) {
+            char expect[64];
+            snprintf(expect, sizeof(expect), "msg %d", recv ++);
+            assert(from == _a_addr);
+            assert(0 == strcmp(expect, buf));
+            bufsz = sizeof(buf);
+        }
+    }
+    assert(recv == TEST_BRIDGE_MSGS);
+
+    // b -> a, replied to the source
+    assert(BUS_OK == bus_send(b, "reply", 6, from));
+    int done = 0;
+    for (int i = 0; i < 1000 && !done; ++ i) {
+        _pump(r, ba, bb, a, b);
+        bufsz = sizeof(buf);
+        if (BUS_OK == bus_recv_all(a, buf, &bufsz, &from)) {
+            assert(from == _b_addr);
+            assert(bufsz == 6 && 0 == strcmp("reply", buf));
+            done = 1;
+        }
+    }
+    assert(done);
+    assert(0 == bridge_drops(ba) && 0 == bridge_drops(bb));
+
+    // a larger one is dropped, and doesn't block the following
+    static char big[BRIDGE_DEFAULT_MSG_SIZE + 1];
+    assert(BUS_OK == bus_send(b, big, sizeof(big), _a_addr));
+    assert(BUS_OK == bus_send(b, "after", 6, _a_addr));
+    done = 0;
+    for (int i = 0; i < 1000 && !done; ++ i) {
+        _pump(r, ba, bb, a, b);
+        bufsz = sizeof(buf);
+        if (BUS_OK == bus_recv_all(a, buf, &bufsz, &from)) {
+            assert(bufsz == 6 && 0 == strcmp("after", buf));
+            done = 1;
+        }
+    }
+    assert(done);
+    assert(1 == bridge_drops(bb));
+
+    bus_release(a);
+    bus_release(b);
+    bridge_release(ba);
+    bridge_release(bb);
+    reactor_release(r);
+    return 0;
+}
+
+// peer's accept queue is full, so connecting never completes
+int
+test_logic_bridge_connect(const char* param) {
+    sockaddrin_t addr;
+    assert(0 == sock_addr_aton(TEST_BRIDGE_IP, TEST_BRIDGE_PORT + 1, &addr));
+    sock_t lfd = sock_tcp();
+    assert(lfd != INVALID_SOCK);
+    assert(0 == sock_set_reuseaddr(lfd));
+    assert(0 == bind(lfd, (sockaddr_t*)&addr, sizeof(addr)));
+    assert(0 == listen(lfd, 0));
+    sock_t fills[4];
+    for (int i = 0; i < 4; ++ i) {
+        fills[i] = sock_tcp();
+        sock_set_nonblock(fills[i]);
+        connect(fills[i], (sockaddr_t*)&addr, sizeof(addr));
+    }
+    usleep(10 * 1000);
+
+    reactor_t* r = reactor_create();
+    assert(r);
+    bridge_t* b = bridge_create(TEST_BRIDGE_KEY_A, 1, r, 0);
+    assert(b);
+    bridge_set_connect_timeout(b, TEST_BRIDGE_CONNECT_MS);
+    assert(0 == bridge_add_peer(b, 2, TEST_BRIDGE_IP, TEST_BRIDGE_PORT + 1));
+
+    // polling never waits for the connecting, across timeout & reconnect
+    for (int i = 0; i < 30; ++ i) {
+        struct timeval start, end, cost;
+        gettimeofday(&start, NULL);
+        bridge_poll(b);
+        gettimeofday(&end, NULL);
+        util_time_sub(&end, &start, &cost);
+        assert(cost.tv_sec == 0 && cost.tv_usec < TEST_BRIDGE_CONNECT_MS * 1000 / 2);
+        reactor_dispatch(r, TEST_BRIDGE_CONNECT_MS);
+    }
+
+    bridge_release(b);
+    reactor_release(r);
+    for (int i = 0; i < 4; ++ i)
+        sock_close(fills[i]);
+    sock_close(lfd);
+    return 0;
+}
+
+static int
+_elapsed_ms(const struct timeval* start) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_usec - start->tv_usec) / 1000;
+}
+
+// the syn is dropped as accept queue is full, and the queue is freed after 300ms,
+// so the handshake completes by the syn retransmitted in 1s.
+// return connections accepted from bridge
+static int
+_delayed_accept(int timeout_ms) {
+    sockaddrin_t addr;
+    assert(0 == sock_addr_aton(TEST_BRIDGE_IP, TEST_BRIDGE_PORT + 2, &addr));
+    sock_t lfd = sock_tcp();
+    assert(lfd != INVALID_SOCK);
+    assert(0 == sock_set_reuseaddr(lfd));
+    assert(0 == bind(lfd, (sockaddr_t*)&addr, sizeof(addr)));
+    assert(0 == listen(lfd, 0));
+    assert(0 == sock_set_nonblock(lfd));
+    sock_t fill = sock_tcp();
+    assert(0 == connect(fill, (sockaddr_t*)&addr, sizeof(addr)));
+    sockaddrin_t fill_addr;
+    socklen_t len = sizeof(fill_addr);
+    assert(0 == getsockname(fill, (sockaddr_t*)&fill_addr, &len));
+
+    reactor_t* r = reactor_create();
+    assert(r);
+    bridge_t* b = bridge_create(TEST_BRIDGE_KEY_A, 1, r, 0);
+    assert(b);
+    bridge_set_connect_timeout(b, timeout_ms);
+    assert(0 == bridge_add_peer(b, 2, TEST_BRIDGE_IP, TEST_BRIDGE_PORT + 2));
+    bridge_poll(b);
+
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    int polled = 0, n = 0;
+    int elapsed;
+    while ((elapsed = _elapsed_ms(&start)) < 1800) {
+        // a pending connect is aborted here if timeout is short,
+        // and not reconnected as no more polling
+        if (!polled && elapsed >= 150) {
+            bridge_poll(b);
+            polled = 1;
+        }
+        if (elapsed >= 300) {
+            sockaddrin_t from;
+            len = sizeof(from);
+            sock_t fd;
+            while ((fd = accept(lfd, (sockaddr_t*)&from, &len)) != INVALID_SOCK) {
+                if (from.sin_port != fill_addr.sin_port)
+                    ++ n;
+                sock_close(fd);
+                len = sizeof(from);
+            }
+        }
+        reactor_dispatch(r, 10);
+    }
+
+    bridge_release(b);
+    reactor_release(r);
+    sock_close(fill);
+    sock_close(lfd);
+    return n;
+}
+
+// peer on a slow link, or the first syn is lost
+int
+test_logic_bridge_slow_connect(const char* param) {
+    assert(0 == _delayed_accept(TEST_BRIDGE_CONNECT_MS));
+    assert(1 == _delayed_accept(0));
+    return 0;
+}
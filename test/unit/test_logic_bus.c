@@ -0,0 +1,827 @@
+#include <assert.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "mm/shm.h"
+#include "base/rbuffer.h"
+#include "logic/bus.h"
+#include "util/util_time.h"
+
+#define TEST_BUS_KEY 0x1235
+#define TEST_BUS_MSG_SIZE 64
+#define TEST_BUS_MAX_STAT 256
+
+int
+test_logic_bus(const char* param) {
+    bus_addr_t addrs[] = { (1 << 16) + 1, (1 << 16) + 2, (2 << 16) + 1 };
+    bus_t* bts[3];
+    for (int i = 0; i < 3; ++ i) {
+        bts[i] = bus_create(TEST_BUS_KEY, addrs[i]);
+        if (!bts[i]) {
+            fprintf(stderr, "bus[%d] create fail\n", addrs[i]);
+            return -1;
+        }
+    }
+    for (int i = 0; i < 3; ++ i) {
+        bus_poll(bts[i]);
+    }
+
+    // drain messages left by last time
+    char drain[TEST_BUS_MSG_SIZE];
+    size_t drainsz = sizeof(drain);
+    bus_addr_t from;
+    while (bus_recv_all(bts[0], drain, &drainsz, &from) == BUS_OK) {
+        drainsz = sizeof(drain);
+    }
+
+    // 1 & 2 send to 0
+    int loop = param ? atoi(param) : 3;
+    for (int i = 0; i < loop; ++ i) {
+        char buf[TEST_BUS_MSG_SIZE];
+        for (int j = 1; j < 3; ++ j) {
+            snprintf(buf, sizeof(buf), "%d:%d", addrs[j], i);
+            int ret = bus_send(bts[j], buf, strlen(buf) + 1, addrs[0]);
+            assert(BUS_OK == ret);
+        }
+    }
+    bus_poll(bts[0]);
+
+    // batch receive, messages from the same pipe keep in order
+    int seq[3] = { 0, 0, 0 };
+    int total = 0;
+    while (1) {
+        char bufs[4][TEST_BUS_MSG_SIZE];
+        bus_msg_t msgs[4];
+        for (int i = 0; i < 4; ++ i) {
+            msgs[i].buf = bufs[i];
+            msgs[i].bufsz = TEST_BUS_MSG_SIZE;
+        }
+        int n = bus_recv_batch(bts[0], msgs, 4);
+        assert(n >= 0);
+        if (n == 0) {
+            break;
+        }
+        for (int i = 0; i < n; ++ i) {
+            int j = (msgs[i].from == addrs[1]) ? 1 : 2;
+            char expect[TEST_BUS_MSG_SIZE];
+            snprintf(expect, sizeof(expect), "%d:%d", addrs[j], seq[j] ++);
+            assert(0 == strcmp(expect, msgs[i].buf));
+            printf("bus recv from [%d]: %s\n", msgs[i].from, msgs[i].buf);
+        }
+        total += n;
+    }
+    assert(total == loop * 2);
+    assert(seq[1] == loop && seq[2] == loop);
+
+    for (int i = 0; i < 3; ++ i) {
+        bus_release(bts[i]);
+    }
+    return 0;
+}
+
+static bus_addr_t _wait_from = (2 << 16) + 1;
+static bus_addr_t _wait_to = (1 << 16) + 1;
+
+static void*
+_wait_send(void* arg) {
+    usleep(50 * 1000);
+    const char* msg = "doorbell";
+    int ret = bus_send((bus_t*)arg, msg, strlen(msg) + 1, _wait_to);
+    assert(BUS_OK == ret);
+    return NULL;
+}
+
+static int
+_wait_drain(bus_t* bt) {
+    char buf[TEST_BUS_MSG_SIZE];
+    bus_msg_t msg;
+    int n = 0;
+    do {
+        msg.buf = buf;
+        msg.bufsz = sizeof(buf);
+    } while (bus_recv_batch(bt, &msg, 1) == 1 && ++ n);
+    return n;
+}
+
+int
+test_logic_bus_wait(const char* param) {
+    bus_t* to = bus_create(TEST_BUS_KEY, _wait_to);
+    bus_t* from = bus_create(TEST_BUS_KEY, _wait_from);
+    if (!to || !from) {
+        fprintf(stderr, "bus create fail\n");
+        return -1;
+    }
+    bus_poll(to);
+    bus_poll(from);
+    _wait_drain(to);
+
+    // timeout
+    int ret = bus_wait(to, 10);
+    assert(BUS_ERR_EMPTY == ret);
+
+    // futex wake up
+    struct timeval start, end;
+    pthread_t t;
+    gettimeofday(&start, NULL);
+    pthread_create(&t, NULL, _wait_send, from);
+    ret = bus_wait(to, 5000);
+    gettimeofday(&end, NULL);
+    pthread_join(t, NULL);
+    assert(BUS_OK == ret);
+    struct timeval cost;
+    util_time_sub(&end, &start, &cost);
+    assert(cost.tv_sec < 1);
+    bus_poll(to);
+    assert(1 == _wait_drain(to));
+
+    // fd wake up, armed by draining
+    struct pollfd pfd;
+    pfd.fd = bus_fd(to);
+    pfd.events = POLLIN;
+    assert(pfd.fd >= 0);
+    _wait_drain(to);
+    pthread_create(&t, NULL, _wait_send, from);
+    ret = poll(&pfd, 1, 5000);
+    pthread_join(t, NULL);
+    assert(1 == ret && (pfd.revents & POLLIN));
+    assert(1 == _wait_drain(to));
+    printf("bus doorbell wake up in %d us\n", (int)cost.tv_usec);
+
+    // a larger message blocks its pipe until taken out
+    const char* msg = "oversize";
+    char small[4];
+    bus_msg_t m;
+    m.buf = small;
+    m.bufsz = sizeof(small);
+    assert(0 == bus_recv_batch(to, &m, 1));
+    assert(BUS_OK == bus_send(from, msg, strlen(msg) + 1, _wait_to));
+    assert(BUS_ERR_OVERSIZE == bus_recv_batch(to, &m, 1));
+    m.bufsz = 0;
+    assert(1 == bus_recv_oversize(to, sizeof(small), &m));
+    assert(m.bufsz == strlen(msg) + 1 && m.from == _wait_from);
+    m.bufsz = sizeof(small);
+    assert(0 == bus_recv_batch(to, &m, 1));
+
+    bus_release(to);
+    bus_release(from);
+    return 0;
+}
+
+#define TEST_BUS_STRESS_MSGS 20000
+
+static bus_addr_t _stress_from = (22 << 16) + 1;
+static bus_addr_t _stress_to = (23 << 16) + 1;
+
+// receiver sleeps without timeout, killed by alarm if a wake up is lost
+static int
+_stress_recv(int ready, int by_fd) {
+    bus_t* bt = bus_create(TEST_BUS_KEY, _stress_to);
+    if (!bt)
+        return 1;
+    alarm(30);
+    bus_poll(bt);
+    struct pollfd pfd;
+    pfd.fd = by_fd ? bus_fd(bt) : -1;
+    pfd.events = POLLIN;
+    // messages left by last time, and arm fd
+    _wait_drain(bt);
+    char c = 0;
+    if (1 != write(ready, &c, 1))
+        return 1;
+    int expect = 0;
+    while (expect < TEST_BUS_STRESS_MSGS) {
+        if (by_fd) {
+            poll(&pfd, 1, -1);
+        } else {
+            bus_wait(bt, -1);
+        }
+        bus_poll(bt);
+        int seq;
+        bus_msg_t msg;
+        msg.buf = (char*)&seq;
+        msg.bufsz = sizeof(seq);
+        while (bus_recv_batch(bt, &msg, 1) == 1) {
+            if (msg.bufsz != sizeof(seq) || seq != expect ++)
+                return 1;
+            msg.bufsz = sizeof(seq);
+        }
+    }
+    bus_release(bt);
+    return 0;
+}
+
+int
+test_logic_bus_wait_stress(const char* param) {
+    bus_t* from = bus_create(TEST_BUS_KEY, _stress_from);
+    assert(from);
+    for (int by_fd = 0; by_fd < 2; ++ by_fd) {
+        int fds[2];
+        assert(0 == pipe(fds));
+        pid_t pid = fork();
+        if (pid == 0) {
+            _exit(_stress_recv(fds[1], by_fd));
+        }
+        char c;
+        assert(1 == read(fds[0], &c, 1));
+        bus_poll(from);
+        for (int seq = 0; seq < TEST_BUS_STRESS_MSGS; ++ seq) {
+            int ret;
+            while ((ret = bus_send(from, (const char*)&seq, sizeof(seq), _stress_to)) != BUS_OK) {
+                assert(BUS_ERR_PEER_DEAD != ret);
+                bus_poll(from);
+                usleep(10);
+            }
+            // pause now and then, so the receiver goes to sleep
+            if (seq % 32 == 0)
+                usleep(seq % 7 * 10);
+        }
+        int status;
+        waitpid(pid, &status, 0);
+        assert(WIFEXITED(status) && 0 == WEXITSTATUS(status));
+        close(fds[0]);
+        close(fds[1]);
+    }
+    bus_release(from);
+    return 0;
+}
+
+int
+test_logic_bus_bcast(const char* param) {
+    bus_addr_t addrs[] = { (3 << 16) + 1, (4 << 16) + 1, (4 << 16) + 2, (5 << 16) + 1 };
+    bus_t* bts[4];
+    for (int i = 0; i < 4; ++ i) {
+        bts[i] = bus_create(TEST_BUS_KEY, addrs[i]);
+        if (!bts[i]) {
+            fprintf(stderr, "bus[%d] create fail\n", addrs[i]);
+            return -1;
+        }
+    }
+    for (int i = 0; i < 4; ++ i) {
+        bus_poll(bts[i]);
+        _wait_drain(bts[i]);
+    }
+
+    // one write for all subscribers of type 4
+    int loop = param ? atoi(param) : 3;
+    for (int i = 0; i < loop; ++ i) {
+        char buf[TEST_BUS_MSG_SIZE];
+        snprintf(buf, sizeof(buf), "bcast:%d", i);
+        int ret = bus_send_by_type(bts[0], buf, strlen(buf) + 1, 4);
+        assert(BUS_OK == ret);
+    }
+    for (int i = 1; i < 4; ++ i) {
+        bus_poll(bts[i]);
+    }
+    assert(loop == _wait_drain(bts[1]));
+    assert(loop == _wait_drain(bts[2]));
+    assert(0 == _wait_drain(bts[3]));
+    assert(BUS_ERR_PEER_NOT_FOUND == bus_send_by_type(bts[0], "x", 1, 6));
+
+    // the slowest subscriber holds the pipe
+    const char* msg = "slowest reader test message";
+    int sent = 0;
+    while (bus_send_by_type(bts[0], msg, strlen(msg) + 1, 4) == BUS_OK) {
+        ++ sent;
+    }
+    assert(sent > 0);
+    assert(sent == _wait_drain(bts[1]));
+    assert(BUS_ERR_SEND_FAIL == bus_send_by_type(bts[0], msg, strlen(msg) + 1, 4));
+    assert(sent == _wait_drain(bts[2]));
+    assert(BUS_OK == bus_send_by_type(bts[0], msg, strlen(msg) + 1, 4));
+    assert(1 == _wait_drain(bts[1]));
+    assert(1 == _wait_drain(bts[2]));
+    printf("bus broadcast %d messages to fill pipe\n", sent);
+
+    for (int i = 0; i < 4; ++ i) {
+        bus_release(bts[i]);
+    }
+    return 0;
+}
+
+int
+test_logic_bus_stat(const char* param) {
+    bus_t* to = bus_create(TEST_BUS_KEY, _wait_to);
+    bus_t* from = bus_create(TEST_BUS_KEY, _wait_from);
+    if (!to || !from) {
+        fprintf(stderr, "bus create fail\n");
+        return -1;
+    }
+    bus_poll(to);
+    bus_poll(from);
+    _wait_drain(to);
+
+    bus_pipe_stat_t before[TEST_BUS_MAX_STAT];
+    bus_pipe_stat_t after[TEST_BUS_MAX_STAT];
+    int n = bus_stat(from, before, TEST_BUS_MAX_STAT);
+    assert(n > 0);
+
+    // stamped messages record latency
+    int loop = param ? atoi(param) : 3;
+    const char* msg = "stat";
+    bus_set_stamp(from, 1);
+    for (int i = 0; i < loop; ++ i) {
+        assert(BUS_OK == bus_send(from, msg, strlen(msg) + 1, _wait_to));
+    }
+    assert(loop == _wait_drain(to));
+    assert(n == bus_stat(to, after, TEST_BUS_MAX_STAT));
+
+    int found = 0;
+    for (int i = 0; i < n; ++ i) {
+        if (after[i].bcast || after[i].from != _wait_from || after[i].to != _wait_to)
+            continue;
+        bus_stat_t* s0 = &before[i].stat;
+        bus_stat_t* s1 = &after[i].stat;
+        assert(s1->send_msgs - s0->send_msgs == (uint64_t)loop);
+        assert(s1->recv_msgs - s0->recv_msgs == (uint64_t)loop);
+        assert(s1->send_bytes - s0->send_bytes == (uint64_t)loop * (strlen(msg) + 1));
+        assert(s1->peak_bytes > 0);
+        uint64_t stamped = 0;
+        for (int j = 0; j < BUS_STAT_LATENCY_BUCKETS; ++ j) {
+            stamped += s1->latency[j] - s0->latency[j];
+        }
+        assert(stamped == (uint64_t)loop);
+        found = 1;
+    }
+    assert(found);
+
+    bus_release(to);
+    bus_release(from);
+    return 0;
+}
+
+static int
+_pipe_size(bus_t* bt, bus_addr_t from, bus_addr_t to) {
+    bus_pipe_stat_t stats[TEST_BUS_MAX_STAT];
+    int n = bus_stat(bt, stats, TEST_BUS_MAX_STAT);
+    for (int i = 0; i < n; ++ i) {
+        if (!stats[i].bcast && stats[i].from == from && stats[i].to == to)
+            return (int)stats[i].size;
+    }
+    return -1;
+}
+
+int
+test_logic_bus_pipe_size(const char* param) {
+    bus_addr_t addrs[] = { (9 << 16) + 1, (10 << 16) + 1, (10 << 16) + 2, (11 << 16) + 1 };
+    bus_t* bts[4];
+    for (int i = 0; i < 4; ++ i) {
+        bts[i] = bus_create(TEST_BUS_KEY, addrs[i]);
+        if (!bts[i]) {
+            fprintf(stderr, "bus[%d] create fail\n", addrs[i]);
+            return -1;
+        }
+    }
+
+    // by address goes before by type, large one tries huge pages
+    assert(BUS_OK == bus_set_pipe_size_by_type(bts[0], 10, 1000 * 1000));
+    assert(BUS_OK == bus_set_pipe_size(bts[0], addrs[2], BUS_PIPE_HUGE_SIZE * 2));
+    assert(BUS_ERR_FAIL == bus_set_pipe_size(bts[0], addrs[3], 0));
+    assert(BUS_ERR_FAIL == bus_set_pipe_size(bts[0], addrs[3], (size_t)BUS_PIPE_MAX_SIZE + 1));
+
+    const char* msg = "pipe size";
+    for (int i = 1; i < 4; ++ i) {
+        bus_poll(bts[i]);
+        assert(BUS_OK == bus_send(bts[0], msg, strlen(msg) + 1, addrs[i]));
+    }
+    assert(1 << 20 == _pipe_size(bts[0], addrs[0], addrs[1]));
+    assert(BUS_PIPE_HUGE_SIZE * 2 == _pipe_size(bts[0], addrs[0], addrs[2]));
+    assert(ROUNDUP(BUS_PIPE_DEFAULT_SIZE) == _pipe_size(bts[0], addrs[0], addrs[3]));
+    for (int i = 1; i < 4; ++ i) {
+        bus_poll(bts[i]);
+        assert(_wait_drain(bts[i]) >= 1);
+    }
+
+    for (int i = 0; i < 4; ++ i) {
+        bus_release(bts[i]);
+    }
+    return 0;
+}
+
+int
+test_logic_bus_scale(const char* param) {
+    // more terminals than the default capacity
+    int count = param ? atoi(param) : 300;
+    int16_t key = TEST_BUS_KEY + 1;
+    bus_t** bts = (bus_t**)MALLOC(sizeof(bus_t*) * (count + 1));
+    bts[0] = bus_create_sized(key, (1 << 16) + 1, count + 1, count * 2, 0);
+    assert(bts[0]);
+    for (int i = 1; i <= count; ++ i) {
+        bts[i] = bus_create(key, (((i % 7) + 2) << 16) + i);
+        assert(bts[i]);
+        assert(BUS_OK == bus_set_pipe_size(bts[i], (1 << 16) + 1, 1024));
+    }
+    bus_poll(bts[0]);
+    _wait_drain(bts[0]);
+
+    // all send to terminal 0, with incremental pipe discovery
+    for (int i = 1; i <= count; ++ i) {
+        char buf[TEST_BUS_MSG_SIZE];
+        snprintf(buf, sizeof(buf), "%d", i);
+        assert(BUS_OK == bus_send(bts[i], buf, strlen(buf) + 1, (1 << 16) + 1));
+        if (i % 50 == 0) {
+            bus_poll(bts[0]);
+        }
+    }
+    bus_poll(bts[0]);
+    assert(count == _wait_drain(bts[0]));
+
+    // broadcast to one type reaches only its terminals
+    assert(BUS_OK == bus_send_by_type(bts[0], "t", 2, 3));
+    int recv = 0;
+    for (int i = 1; i <= count; ++ i) {
+        bus_poll(bts[i]);
+        recv += _wait_drain(bts[i]);
+    }
+    int expect = 0;
+    for (int i = 1; i <= count; ++ i) {
+        expect += ((i % 7) + 2 == 3);
+    }
+    assert(expect == recv);
+
+    for (int i = 0; i <= count; ++ i) {
+        bus_release(bts[i]);
+    }
+    FREE(bts);
+    return 0;
+}
+
+int
+test_logic_bus_reclaim(const char* param) {
+    bus_addr_t self = (12 << 16) + 1;
+    bus_addr_t peer = (13 << 16) + 1;
+    bus_t* bt = bus_create(TEST_BUS_KEY, self);
+    assert(bt);
+    assert(BUS_OK == bus_set_pipe_size(bt, peer, 4096));
+
+    // peer exits without draining
+    int status;
+    pid_t pid = fork();
+    if (pid == 0) {
+        _exit(bus_create(TEST_BUS_KEY, peer) ? 0 : 1);
+    }
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && 0 == WEXITSTATUS(status));
+
+    // fail fast once the pipe is full
+    const char* msg = "reclaim";
+    int ret;
+    bus_poll(bt);
+    while ((ret = bus_send(bt, msg, strlen(msg) + 1, peer)) == BUS_OK);
+    assert(BUS_ERR_PEER_DEAD == ret);
+    assert(BUS_ERR_PEER_DEAD == bus_send(bt, msg, strlen(msg) + 1, peer));
+    assert(bus_reclaim(bt) >= 1);
+    assert(_pipe_size(bt, self, peer) < 0);
+    assert(BUS_ERR_PEER_DEAD == bus_send(bt, msg, strlen(msg) + 1, peer));
+
+    // peer restarts, and receives by a new pipe
+    int fds[2];
+    assert(0 == pipe(fds));
+    pid = fork();
+    if (pid == 0) {
+        bus_t* p = bus_create(TEST_BUS_KEY, peer);
+        char c = 0;
+        assert(1 == write(fds[1], &c, 1));
+        int n = 0;
+        for (int i = 0; i < 100 && n == 0; ++ i) {
+            bus_wait(p, 50);
+            bus_poll(p);
+            n = _wait_drain(p);
+        }
+        _exit(n == 1 ? 0 : 1);
+    }
+    char c;
+    assert(1 == read(fds[0], &c, 1));
+    assert(BUS_OK == bus_send(bt, msg, strlen(msg) + 1, peer));
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && 0 == WEXITSTATUS(status));
+    close(fds[0]);
+    close(fds[1]);
+
+    bus_release(bt);
+    return 0;
+}
+
+#define TEST_BUS_LOCK_ROUNDS 8
+#define TEST_BUS_LOCK_TERMS 64
+
+// child keeps registering terminals and pipes, killed at any point
+static void
+_lock_child(int16_t key, int round, bus_addr_t to) {
+    for (int i = 0; i < TEST_BUS_LOCK_TERMS; ++ i) {
+        bus_addr_t addr = ((16 + round) << 16) + i + 1;
+        bus_t* bt = bus_create(key, addr);
+        if (!bt)
+            _exit(1);
+        bus_send(bt, "x", 1, to);
+    }
+    pause();
+    _exit(0);
+}
+
+int
+test_logic_bus_lock(const char* param) {
+    int16_t key = TEST_BUS_KEY + 2;
+    bus_addr_t self = (1 << 16) + 1;
+    bus_addr_t peer = (2 << 16) + 1;
+    int max_terms = TEST_BUS_LOCK_ROUNDS * TEST_BUS_LOCK_TERMS + 2;
+    bus_t* bt = bus_create_sized(key, self, max_terms, max_terms * 2, 0);
+    assert(bt);
+    srand(time(NULL));
+    for (int round = 0; round < TEST_BUS_LOCK_ROUNDS; ++ round) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            _lock_child(key, round, self);
+        }
+        usleep(rand() % 5000);
+        kill(pid, SIGKILL);
+        int status;
+        waitpid(pid, &status, 0);
+        // lock is usable and directory consistent
+        bus_poll(bt);
+        _wait_drain(bt);
+    }
+    assert(bus_reclaim(bt) >= 0);
+
+    // new terminal still joins and talks
+    bus_t* p = bus_create(key, peer);
+    assert(p);
+    bus_poll(bt);
+    assert(BUS_OK == bus_send(bt, "lock", 5, peer));
+    bus_poll(p);
+    assert(1 == _wait_drain(p));
+    assert(BUS_OK == bus_send(p, "lock", 5, self));
+    bus_poll(bt);
+    assert(1 == _wait_drain(bt));
+
+    bus_release(p);
+    bus_release(bt);
+
+    // a foreign segment at the key is rejected, never locked
+    int16_t fkey = TEST_BUS_KEY + 6;
+    shm_t* shm = shm_create(fkey << 16, 64 << 10, 0);
+    assert(shm);
+    memset(shm_mem(shm), 0xff, 64 << 10);
+    assert(!bus_create(fkey, self));
+    shm_destroy(shm);
+    shm_detach(shm);
+    return 0;
+}
+
+#define TEST_BUS_MPSC_THREADS 4
+
+static bus_addr_t _mpsc_from = (14 << 16) + 1;
+static bus_addr_t _mpsc_to = (15 << 16) + 1;
+static int _mpsc_loop = 10000;
+
+typedef struct mpsc_msg_t {
+    int thread;
+    int seq;
+} mpsc_msg_t;
+
+static bus_t* _mpsc_bus;
+
+static void*
+_mpsc_send(void* arg) {
+    mpsc_msg_t msg;
+    msg.thread = (int)(intptr_t)arg;
+    for (msg.seq = 0; msg.seq < _mpsc_loop; ) {
+        int ret = bus_send(_mpsc_bus, (const char*)&msg, sizeof(msg), _mpsc_to);
+        if (ret == BUS_ERR_SEND_FAIL) {
+            usleep(100);
+            continue;
+        }
+        assert(BUS_OK == ret);
+        ++ msg.seq;
+    }
+    return NULL;
+}
+
+int
+test_logic_bus_mpsc(const char* param) {
+    if (param) {
+        _mpsc_loop = atoi(param);
+    }
+    bus_t* to = bus_create(TEST_BUS_KEY, _mpsc_to);
+    _mpsc_bus = bus_create(TEST_BUS_KEY, _mpsc_from);
+    assert(to && _mpsc_bus);
+    bus_set_pipe_size(_mpsc_bus, _mpsc_to, 16 * 1024);
+    assert(BUS_OK == bus_set_pipe_mpsc_by_type(_mpsc_bus, bus_addr_type(_mpsc_to)));
+    bus_poll(_mpsc_bus);
+    bus_poll(to);
+    _wait_drain(to);
+
+    // pipe is created by one thread first
+    mpsc_msg_t msg = { -1, 0 };
+    assert(BUS_OK == bus_send(_mpsc_bus, (const char*)&msg, sizeof(msg), _mpsc_to));
+    char* reserved;
+    assert(BUS_ERR_FAIL == bus_send_reserve(_mpsc_bus, &reserved, sizeof(msg), _mpsc_to));
+
+    pthread_t threads[TEST_BUS_MPSC_THREADS];
+    for (int i = 0; i < TEST_BUS_MPSC_THREADS; ++ i) {
+        pthread_create(&threads[i], NULL, _mpsc_send, (void*)(intptr_t)i);
+    }
+
+    // messages of every thread keep in order
+    int seqs[TEST_BUS_MPSC_THREADS] = { 0 };
+    int total = 0;
+    bus_poll(to);
+    while (total < TEST_BUS_MPSC_THREADS * _mpsc_loop) {
+        mpsc_msg_t recv;
+        bus_msg_t m;
+        m.buf = (char*)&recv;
+        m.bufsz = sizeof(recv);
+        if (bus_recv_batch(to, &m, 1) != 1) {
+            usleep(100);
+            continue;
+        }
+        assert(m.from == _mpsc_from && m.bufsz == sizeof(recv));
+        if (recv.thread < 0)
+            continue;
+        assert(recv.thread < TEST_BUS_MPSC_THREADS);
+        assert(recv.seq == seqs[recv.thread] ++);
+        ++ total;
+    }
+    for (int i = 0; i < TEST_BUS_MPSC_THREADS; ++ i) {
+        pthread_join(threads[i], NULL);
+    }
+    assert(0 == _wait_drain(to));
+
+    bus_release(_mpsc_bus);
+    bus_release(to);
+    return 0;
+}
+
+static bus_addr_t _prio_bulk = (18 << 16) + 1;
+static bus_addr_t _prio_ctrl = (18 << 16) + 2;
+static bus_addr_t _prio_to = (19 << 16) + 1;
+
+static void
+_prio_expect(bus_t* bt, bus_addr_t from, const char* expect) {
+    char buf[TEST_BUS_MSG_SIZE];
+    size_t bufsz = sizeof(buf);
+    assert(BUS_OK == bus_recv(bt, buf, &bufsz, from));
+    assert(bufsz == strlen(expect) + 1 && 0 == strcmp(buf, expect));
+}
+
+int
+test_logic_bus_prio(const char* param) {
+    bus_t* to = bus_create(TEST_BUS_KEY, _prio_to);
+    bus_t* bulk = bus_create(TEST_BUS_KEY, _prio_bulk);
+    bus_t* ctrl = bus_create(TEST_BUS_KEY, _prio_ctrl);
+    assert(to && bulk && ctrl);
+    assert(BUS_OK == bus_set_pipe_lanes_by_type(bulk, bus_addr_type(_prio_to), 3));
+    assert(BUS_OK == bus_set_pipe_lanes(ctrl, _prio_to, 2));
+    assert(BUS_ERR_FAIL == bus_set_pipe_lanes(ctrl, _prio_to, BUS_MAX_LANES + 1));
+    bus_poll(bulk);
+    bus_poll(ctrl);
+    bus_poll(to);
+    _wait_drain(to);
+
+    // higher lane first in a pipe, priority over lanes is clamped
+    char buf[TEST_BUS_MSG_SIZE];
+    for (int i = 0; i < 5; ++ i) {
+        int n = snprintf(buf, sizeof(buf), "bulk %d", i);
+        assert(BUS_OK == bus_send(bulk, buf, n + 1, _prio_to));
+    }
+    assert(BUS_OK == bus_send_prio(bulk, "mid", 4, _prio_to, 1));
+    assert(BUS_OK == bus_send_prio(bulk, "high", 5, _prio_to, 2));
+    assert(BUS_OK == bus_send_prio(bulk, "top", 4, _prio_to, 9));
+    bus_poll(to);
+    _prio_expect(to, _prio_bulk, "high");
+    _prio_expect(to, _prio_bulk, "top");
+
+    // consume the lane peeked, even if a higher one arrives
+    const char* data;
+    size_t datasz;
+    assert(BUS_OK == bus_recv_peek(to, &data, &datasz, _prio_bulk));
+    assert(0 == strcmp(data, "mid"));
+    assert(BUS_OK == bus_send_prio(bulk, "late", 5, _prio_to, 2));
+    assert(BUS_OK == bus_recv_consume(to, _prio_bulk));
+    _prio_expect(to, _prio_bulk, "late");
+    for (int i = 0; i < 5; ++ i) {
+        char expect[TEST_BUS_MSG_SIZE];
+        snprintf(expect, sizeof(expect), "bulk %d", i);
+        _prio_expect(to, _prio_bulk, expect);
+    }
+
+    // higher lanes of all pipes go before round-robin
+    for (int i = 0; i < 5; ++ i) {
+        int n = snprintf(buf, sizeof(buf), "bulk %d", i);
+        assert(BUS_OK == bus_send(bulk, buf, n + 1, _prio_to));
+    }
+    assert(BUS_OK == bus_send_prio(ctrl, "kick", 5, _prio_to, 1));
+    bus_poll(to);
+    char bufs[8][TEST_BUS_MSG_SIZE];
+    bus_msg_t msgs[8];
+    for (int i = 0; i < 8; ++ i) {
+        msgs[i].buf = bufs[i];
+        msgs[i].bufsz = sizeof(bufs[i]);
+    }
+    assert(6 == bus_recv_batch(to, msgs, 8));
+    assert(msgs[0].from == _prio_ctrl && 0 == strcmp(msgs[0].buf, "kick"));
+    for (int i = 1; i < 6; ++ i) {
+        char expect[TEST_BUS_MSG_SIZE];
+        snprintf(expect, sizeof(expect), "bulk %d", i - 1);
+        assert(msgs[i].from == _prio_bulk && 0 == strcmp(msgs[i].buf, expect));
+    }
+    assert(0 == _wait_drain(to));
+
+    bus_release(ctrl);
+    bus_release(bulk);
+    bus_release(to);
+    return 0;
+}
+
+static bus_addr_t _spill_from = (20 << 16) + 1;
+static bus_addr_t _spill_to = (21 << 16) + 1;
+static int _spill_marks[2];
+
+static void
+_spill_mark(bus_t* bt, bus_addr_t to, int high, void* arg) {
+    assert(to == _spill_to);
+    // high & low in turn
+    assert(_spill_marks[1] + (high ? 0 : 1) == _spill_marks[0]);
+    ++ _spill_marks[high ? 0 : 1];
+}
+
+// stat is kept in shm since last time
+static uint64_t
+_spill_stat(bus_t* bt, uint64_t* spills) {
+    bus_pipe_stat_t stats[TEST_BUS_MAX_STAT];
+    int n = bus_stat(bt, stats, TEST_BUS_MAX_STAT);
+    for (int i = 0; i < n; ++ i) {
+        if (stats[i].from == _spill_from && stats[i].to == _spill_to && !stats[i].bcast) {
+            *spills = stats[i].stat.spill_msgs;
+            return stats[i].stat.spill_drops;
+        }
+    }
+    *spills = 0;
+    return 0;
+}
+
+int
+test_logic_bus_spill(const char* param) {
+    bus_t* to = bus_create(TEST_BUS_KEY, _spill_to);
+    bus_t* from = bus_create(TEST_BUS_KEY, _spill_from);
+    assert(to && from);
+    assert(BUS_ERR_FAIL == bus_set_spill(from, 4096, 512, 2048, _spill_mark, NULL));
+    // high watermark is reached only if heads of messages are counted
+    assert(BUS_OK == bus_set_spill(from, 4096, 4000, 512, _spill_mark, NULL));
+    bus_set_pipe_size(from, _spill_to, 1024);
+    bus_poll(from);
+    bus_poll(to);
+    _wait_drain(to);
+    memset(_spill_marks, 0, sizeof(_spill_marks));
+    uint64_t spills0;
+    _spill_stat(from, &spills0);
+
+    // burst over pipe size is spilled, then dropped over spill size
+    char buf[TEST_BUS_MSG_SIZE];
+    int sent = 0, drops = 0;
+    for (int i = 0; i < 100; ++ i) {
+        memset(buf, 0, sizeof(buf));
+        snprintf(buf, sizeof(buf), "%d", sent);
+        int ret = bus_send(from, buf, sizeof(buf), _spill_to);
+        if (ret == BUS_OK) {
+            assert(0 == drops);
+            ++ sent;
+        } else {
+            assert(BUS_ERR_SEND_FAIL == ret);
+            ++ drops;
+        }
+    }
+    assert(sent > 1024 / TEST_BUS_MSG_SIZE && drops > 0);
+    assert(1 == _spill_marks[0] && 0 == _spill_marks[1]);
+    uint64_t spills1;
+    uint64_t drops0 = _spill_stat(from, &spills1);
+    assert(drops0 >= (uint64_t)drops);
+    assert(spills1 - spills0 == 4096 / rbuffer_record_size(sizeof(buf)));
+
+    // flushed by poll in order
+    bus_poll(to);
+    int recv = 0;
+    for (int i = 0; i < 1000 && recv < sent; ++ i) {
+        bus_msg_t msg;
+        msg.buf = buf;
+        msg.bufsz = sizeof(buf);
+        while (bus_recv_batch(to, &msg, 1) == 1) {
+            assert(msg.from == _spill_from && atoi(buf) == recv ++);
+            msg.bufsz = sizeof(buf);
+        }
+        bus_poll(from);
+    }
+    assert(recv == sent);
+    assert(1 == _spill_marks[0] && 1 == _spill_marks[1]);
+    assert(0 == _wait_drain(to));
+    assert(drops0 == _spill_stat(from, &spills1));
+
+    bus_set_spill(from, 0, 0, 0, NULL, NULL);
+    bus_release(from);
+    bus_release(to);
+    return 0;
+}
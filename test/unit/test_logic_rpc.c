@@ -0,0 +1,180 @@
+#include <assert.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "logic/rpc.h"
+
+#define TEST_RPC_BUS_KEY 0x1235
+#define TEST_RPC_MSG_SIZE 64
+#define TEST_RPC_CRT_STACK (64 * 1024)
+
+static bus_addr_t _client_addr = (16 << 16) + 1;
+static bus_addr_t _server_addr = (17 << 16) + 1;
+
+// hold "late" requests, reply after client timeout
+static bus_addr_t _late_from;
+static uint32_t _late_id;
+
+static void
+_server_handle(rpc_t* rpc, bus_addr_t from, uint32_t id,
+               const char* buf, size_t bufsz, void* arg) {
+    if (bufsz == 5 && 0 == memcmp(buf, "late", 5)) {
+        _late_from = from;
+        _late_id = id;
+        return;
+    }
+    // server allows larger messages than client
+    if (bufsz == 4 && 0 == memcmp(buf, "big", 4)) {
+        char big[TEST_RPC_MSG_SIZE * 2];
+        memset(big, 'b', sizeof(big));
+        assert(RPC_OK == rpc_reply(rpc, from, id, big, sizeof(big)));
+        return;
+    }
+    char rsp[TEST_RPC_MSG_SIZE];
+    int n = snprintf(rsp, sizeof(rsp), "echo %s", buf);
+    assert(RPC_OK == rpc_reply(rpc, from, id, rsp, n + 1));
+}
+
+typedef struct result_t {
+    int err;
+    char rsp[TEST_RPC_MSG_SIZE];
+    int done;
+} result_t;
+
+static void
+_client_done(rpc_t* rpc, int err, const char* buf, size_t bufsz, void* arg) {
+    result_t* r = (result_t*)arg;
+    r->err = err;
+    if (buf) {
+        assert(bufsz <= sizeof(r->rsp));
+        memcpy(r->rsp, buf, bufsz);
+    }
+    r->done = 1;
+}
+
+static void
+_pump(rpc_t* client, rpc_t* server, timerheap_t* timer) {
+    struct timeval now;
+    rpc_poll(server, 64);
+    rpc_poll(client, 64);
+    gettimeofday(&now, NULL);
+    timer_poll(timer, &now);
+}
+
+#if defined(OS_LINUX)
+typedef struct crt_arg_t {
+    rpc_t* client;
+    int err;
+    char rsp[TEST_RPC_MSG_SIZE];
+    size_t rspsz;
+} crt_arg_t;
+
+static void
+_crt_call(crt_t* crt, void* arg) {
+    crt_arg_t* ca = (crt_arg_t*)arg;
+    ca->rspsz = sizeof(ca->rsp);
+    ca->err = rpc_call_crt(ca->client, crt, _server_addr, "crt", 4, 1000,
+                           ca->rsp, &ca->rspsz);
+}
+#endif
+
+int
+test_logic_rpc(const char* param) {
+    bus_t* cbus = bus_create(TEST_RPC_BUS_KEY, _client_addr);
+    bus_t* sbus = bus_create(TEST_RPC_BUS_KEY, _server_addr);
+    assert(cbus && sbus);
+    bus_poll(cbus);
+    bus_poll(sbus);
+    timerheap_t* timer = timer_create_heap();
+    rpc_t* client = rpc_create(cbus, timer, 4, TEST_RPC_MSG_SIZE);
+    rpc_t* server = rpc_create(sbus, NULL, 0, TEST_RPC_MSG_SIZE * 4);
+    assert(client && server);
+    rpc_set_handler(server, _server_handle, NULL);
+    // messages left by last time
+    while (rpc_poll(server, 64) > 0 || rpc_poll(client, 64) > 0);
+
+    // callbacks, table is full at 4 pending
+    result_t rs[5];
+    memset(rs, 0, sizeof(rs));
+    for (int i = 0; i < 4; ++ i) {
+        char req[TEST_RPC_MSG_SIZE];
+        int n = snprintf(req, sizeof(req), "%d", i);
+        assert(RPC_OK == rpc_call(client, _server_addr, req, n + 1, 1000, _client_done, &rs[i]));
+    }
+    assert(4 == rpc_pending(client));
+    assert(RPC_ERR_FULL == rpc_call(client, _server_addr, "x", 2, 1000, _client_done, &rs[4]));
+    bus_poll(sbus);
+    for (int i = 0; i < 100 && rpc_pending(client) > 0; ++ i) {
+        _pump(client, server, timer);
+        bus_poll(cbus);
+    }
+    assert(0 == rpc_pending(client));
+    for (int i = 0; i < 4; ++ i) {
+        char expect[TEST_RPC_MSG_SIZE];
+        snprintf(expect, sizeof(expect), "echo %d", i);
+        assert(rs[i].done && RPC_OK == rs[i].err);
+        assert(0 == strcmp(expect, rs[i].rsp));
+    }
+
+    // timeout, and the late response is dropped
+    result_t late;
+    memset(&late, 0, sizeof(late));
+    assert(RPC_OK == rpc_call(client, _server_addr, "late", 5, 20, _client_done, &late));
+    for (int i = 0; i < 1000 && !late.done; ++ i) {
+        _pump(client, server, timer);
+        usleep(1000);
+    }
+    assert(late.done && RPC_ERR_TIMEOUT == late.err);
+    assert(RPC_OK == rpc_reply(server, _late_from, _late_id, "late", 5));
+    late.done = 0;
+    _pump(client, server, timer);
+    assert(!late.done && 0 == rpc_pending(client));
+
+    // larger response fails the call, and doesn't block the following
+    // non-rpc message is rejected
+    uint64_t rejects = rpc_rejects(client);
+    result_t big, next;
+    memset(&big, 0, sizeof(big));
+    memset(&next, 0, sizeof(next));
+    assert(BUS_OK == bus_send(sbus, "junk", 5, _client_addr));
+    assert(RPC_OK == rpc_call(client, _server_addr, "big", 4, 1000, _client_done, &big));
+    assert(RPC_OK == rpc_call(client, _server_addr, "next", 5, 1000, _client_done, &next));
+    for (int i = 0; i < 100 && rpc_pending(client) > 0; ++ i) {
+        _pump(client, server, timer);
+    }
+    assert(big.done && RPC_ERR_TRUNCATE == big.err);
+    assert(next.done && RPC_OK == next.err && 0 == strcmp("echo next", next.rsp));
+    assert(rejects + 2 == rpc_rejects(client));
+
+#if defined(OS_LINUX)
+    // coroutine waiter
+    crt_t* crt = crt_create(TEST_RPC_CRT_STACK);
+    crt_arg_t ca;
+    memset(&ca, 0, sizeof(ca));
+    ca.client = client;
+    ca.err = RPC_ERR_FAIL;
+    int id = crt_new(crt, _crt_call, &ca);
+    crt_resume(crt, id);
+    assert(1 == rpc_pending(client));
+    for (int i = 0; i < 100 && crt_status(crt, id) != CRT_DEAD; ++ i) {
+        _pump(client, server, timer);
+    }
+    assert(RPC_OK == ca.err);
+    assert(ca.rspsz == 9 && 0 == strcmp("echo crt", ca.rsp));
+    crt_release(crt);
+#endif
+
+    // pending calls are canceled by release
+    result_t cancel;
+    memset(&cancel, 0, sizeof(cancel));
+    assert(RPC_OK == rpc_call(client, _server_addr, "late", 5, 0, _client_done, &cancel));
+    rpc_release(client);
+    assert(cancel.done && RPC_ERR_CANCEL == cancel.err);
+    while (rpc_poll(server, 64) > 0);
+
+    rpc_release(server);
+    timer_release(timer);
+    bus_release(cbus);
+    bus_release(sbus);
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "net/sock.h"
+#include "net/reactor.h"
+#include "net/acceptor.h"
+
+#define TEST_ACC_IP "127.0.0.1"
+#define TEST_ACC_PORT 8400
+#define TEST_ACC_FDS 256
+
+static int _accepted;
+static uint16_t _peer_port;
+
+static int
+_acc_read(sock_t fd, void* arg, const sockaddr_t* peer) {
+    ++ _accepted;
+    _peer_port = ntohs(((const sockaddrin_t*)peer)->sin_port);
+    // nonblocking by acceptor
+    assert(fcntl(fd, F_GETFL) & O_NONBLOCK);
+    sock_close(fd);
+    return 0;
+}
+
+static sock_t
+_connect() {
+    sockaddrin_t addr;
+    assert(0 == sock_addr_aton(TEST_ACC_IP, TEST_ACC_PORT, &addr));
+    sock_t fd = sock_tcp();
+    if (fd == INVALID_SOCK)
+        return fd;
+    assert(0 == connect(fd, (sockaddr_t*)&addr, sizeof(addr)));
+    return fd;
+}
+
+// out of fds, pending connection is refused and acceptor keeps working
+int
+test_net_acceptor_emfile(const char* param) {
+    reactor_t* r = reactor_create();
+    acc_t* acc = acc_create(r);
+    assert(r && acc);
+    acc_set_read_func(acc, _acc_read, NULL);
+    sockaddrin_t addr;
+    assert(0 == sock_addr_aton(TEST_ACC_IP, TEST_ACC_PORT, &addr));
+    assert(0 == acc_start(acc, (sockaddr_t*)&addr));
+
+    struct rlimit old, lim;
+    assert(0 == getrlimit(RLIMIT_NOFILE, &old));
+    lim = old;
+    lim.rlim_cur = TEST_ACC_FDS;
+    assert(0 == setrlimit(RLIMIT_NOFILE, &lim));
+
+    // exhaust fds, leave one for client
+    int fds[TEST_ACC_FDS];
+    int n = 0;
+    while (n < TEST_ACC_FDS && (fds[n] = dup(0)) >= 0)
+        ++ n;
+    assert(n > 0 && n < TEST_ACC_FDS);
+    close(fds[-- n]);
+    _accepted = 0;
+    sock_t c = _connect();
+    assert(c != INVALID_SOCK);
+    for (int i = 0; i < 10; ++ i)
+        assert(reactor_dispatch(r, 10) >= 0);
+    assert(0 == _accepted);
+    // closed, not timeout
+    struct timeval tv = { 1, 0 };
+    setsockopt(c, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    char buf[8];
+    errno = 0;
+    assert(read(c, buf, sizeof(buf)) <= 0 && EAGAIN != errno);
+    sock_close(c);
+
+    // recovered
+    while (n > 0)
+        close(fds[-- n]);
+    assert(0 == setrlimit(RLIMIT_NOFILE, &old));
+    c = _connect();
+    assert(c != INVALID_SOCK);
+    for (int i = 0; i < 100 && 0 == _accepted; ++ i)
+        assert(reactor_dispatch(r, 10) >= 0);
+    assert(1 == _accepted);
+    sockaddrin_t local;
+    socklen_t len = sizeof(local);
+    assert(0 == getsockname(c, (sockaddr_t*)&local, &len));
+    assert(_peer_port == ntohs(local.sin_port));
+    sock_close(c);
+
+    acc_release(acc);
+    reactor_release(r);
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "net/sock.h"
+#include "net/reactor.h"
+#include "net/connector.h"
+
+#define TEST_CON_LARGE (1 << 20)
+#define TEST_CON_PEERS 2
+
+static int
+_con_read(sock_t fd, void* arg, const char* buffer, int buflen) {
+    return buflen;
+}
+
+// read n bytes from peer while dispatching
+static void
+_con_recv(reactor_t* r, sock_t peer, char* buf, int n) {
+    int nread = 0;
+    for (int i = 0; i < 100000 && nread < n; ++ i) {
+        reactor_dispatch(r, 0);
+        int res = read(peer, buf + nread, n - nread);
+        if (res > 0)
+            nread += res;
+        else
+            assert(res < 0 && EAGAIN == errno);
+    }
+    assert(nread == n);
+}
+
+static char*
+_con_pattern(int n, int seed) {
+    char* buf = (char*)MALLOC(n);
+    for (int i = 0; i < n; ++ i)
+        buf[i] = (char)(i * 31 + seed);
+    return buf;
+}
+
+int
+test_net_connector_sendv(const char* param) {
+    reactor_t* r = reactor_create();
+    assert(r);
+    con_t* cons[TEST_CON_PEERS];
+    sock_t peers[TEST_CON_PEERS];
+    for (int i = 0; i < TEST_CON_PEERS; ++ i) {
+        int fds[2];
+        assert(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+        assert(0 == sock_set_nonblock(fds[1]));
+        cons[i] = con_create(r);
+        assert(cons[i]);
+        con_set_read_func(cons[i], _con_read, NULL);
+        con_set_sock(cons[i], fds[0]);
+        assert(0 == con_start(cons[i]));
+        peers[i] = fds[1];
+    }
+    char* recv = (char*)MALLOC(TEST_CON_LARGE);
+
+    // nothing pending, written at once without dispatch
+    assert(0 == con_send(cons[0], "now", 3));
+    assert(3 == read(peers[0], recv, TEST_CON_LARGE));
+    assert(0 == memcmp(recv, "now", 3));
+
+    // larger than wbuf, queued
+    char* large = _con_pattern(TEST_CON_LARGE, 1);
+    assert(0 == con_send(cons[0], "head", 4));
+    assert(0 == con_send(cons[0], large, TEST_CON_LARGE));
+    assert(0 == con_send(cons[0], "tail", 4));
+    _con_recv(r, peers[0], recv, 4);
+    assert(0 == memcmp(recv, "head", 4));
+    _con_recv(r, peers[0], recv, TEST_CON_LARGE);
+    assert(0 == memcmp(recv, large, TEST_CON_LARGE));
+    _con_recv(r, peers[0], recv, 4);
+    assert(0 == memcmp(recv, "tail", 4));
+
+    // gathered
+    struct iovec iov[3];
+    iov[0].iov_base = "abc";
+    iov[0].iov_len = 3;
+    iov[1].iov_base = large;
+    iov[1].iov_len = 1000;
+    iov[2].iov_base = "xyz";
+    iov[2].iov_len = 3;
+    assert(0 == con_sendv(cons[0], iov, 3));
+    _con_recv(r, peers[0], recv, 1006);
+    assert(0 == memcmp(recv, "abc", 3));
+    assert(0 == memcmp(recv + 3, large, 1000));
+    assert(0 == memcmp(recv + 1003, "xyz", 3));
+
+    // shared by connections
+    con_seg_t* seg = con_seg_create(large, TEST_CON_LARGE);
+    assert(seg);
+    for (int i = 0; i < TEST_CON_PEERS; ++ i)
+        assert(0 == con_send_seg(cons[i], seg));
+    con_seg_release(seg);
+    for (int i = 0; i < TEST_CON_PEERS; ++ i) {
+        memset(recv, 0, TEST_CON_LARGE);
+        _con_recv(r, peers[i], recv, TEST_CON_LARGE);
+        assert(0 == memcmp(recv, large, TEST_CON_LARGE));
+    }
+
+    // queue limited
+    char* huge = (char*)MALLOC(CONNECTOR_QUEUE_MAX + 1);
+    assert(0 != con_send(cons[0], huge, CONNECTOR_QUEUE_MAX + 1));
+    FREE(huge);
+
+    for (int i = 0; i < TEST_CON_PEERS; ++ i) {
+        con_release(cons[i]);
+        close(peers[i]);
+    }
+    FREE(large);
+    FREE(recv);
+    reactor_release(r);
+    return 0;
+}
@@ -16,6 +16,8 @@
 #define ECHO_PORT 8000
 
 static int _insts;
+static int _s_edge;
+static int _s_uring;
 static reactor_t* _s_reactor;
 static idtable_t* _s_cons;
 
@@ -58,7 +60,7 @@ _conn_close(sock_t fd, void* arg) {
 }
 
 static int
-_accept_read(sock_t fd, void* arg) {
+_accept_read(sock_t fd, void* arg, const sockaddr_t* peer) {
     ConCtx* ctx = (ConCtx*)MALLOC(sizeof(ConCtx));
     assert(ctx);
 
@@ -68,6 +70,7 @@ _accept_read(sock_t fd, void* arg) {
     con_set_read_func(ctx->con, _conn_read, NULL);
     con_set_close_func(ctx->con, _conn_close, NULL);
     con_set_sock(ctx->con, fd);
+    con_set_nonblock(ctx->con);
 
     int res = idtable_add(_s_cons, fd, ctx);
     assert(0 == res);
@@ -85,8 +88,12 @@ static void*
 echo_server(void* arg) {
 
     _s_cons = idtable_create(1024);
-    _s_reactor = reactor_create();
+    _s_reactor = _s_uring ? reactor_create_uring() : reactor_create();
     assert(_s_cons && _s_reactor);
+    if (_s_edge) {
+        int res = reactor_set_edge(_s_reactor, 1);
+        assert(0 == res);
+    }
 
     printf("echo server start\n");
 
@@ -226,3 +233,24 @@ test_net_echo(const char* param) {
     return 0;
 }
 
+int
+test_net_echo_edge(const char* param) {
+    _s_edge = 1;
+    int res = test_net_echo(param);
+    _s_edge = 0;
+    return res;
+}
+
+int
+test_net_echo_uring(const char* param) {
+    reactor_t* r = reactor_create_uring();
+    if (!r) {
+        printf("io_uring not supported\n");
+        return 0;
+    }
+    reactor_release(r);
+    _s_uring = 1;
+    int res = test_net_echo(param);
+    _s_uring = 0;
+    return res;
+}
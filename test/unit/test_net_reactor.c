@@ -0,0 +1,231 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "core/atom.h"
+#include "net/reactor.h"
+#include "net/reactor_group.h"
+#include "util/util_time.h"
+
+#define TEST_REACTOR_FDS 64
+#define TEST_GROUP_LOOPS 4
+#define TEST_GROUP_CONNS 64
+#define TEST_GROUP_IP "127.0.0.1"
+#define TEST_GROUP_PORT 8200
+#define TEST_TIMER_MS 20
+
+static reactor_t* _r;
+static handler_t* _hs[TEST_REACTOR_FDS];
+static int _peers[TEST_REACTOR_FDS];
+static int _calls;
+static int _uring;
+
+static int
+_stale_close(handler_t* h) {
+    return 0;
+}
+
+// the first ready handler closes all the others, and reuses their slots
+static int
+_stale_in(handler_t* h) {
+    ++ _calls;
+    for (int i = 0; i < TEST_REACTOR_FDS; ++ i) {
+        if (!_hs[i] || _hs[i] == h)
+            continue;
+        assert(0 == reactor_unregister(_r, _hs[i]));
+        close(_hs[i]->fd);
+        close(_peers[i]);
+        memset(_hs[i], 0xff, sizeof(handler_t));
+        FREE(_hs[i]);
+        _hs[i] = NULL;
+    }
+    int fds[2];
+    for (int i = 0; i < TEST_REACTOR_FDS; ++ i) {
+        if (_hs[i])
+            continue;
+        assert(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+        assert(1 == write(fds[1], "x", 1));
+        _hs[i] = (handler_t*)MALLOC(sizeof(handler_t));
+        _hs[i]->fd = fds[0];
+        _hs[i]->in_func = _stale_in;
+        _hs[i]->out_func = NULL;
+        _hs[i]->close_func = _stale_close;
+        _peers[i] = fds[1];
+        assert(0 == reactor_register(_r, _hs[i], EVENT_IN));
+    }
+    char c;
+    assert(1 == read(h->fd, &c, 1));
+    return 0;
+}
+
+int
+test_net_reactor_stale(const char* param) {
+    _r = _uring ? reactor_create_uring() : reactor_create();
+    if (!_r) {
+        printf("reactor not supported\n");
+        return 0;
+    }
+    int fds[2];
+    for (int i = 0; i < TEST_REACTOR_FDS; ++ i) {
+        assert(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+        assert(1 == write(fds[1], "x", 1));
+        _hs[i] = (handler_t*)MALLOC(sizeof(handler_t));
+        _hs[i]->fd = fds[0];
+        _hs[i]->in_func = _stale_in;
+        _hs[i]->out_func = NULL;
+        _hs[i]->close_func = _stale_close;
+        _peers[i] = fds[1];
+        assert(0 == reactor_register(_r, _hs[i], EVENT_IN));
+    }
+
+    // all ready, but events of closed handlers are skipped
+    _calls = 0;
+    assert(reactor_dispatch(_r, 100) > 0);
+    assert(1 == _calls);
+
+    for (int i = 0; i < TEST_REACTOR_FDS; ++ i) {
+        reactor_unregister(_r, _hs[i]);
+        close(_hs[i]->fd);
+        close(_peers[i]);
+        FREE(_hs[i]);
+        _hs[i] = NULL;
+    }
+    reactor_release(_r);
+    return 0;
+}
+
+int
+test_net_reactor_stale_uring(const char* param) {
+    _uring = 1;
+    int res = test_net_reactor_stale(param);
+    _uring = 0;
+    return res;
+}
+
+static atom_t _accepted[TEST_GROUP_LOOPS];
+static atom_t _posted[TEST_GROUP_LOOPS];
+
+static int
+_group_loop(rgroup_t* g, reactor_t* r) {
+    for (int i = 0; i < rgroup_size(g); ++ i) {
+        if (rgroup_reactor(g, i) == r)
+            return i;
+    }
+    return -1;
+}
+
+static void
+_group_accept(reactor_t* r, sock_t fd, void* arg) {
+    int loop = _group_loop((rgroup_t*)arg, r);
+    assert(loop >= 0);
+    atom_inc(&_accepted[loop]);
+    sock_close(fd);
+}
+
+static void
+_group_post(reactor_t* r, void* arg) {
+    int loop = _group_loop((rgroup_t*)arg, r);
+    assert(loop >= 0);
+    atom_inc(&_posted[loop]);
+}
+
+static uint32_t
+_group_sum(atom_t* counts) {
+    uint32_t sum = 0;
+    for (int i = 0; i < TEST_GROUP_LOOPS; ++ i)
+        sum += atom_load_acquire(&counts[i]);
+    return sum;
+}
+
+int
+test_net_reactor_group(const char* param) {
+    memset(_accepted, 0, sizeof(_accepted));
+    memset(_posted, 0, sizeof(_posted));
+    rgroup_t* g = rgroup_create(TEST_GROUP_LOOPS, 1);
+    assert(g && TEST_GROUP_LOOPS == rgroup_size(g));
+
+    sockaddrin_t addr;
+    assert(0 == sock_addr_aton(TEST_GROUP_IP, TEST_GROUP_PORT, &addr));
+    assert(0 == rgroup_listen(g, (sockaddr_t*)&addr, _group_accept, g));
+    assert(0 == rgroup_start(g));
+    // listen after start
+    assert(0 != rgroup_listen(g, (sockaddr_t*)&addr, _group_accept, g));
+
+    // closures run in their own loops
+    for (int i = 0; i < TEST_GROUP_LOOPS; ++ i) {
+        for (int j = 0; j <= i; ++ j)
+            assert(0 == rgroup_post(g, i, _group_post, g));
+    }
+    for (int i = 0; i < TEST_GROUP_CONNS; ++ i) {
+        sock_t fd = sock_tcp();
+        assert(fd != INVALID_SOCK);
+        assert(0 == connect(fd, (sockaddr_t*)&addr, sizeof(addr)));
+        sock_close(fd);
+    }
+    for (int i = 0; i < 500; ++ i) {
+        if (TEST_GROUP_CONNS == _group_sum(_accepted)
+            && TEST_GROUP_LOOPS * (TEST_GROUP_LOOPS + 1) / 2 == _group_sum(_posted))
+            break;
+        usleep(10000);
+    }
+    assert(TEST_GROUP_CONNS == _group_sum(_accepted));
+    for (int i = 0; i < TEST_GROUP_LOOPS; ++ i) {
+        assert(i + 1 == atom_load_acquire(&_posted[i]));
+        printf("loop %d accepted %u\n", i, atom_load_acquire(&_accepted[i]));
+    }
+
+    assert(0 == rgroup_stop(g));
+    rgroup_release(g);
+    return 0;
+}
+
+static tv_t _fired;
+
+static int
+_timer_fire(void* args) {
+    gettimeofday(&_fired, NULL);
+    return 0;
+}
+
+int
+test_net_reactor_timer(const char* param) {
+    reactor_t* r = reactor_create();
+    timerheap_t* timer = timer_create_heap();
+    assert(r && timer);
+    assert(0 == reactor_set_timer(r, timer));
+
+    tv_t delay, start, late;
+    delay.tv_sec = 0;
+    delay.tv_usec = TEST_TIMER_MS * 1000;
+    memset(&_fired, 0, sizeof(_fired));
+    gettimeofday(&start, NULL);
+    assert(TIMER_INVALID_ID != timer_register(timer, NULL, &delay, _timer_fire, NULL));
+
+    // wakes up for the timer, not the long timeout
+    int loops = 0;
+    while (0 == _fired.tv_sec && loops < 100) {
+        assert(reactor_dispatch(r, 10000) >= 0);
+        ++ loops;
+    }
+    assert(_fired.tv_sec > 0);
+    util_time_sub(&_fired, &start, &late);
+    int64_t us = (int64_t)late.tv_sec * 1000000 + late.tv_usec - TEST_TIMER_MS * 1000;
+    printf("timer fired %"PRId64" us late after %d dispatch\n", us, loops);
+    assert(us >= 0 && us < 1000 * TEST_TIMER_MS);
+    assert(loops <= 3);
+
+    // no timer, timeout as it is
+    gettimeofday(&start, NULL);
+    assert(0 == reactor_dispatch(r, TEST_TIMER_MS));
+    gettimeofday(&_fired, NULL);
+    util_time_sub(&_fired, &start, &late);
+    assert(late.tv_sec * 1000 + late.tv_usec / 1000 >= TEST_TIMER_MS - 1);
+
+    reactor_release(r);
+    timer_release(timer);
+    return 0;
+}